@@ -35,6 +35,36 @@ class Executor {
 		std::istringstream * mStream;
 };
 
+//----------------------------------------------------------------------------
+// Command run once through the shell, with pipes to its standard input and
+// output, so that many lines can be sent to it and its replies read back
+// without starting a new process for each. Writing and reading may be done
+// from different threads. Not available on Windows.
+//----------------------------------------------------------------------------
+
+class Coprocess {
+
+	CANNOT_COPY( Coprocess );
+
+	public:
+
+		Coprocess( const std::string & cmd );
+		~Coprocess();
+
+		void Write( const char * p, unsigned int len );
+		unsigned int Read( char * p, unsigned int len );
+		void CloseInput();
+		void Kill();
+		int Wait();
+
+	private:
+
+		void CloseOutput();
+
+		std::string mCmd;
+		int mPid, mIn, mOut;
+};
+
 //------------------------------------------------------------------------
 
 }  // namespace
@@ -11,9 +11,10 @@
 
 #include "a_base.h"
 #include "a_dict.h"
+#include "a_regex.h"
 #include <stack>
 #include <iosfwd>
-#include <deque>
+#include <exception>
 
 namespace ALib {
 
@@ -59,6 +60,85 @@ class ExprToken {
 		int mPrec;
 };
 
+//----------------------------------------------------------------------------
+// Values on the evaluation stack. A value may be held as a string, as a
+// number, or both - we only convert between the two when an operation
+// actually needs the other form.
+//----------------------------------------------------------------------------
+
+class ExprValue {
+
+	public:
+
+		ExprValue() : mHasStr( true ), mNumState( nsUnknown ), mNum( 0 ) {}
+
+		void SetNum( double d );
+		void SetStr( const std::string & s );
+		void Append( const std::string & s );
+
+		bool IsNum();
+		double GetNum() const;
+		const std::string & GetStr();
+		bool ToBool();
+
+	private:
+
+		enum NumState { nsUnknown, nsNum, nsNotNum };
+
+		bool mHasStr;
+		NumState mNumState;
+		double mNum;
+		std::string mStr;
+};
+
+//----------------------------------------------------------------------------
+// Parameters passed to a function. These are a view of the top of the
+// evaluation stack, so calling a function does not copy its parameters.
+//----------------------------------------------------------------------------
+
+class ExprArgs {
+
+	public:
+
+		ExprArgs( ExprValue * base, unsigned int n )
+			: mBase( base ), mSize( n ) {}
+
+		unsigned int Size() const {
+			return mSize;
+		}
+
+		const std::string & operator[]( unsigned int i ) const {
+			return mBase[i].GetStr();
+		}
+
+	private:
+
+		ExprValue * mBase;
+		unsigned int mSize;
+};
+
+//----------------------------------------------------------------------------
+// Compiled instruction. The meaning of the argument depends on the opcode -
+// it may index the constants, names or variable slots of the expression,
+// or give the number of a positional parameter.
+//----------------------------------------------------------------------------
+
+struct ExprInstr {
+
+	enum OpCode {
+		opConst, opPosParam, opVar, opReadVar, opCall, opCallNamed,
+		opCat, opAdd, opSub, opMul, opDiv, opMod, opNeg,
+		opEq, opNe, opLt, opGt, opLe, opGe, opAnd, opOr, opBool,
+		opJump, opJumpFalse, opAndJump, opOrJump,
+		opBad, opEnd
+	};
+
+	ExprInstr( OpCode op, int arg = 0 ) : mOp( op ), mArg( arg ) {}
+
+	OpCode mOp;
+	int mArg;
+};
+
 //----------------------------------------------------------------------------
 /// Simple arithmetic & string expression evaluator
 //----------------------------------------------------------------------------
@@ -71,8 +151,11 @@ class Expression {
 		typedef std::vector <ExprToken> RPNRep;
 
 		// type for functions within expression
-		typedef std::string (*FuncImpl)( const std::deque <std::string> &,
-											Expression * );
+		typedef std::string (*FuncImpl)( const ExprArgs &, Expression * );
+
+		// block of rows for batch evaluation, and selection of rows in it
+		typedef std::vector <std::vector <std::string> > Batch;
+		typedef std::vector <char> Selection;
 
 		Expression();
 		~Expression();
@@ -85,19 +168,35 @@ class Expression {
 
 		void ClearPosParams();
 		void AddPosParam( const std::string & s );
+		void BindPosParams( const std::vector <std::string> & params );
 
 		unsigned int PosParamCount() const;
 		std::string PosParam( unsigned int i ) const;
 
+		unsigned int EvaluateBatch( const Batch & rows, unsigned int n,
+									const Selection & sel,
+									std::vector <std::string> & results );
+		unsigned int SelectBatch( const Batch & rows, unsigned int n,
+									const Selection & sel,
+									Selection & selected );
+		void ThrowBatchError() const;
+
+		bool UsesVars() const;
+		bool IsStateful() const;
+
 		void ClearVars();
 		void AddVar( const std::string & name, const std::string & val );
+		unsigned int VarSlot( const std::string & name );
+		void SetVar( unsigned int slot, const std::string & val );
 
 		struct AddFunc {
 			FuncImpl mFunc;
 			unsigned int mParamCount;
+			bool mStateful;
 
-			AddFunc( const std::string & name, FuncImpl fi, unsigned int np )
-				: mFunc( fi ), mParamCount( np ) {
+			AddFunc( const std::string & name, FuncImpl fi, unsigned int np,
+						bool stateful = false )
+				: mFunc( fi ), mParamCount( np ), mStateful( stateful ) {
 				Expression::AddFunction( name, * this );
 			}
 		};
@@ -108,24 +207,85 @@ class Expression {
 		static void SetRNGSeed( int n );
 		static int GetRNGSeed();
 
+		const RegEx & GetRegEx( const std::string & pattern );
+
 	private:
 
-		std::string PopStr();
-		double PopNum();
+		typedef std::vector <ExprInstr> Code;
+
+		void Generate();
+		unsigned int AddName( const std::string & name );
+		unsigned int AddConst( const std::string & val );
+		bool IsConst( const Code & c ) const;
+		static void Append( Code & to, const Code & from );
+		void Flatten( std::vector <Code> & frags, bool & flat );
+		void GenOp( std::vector <Code> & frags, bool & flat,
+						const ExprInstr & in, unsigned int nargs );
+		void GenAndOr( std::vector <Code> & frags, ExprInstr::OpCode op );
+		void GenIf( std::vector <Code> & frags );
+		void Fold( Code & c );
+		void Run();
+		ExprValue & Push();
+		ExprValue & Operand( unsigned int n );
+		double NumOperand( unsigned int n );
 		std::string GetVar( const std::string & var ) const;
-		void DoCompare( const std::string & op );
-		void DoAndOr( const std::string & op );
-		void PushBool( bool b );
-		void ExecOp( const ExprToken & tok );
-		bool EvalSingleExpr( unsigned int & ei, std::string & result );
-		std::string CallFunction( const std::string & name );
+		void CallFunction( const std::string & name, const AddFunc * af,
+							int site );
+
+		void RunBatch( const Batch & rows, unsigned int n,
+						const Selection & sel );
+		void RunBatchRows( const Batch & rows );
+		void BatchOp( unsigned int pc, unsigned int sp, const Batch & rows );
+		void BatchCall( const ExprInstr & in, unsigned int sp,
+							const Batch & rows );
+		void BatchJump( unsigned int pc, unsigned int sp );
+		void BatchFail( unsigned int row );
+		ExprValue & BatchOperand( unsigned int sp, unsigned int n,
+									unsigned int row );
+
+		const std::vector <std::string> & PosParams() const;
 
 		std::vector <std::string> mPosParams;
-		std::stack <std::string> mStack;
-		Dictionary <std::string> mVars;
+		const std::vector <std::string> * mBoundParams;
+
+		Dictionary <unsigned int> mVarSlots;
+		std::vector <std::string> mVarNames, mVarVals;
+		std::vector <bool> mVarSet;
 
 		RPNRep mRPN;
 
+		Code mCode;
+		std::vector <ExprValue> mConsts;
+		std::vector <std::string> mNames;
+		std::vector <const AddFunc *> mNameFuncs;
+
+		std::vector <ExprValue> mStack;
+		unsigned int mSP;
+		ExprValue mResult;
+
+		bool mUsesVars, mStateful, mBatchable;
+
+		std::vector <std::vector <ExprValue> > mBatchStack;
+		std::vector <ExprValue> mBatchResult, mBatchArgs;
+		std::vector <unsigned int> mActive;
+		std::vector <std::vector <unsigned int> > mPending;
+		std::vector <int> mPendingDepth;
+		unsigned int mBatchSize, mBatchFail;
+		std::exception_ptr mBatchError;
+
+		struct CachedRegEx {
+			CachedRegEx( const std::string & pattern )
+				: mPattern( pattern ), mRegEx( pattern ), mLastUse( 0 ) {}
+			std::string mPattern;
+			RegEx mRegEx;
+			unsigned long mLastUse;
+		};
+
+		std::vector <CachedRegEx> mRegExCache;
+		std::vector <int> mSiteRegEx;
+		int mCallSite;
+		unsigned long mRegExUses;
+
 		static Dictionary <AddFunc> mFuncs;
 
 		static bool mUseRNGSeed;
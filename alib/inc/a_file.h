@@ -56,6 +56,56 @@ void FileRead( const std::string & fname, std::string & s  );
 bool FileExists( const std::string & fname );
 bool DirExists( const std::string & dirname );
 
+//---------------------------------------------------------------------------
+// File size, identity and modification and status change times, so we can
+// tell if it has been changed or replaced. Times are in nanoseconds, but
+// only have the resolution that the platform and file system provide.
+//---------------------------------------------------------------------------
+
+struct FileStamp {
+	unsigned long long mSize, mModTime, mChangeTime, mInode, mDevice;
+	bool operator == ( const FileStamp & fs ) const;
+};
+
+bool GetFileStamp( const std::string & fname, FileStamp & fs );
+
+//---------------------------------------------------------------------------
+// Check if reading standard input now would have to wait for more input,
+// as it can when it is a pipe or terminal. On Windows we can't tell, and
+// always say it would not.
+//---------------------------------------------------------------------------
+
+bool StdinWouldWait();
+
+//---------------------------------------------------------------------------
+// Read-only memory mapping of a whole file. Mappings of the same file by
+// different processes share the same memory.
+//---------------------------------------------------------------------------
+
+class MappedFile {
+
+	CANNOT_COPY( MappedFile );
+
+	public:
+
+		MappedFile();
+		~MappedFile();
+
+		bool Open( const std::string & fname );
+		void Close();
+		bool IsOpen() const;
+
+		const char * Data() const;
+		unsigned long long Size() const;
+
+	private:
+
+		const char * mData;
+		unsigned long long mSize;
+		bool mOpen;
+		void * mFile, * mMap;		// windows handles
+};
+
 //------------------------------------------------------------------------
 
 }	// end namespace
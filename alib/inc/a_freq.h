@@ -0,0 +1,64 @@
+//---------------------------------------------------------------------------
+// a_freq.h
+//
+// approximate most frequent items in a stream
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#ifndef INC_A_FREQ_H
+#define INC_A_FREQ_H
+
+#include "a_base.h"
+#include <unordered_map>
+
+namespace ALib {
+
+//---------------------------------------------------------------------------
+// Space-Saving counter for finding heavy hitters using a fixed number of
+// counters. When all counters are in use, a new key takes over the counter
+// with the lowest count. Each reported count may be too high by at most
+// its error, and any key whose real count exceeds Count() / capacity is
+// guaranteed to be present.
+//---------------------------------------------------------------------------
+
+class FrequentItems {
+
+	public:
+
+		struct Item {
+			Item( const std::string & key = "" )
+				: mKey( key ), mCount( 0 ), mError( 0 ) {}
+			std::string mKey;
+			unsigned long mCount, mError;
+		};
+
+		FrequentItems( unsigned int capacity );
+
+		void Add( const std::string & key );
+
+		unsigned long Count() const;
+		unsigned int Capacity() const;
+		void Top( unsigned int n, std::vector <Item> & items ) const;
+
+	private:
+
+		void SiftUp( unsigned int hpos );
+		void SiftDown( unsigned int hpos );
+		void Swap( unsigned int h1, unsigned int h2 );
+		bool Less( unsigned int h1, unsigned int h2 ) const;
+
+		typedef std::unordered_map <std::string, unsigned int> IndexMap;
+		IndexMap mIndex;
+		std::vector <Item> mItems;
+		std::vector <unsigned int> mHeap, mHeapPos;
+		unsigned int mCapacity;
+		unsigned long mCount;
+};
+
+//------------------------------------------------------------------------
+
+}	// end namespace
+
+#endif
+
@@ -0,0 +1,72 @@
+//---------------------------------------------------------------------------
+// a_hashset.h
+//
+// compact hashed set of strings for fast membership tests
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#ifndef INC_A_HASHSET_H
+#define INC_A_HASHSET_H
+
+#include "a_base.h"
+
+namespace ALib {
+
+//---------------------------------------------------------------------------
+// 64-bit hash of bytes. This is also used for hashes stored in files, so
+// must not be changed.
+//---------------------------------------------------------------------------
+
+unsigned long long HashBytes( const char * p, unsigned int len );
+
+//---------------------------------------------------------------------------
+// Set of strings supporting only Add and Contains. The strings are packed
+// into a single buffer and found by open addressing, so a large set uses
+// little more memory than the strings themselves. Optionally ignores case.
+// Once the set gets big enough that the table no longer fits in cache, a
+// Bloom filter is kept in front of it so that most misses are rejected
+// without touching the table.
+//---------------------------------------------------------------------------
+
+class StringSet {
+
+	public:
+
+		StringSet( bool icase = false );
+
+		void Add( const std::string & s );
+		bool Contains( const std::string & s ) const;
+
+		unsigned int Size() const;
+		void Clear();
+
+	private:
+
+		typedef unsigned long long Hash;
+
+		struct Slot {
+			unsigned int mTag;		// high bits of hash
+			unsigned int mOffset;	// into mChars, plus one - zero if empty
+		};
+
+		Hash HashOf( const std::string & s ) const;
+		bool Same( const Slot & slot, const std::string & s ) const;
+		unsigned int Probe( const std::string & s, Hash h ) const;
+		void Grow();
+		void BloomAdd( Hash h );
+		bool BloomMayHave( Hash h ) const;
+
+		bool mIgnoreCase;
+		unsigned int mSize;
+		std::vector <Slot> mSlots;
+		std::vector <char> mChars;
+		std::vector <Hash> mBloom;
+};
+
+//------------------------------------------------------------------------
+
+}	// end namespace
+
+#endif
+
@@ -0,0 +1,64 @@
+//---------------------------------------------------------------------------
+// a_lsearch.h
+//
+// search for any of a set of literal strings
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#ifndef INC_A_LSEARCH_H
+#define INC_A_LSEARCH_H
+
+#include "a_base.h"
+
+namespace ALib {
+
+//---------------------------------------------------------------------------
+// Aho-Corasick automaton, which finds out if a string contains any of a set
+// of literals in a single pass, however many literals there are. Literals
+// may be added at any time - the automaton is rebuilt on the next search.
+//---------------------------------------------------------------------------
+
+class LiteralSearch {
+
+	public:
+
+		LiteralSearch();
+
+		void Add( const std::string & lit );
+		unsigned int Size() const;
+		void Clear();
+
+		bool FindIn( const std::string & s ) const;
+
+	private:
+
+		void Build() const;
+		int Child( int node, unsigned char c ) const;
+
+		struct Node {
+			Node() : mFirst( 0 ), mCount( 0 ), mFail( 0 ), mOut( false ) {}
+			unsigned int mFirst, mCount;
+			int mFail;
+			bool mOut;
+		};
+
+		struct Edge {
+			Edge( unsigned char c, int node ) : mChar( c ), mNode( node ) {}
+			unsigned char mChar;
+			int mNode;
+		};
+
+		std::vector <std::string> mLiterals;
+		mutable bool mBuilt;
+		mutable std::vector <Node> mNodes;
+		mutable std::vector <Edge> mEdges;
+		mutable std::vector <int> mRoot;
+};
+
+//------------------------------------------------------------------------
+
+}	// end namespace
+
+#endif
+
@@ -0,0 +1,70 @@
+//---------------------------------------------------------------------------
+// a_quantile.h
+//
+// exact and approximate quantiles for alib
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#ifndef INC_A_QUANTILE_H
+#define INC_A_QUANTILE_H
+
+#include "a_base.h"
+
+namespace ALib {
+
+//---------------------------------------------------------------------------
+// Exact quantile (q in range 0 to 1) of values, using selection rather
+// than a full sort and linear interpolation between adjacent ranks. The
+// vector is partially reordered.
+//---------------------------------------------------------------------------
+
+double Quantile( std::vector <double> & v, double q );
+
+//---------------------------------------------------------------------------
+// As above for several quantiles at once - the quantiles need not be
+// sorted and results are returned in the same order as the quantiles.
+//---------------------------------------------------------------------------
+
+void Quantiles( std::vector <double> & v,
+				const std::vector <double> & qs,
+				std::vector <double> & results );
+
+//---------------------------------------------------------------------------
+// Streaming quantile sketch (KLL) using memory proportional to k rather
+// than to the number of values added. RankError() gives the normalised
+// rank error that holds with 99% confidence for the sketch size, or zero
+// while the sketch still holds every value exactly.
+//---------------------------------------------------------------------------
+
+class QuantileSketch {
+
+	public:
+
+		QuantileSketch( unsigned int k = 200 );
+
+		void Add( double d );
+
+		double Count() const;
+		double Quantile( double q ) const;
+		double RankError() const;
+
+	private:
+
+		void Compress();
+		void SetCapacities();
+
+		typedef std::vector <double> Compactor;
+		std::vector <Compactor> mLevels;
+		std::vector <unsigned int> mCapacities;
+		unsigned int mK, mSize, mMaxSize, mRandom;
+		bool mExact;
+		double mCount, mMin, mMax;
+};
+
+//------------------------------------------------------------------------
+
+}	// end namespace
+
+#endif
+
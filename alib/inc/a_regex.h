@@ -22,6 +22,8 @@
 #define INC_A_REGEX_H
 
 #include "a_base.h"
+#include "a_lsearch.h"
+#include <map>
 
 namespace ALib {
 
@@ -29,6 +31,8 @@ namespace ALib {
 
 class RegEx {
 
+	friend class RegExSet;
+
 	public:
 
 		class Encoding;
@@ -84,24 +88,54 @@ class RegEx {
 
 	private:
 
-		Pos MatchAt( const std::string & s, unsigned int start,
-						unsigned int eindex ) const;
-
 		Pos MatchEmpty() const;
 
-		bool MatchChar( const std::string & s, unsigned int si,
-							unsigned int eindex ) const;
-		unsigned int MatchClosure( const std::string & s,
-									unsigned int start,
-									unsigned int eindex,
-									unsigned int matchlen ) const;
-
 		std::string ReplaceSaved( const std::string & s ) const;
 
 		Encoding * mEnc;
 
 };
 
+//---------------------------------------------------------------------------
+// Set of regexes and literals that can all be searched for at once, so that
+// a string is only scanned once however many there are.
+//---------------------------------------------------------------------------
+
+class RegExSet {
+
+	public:
+
+		RegExSet();
+
+		void Add( const RegEx & re );
+		void AddLiteral( const std::string & lit );
+		unsigned int Size() const;
+		void Clear();
+
+		bool FindIn( const std::string & s ) const;
+
+	private:
+
+		RegExSet( const RegExSet & );
+		void operator=( const RegExSet & );
+
+		void ClearDFA() const;
+		int DFAState( const std::vector <unsigned int> & states ) const;
+		int DFANext( int ds, unsigned char c ) const;
+		bool MatchRegExes( const std::string & s ) const;
+
+		std::vector <RegEx> mAll;
+		std::vector <unsigned int> mRegExes, mBase;
+		LiteralSearch mLiterals;
+
+		typedef std::map <std::vector <unsigned int>, int> DFAIndex;
+		mutable DFAIndex mDFAIndex;
+		mutable std::vector <std::vector <unsigned int> > mDFASets;
+		mutable std::vector <int> mDFANext;
+		mutable std::vector <char> mDFAAccept;
+		mutable int mDFAStart;
+};
+
 //------------------------------------------------------------------------
 
 } // namespace
@@ -38,6 +38,30 @@ template <class TYPE> std::string Str( const TYPE & t ) {
 	return os.str();
 }
 
+//------------------------------------------------------------------------
+// Conversions for the commonest numeric types, which don't need a stream.
+// Str(double) gives exactly the same result as streaming the value.
+//------------------------------------------------------------------------
+
+std::string Str( int n );
+std::string Str( unsigned int n );
+std::string Str( long n );
+std::string Str( unsigned long n );
+std::string Str( double d );
+
+//------------------------------------------------------------------------
+// Format real into caller's buffer without allocating. If places is
+// negative, produce the shortest string that reads back as the same value,
+// otherwise use that many decimal places. Like snprintf, returns length
+// of the full output, which was truncated if this is not less than size.
+//------------------------------------------------------------------------
+
+const unsigned int REAL_BUFSIZE = 32;
+
+unsigned int FormatReal( double d, char * buf, unsigned int size,
+							int places = -1 );
+std::string RealStr( double d, int places = -1 );
+
 //---------------------------------------------------------------------------
 // Return a string that consists of a single NUL byte
 //---------------------------------------------------------------------------
@@ -189,6 +213,7 @@ bool IsIdentBegin( char c );
 bool IsNumber( const std::string & s );
 bool IsInteger( const std::string & s );
 bool IsReal( const std::string & s );
+bool ParseReal( const std::string & s, double & d );
 
 //------------------------------------------------------------------------
 // Numeric conversions
@@ -9,6 +9,15 @@
 #include <iostream>
 #include "a_exec.h"
 #include "a_str.h"
+
+#ifndef ALIB_WINAPI
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/wait.h>
+#endif
+
 using std::string;
 
 namespace ALib {
@@ -78,6 +87,191 @@ std::istream &  Executor:: Exec( const string & cmd  ) {
 
 //----------------------------------------------------------------------------
 
+#ifdef ALIB_WINAPI
+
+Coprocess :: Coprocess( const string & cmd )
+	: mCmd( cmd ), mPid( -1 ), mIn( -1 ), mOut( -1 ) {
+	ATHROW( "Co-processes are not supported on this platform" );
+}
+
+Coprocess :: ~Coprocess() {
+}
+
+void Coprocess :: Write( const char *, unsigned int ) {
+}
+
+unsigned int Coprocess :: Read( char *, unsigned int ) {
+	return 0;
+}
+
+void Coprocess :: CloseInput() {
+}
+
+void Coprocess :: CloseOutput() {
+}
+
+void Coprocess :: Kill() {
+}
+
+int Coprocess :: Wait() {
+	return -1;
+}
+
+#else
+
+//----------------------------------------------------------------------------
+// Start command with /bin/sh, as popen does. Our ends of the pipes are
+// close-on-exec, so that one co-process does not hold open the input of
+// another and stop it seeing end of file. SIGPIPE is ignored so that a
+// command which exits early produces a write error rather than killing us.
+// The command gets its own process group, so that Kill() reaches whatever
+// the shell has started. Both parent and child set the group, so it exists
+// whichever of them runs first - the parent's call fails harmlessly if the
+// child has already done so and started the command.
+//----------------------------------------------------------------------------
+
+Coprocess :: Coprocess( const string & cmd )
+	: mCmd( cmd ), mPid( -1 ), mIn( -1 ), mOut( -1 ) {
+
+	int in[2], out[2];
+	if ( pipe( in ) != 0 ) {
+		ATHROW( "Cannot create pipe for command " << cmd );
+	}
+	if ( pipe( out ) != 0 ) {
+		close( in[0] );
+		close( in[1] );
+		ATHROW( "Cannot create pipe for command " << cmd );
+	}
+	fcntl( in[1], F_SETFD, FD_CLOEXEC );
+	fcntl( out[0], F_SETFD, FD_CLOEXEC );
+	signal( SIGPIPE, SIG_IGN );
+
+	mPid = fork();
+	if ( mPid == 0 ) {
+		setpgid( 0, 0 );
+		dup2( in[0], 0 );
+		dup2( out[1], 1 );
+		close( in[0] );
+		close( in[1] );
+		close( out[0] );
+		close( out[1] );
+		execl( "/bin/sh", "sh", "-c", cmd.c_str(), (char *) 0 );
+		_exit( 127 );
+	}
+
+	if ( mPid > 0 ) {
+		setpgid( mPid, mPid );
+	}
+	close( in[0] );
+	close( out[1] );
+	mIn = in[1];
+	mOut = out[0];
+	if ( mPid < 0 ) {
+		CloseInput();
+		CloseOutput();
+		ATHROW( "Cannot start command " << cmd );
+	}
+}
+
+//----------------------------------------------------------------------------
+// Closing the pipes should make the command exit, if it has not already.
+//----------------------------------------------------------------------------
+
+Coprocess :: ~Coprocess() {
+	Wait();
+}
+
+//----------------------------------------------------------------------------
+// Write all of data to command's standard input
+//----------------------------------------------------------------------------
+
+void Coprocess :: Write( const char * p, unsigned int len ) {
+	while( len ) {
+		ssize_t n = write( mIn, p, len );
+		if ( n < 0 ) {
+			if ( errno == EINTR ) {
+				continue;
+			}
+			ATHROW( "Error writing to command " << mCmd );
+		}
+		p += n;
+		len -= n;
+	}
+}
+
+//----------------------------------------------------------------------------
+// Read what is available of command's standard output, waiting if there
+// is nothing. Returns zero at end of file.
+//----------------------------------------------------------------------------
+
+unsigned int Coprocess :: Read( char * p, unsigned int len ) {
+	for ( ; ; ) {
+		ssize_t n = read( mOut, p, len );
+		if ( n >= 0 ) {
+			return n;
+		}
+		if ( errno != EINTR ) {
+			ATHROW( "Error reading from command " << mCmd );
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+// Tell command there is no more input
+//----------------------------------------------------------------------------
+
+void Coprocess :: CloseInput() {
+	if ( mIn >= 0 ) {
+		close( mIn );
+		mIn = -1;
+	}
+}
+
+void Coprocess :: CloseOutput() {
+	if ( mOut >= 0 ) {
+		close( mOut );
+		mOut = -1;
+	}
+}
+
+//----------------------------------------------------------------------------
+// Stop command that may never finish by itself, for example when we give
+// up reading its output. The process group is only signalled while the
+// command has not been waited for, so its id cannot have been reused.
+//----------------------------------------------------------------------------
+
+void Coprocess :: Kill() {
+	if ( mPid > 0 ) {
+		kill( -mPid, SIGTERM );
+	}
+}
+
+//----------------------------------------------------------------------------
+// Close the pipes and wait for the command to exit, returning its exit
+// status, or -1 if it did not exit normally.
+//----------------------------------------------------------------------------
+
+int Coprocess :: Wait() {
+	CloseInput();
+	CloseOutput();
+	if ( mPid <= 0 ) {
+		return -1;
+	}
+	int status;
+	while( waitpid( mPid, & status, 0 ) < 0 ) {
+		if ( errno != EINTR ) {
+			mPid = -1;
+			return -1;
+		}
+	}
+	mPid = -1;
+	return WIFEXITED( status ) ? WEXITSTATUS( status ) : -1;
+}
+
+#endif
+
+//----------------------------------------------------------------------------
+
 }	// namespace
 
 //----------------------------------------------------------------------------
@@ -25,7 +25,6 @@
 
 using std::string;
 using std::vector;
-using std::deque;
 
 //----------------------------------------------------------------------------
 
@@ -151,6 +150,10 @@ Dictionary <Expression::AddFunc> Expression::mFuncs;
 #define ADD_FUNC( name, fn, np ) 							\
 	static Expression::AddFunc reg_##fn##_( name, fn, np )
 
+// functions whose results depend on the order in which they are called
+#define ADD_STATEFUL_FUNC( name, fn, np ) 					\
+	static Expression::AddFunc reg_##fn##_( name, fn, np, true )
+
 //----------------------------------------------------------------------------
 // static method that does the real addi to dictionary
 //----------------------------------------------------------------------------
@@ -163,12 +166,13 @@ void Expression :: AddFunction( const string & name, const AddFunc & f ) {
 // helper to get double version of  function param - params are strings
 //----------------------------------------------------------------------------
 
-static double GetDParam( const deque <string> & params, int i ) {
-	string s = params.at( i );
-	if ( ! IsNumber( s ) ) {
+static double GetDParam( const ExprArgs & params, int i ) {
+	const string & s = params[i];
+	double d;
+	if ( ! ParseReal( s, d ) ) {
 		ATHROW( "Invalid number: " << s );
 	}
-	return ToReal( s );
+	return d;
 }
 
 //----------------------------------------------------------------------------
@@ -176,7 +180,7 @@ static double GetDParam( const deque <string> & params, int i ) {
 //----------------------------------------------------------------------------
 
 // if first param is true, return second param else return third
-static string FuncIf( const deque <string> & params, Expression * ) {
+static string FuncIf( const ExprArgs & params, Expression * ) {
 	if ( Expression::ToBool( params[0] ) ) {
 		return params[1];
 	}
@@ -186,7 +190,7 @@ static string FuncIf( const deque <string> & params, Expression * ) {
 }
 
 // Invert truth of param . We don't currently support '!' operator.
-static string FuncNot( const deque <string> & params, Expression *  ) {
+static string FuncNot( const ExprArgs & params, Expression *  ) {
 	if ( Expression::ToBool( params[0] ) ) {
 		return "0";
 	}
@@ -196,19 +200,19 @@ static string FuncNot( const deque <string> & params, Expression *  ) {
 }
 
 // Transform double param into an integer
-static string FuncInt( const deque <string> & params, Expression *  ) {
+static string FuncInt( const ExprArgs & params, Expression *  ) {
 	double n = GetDParam( params, 0 );
 	return Str( (int)n );
 }
 
 // Get absolute value of param
-static string FuncAbs( const deque <string> & params, Expression *  ) {
+static string FuncAbs( const ExprArgs & params, Expression *  ) {
 	double n = GetDParam( params, 0 );
 	return Str( std::fabs( n ) );
 }
 
 // Get sign of param
-static string FuncSign( const deque <string> & params, Expression *  ) {
+static string FuncSign( const ExprArgs & params, Expression *  ) {
 	double n = GetDParam( params, 0 );
 	if ( n == 0 ) {
 		return "0";
@@ -222,27 +226,27 @@ static string FuncSign( const deque <string> & params, Expression *  ) {
 }
 
 // Trim leading & trailing whitespace from param
-static string FuncTrim( const deque <string> & params, Expression *  ) {
+static string FuncTrim( const ExprArgs & params, Expression *  ) {
 	return Str( Trim( params[0] ) );
 }
 
 // Return string converted to uppercase
-static string FuncUpper( const deque <string> & params, Expression *  ) {
+static string FuncUpper( const ExprArgs & params, Expression *  ) {
 	return Str( Upper( params[0] ) );
 }
 
 // Return string converted to lowercase
-static string FuncLower( const deque <string> & params, Expression *  ) {
+static string FuncLower( const ExprArgs & params, Expression *  ) {
 	return Str( Lower( params[0] ) );
 }
 
 // Return length of param treaded as string
-static string FuncLen( const deque <string> & params, Expression *  ) {
+static string FuncLen( const ExprArgs & params, Expression *  ) {
 	return Str( params[0].size() );
 }
 
 // Return substring of first param specified by start and length
-static string FuncSubstr( const deque <string> & params, Expression *  ) {
+static string FuncSubstr( const ExprArgs & params, Expression *  ) {
 	int pos = int( GetDParam( params, 1 ) ) - 1;
 	if ( pos < 0 ) {
 		ATHROW( "Invalid position in substr()" );
@@ -257,7 +261,7 @@ static string FuncSubstr( const deque <string> & params, Expression *  ) {
 
 // Get position of second param in first. Returns zero on fail else
 // one-based index of start of second param in first.
-static string FuncPos( const deque <string> & params, Expression *  ) {
+static string FuncPos( const ExprArgs & params, Expression *  ) {
 	string haystack = params[0];
 	string needle = params[1];
 	STRPOS pos = haystack.find( needle );
@@ -265,12 +269,12 @@ static string FuncPos( const deque <string> & params, Expression *  ) {
 }
 
 // Is param a number (real or integer)
-static string FuncIsNum( const deque <string> & params, Expression *  ) {
+static string FuncIsNum( const ExprArgs & params, Expression *  ) {
 	return IsNumber( params[0] ) ? "1" : "0";
 }
 
 // Normalise param into boolean 1 (true) or 0 (false)
-static string FuncBool( const deque <string> & params, Expression *  ) {
+static string FuncBool( const ExprArgs & params, Expression *  ) {
 	if ( Expression::ToBool( params[0] ) ) {
 		return "1";
 	}
@@ -280,51 +284,49 @@ static string FuncBool( const deque <string> & params, Expression *  ) {
 }
 
 // Does param consist of only whitespace characters
-static string FuncIsEmpty( const deque <string> & params, Expression *  ) {
+static string FuncIsEmpty( const ExprArgs & params, Expression *  ) {
 	return params[0].find_first_not_of( " \t"  ) == STRNPOS ? "1" : "0";
 }
 
 // return random number
-static string FuncRandom( const deque <string> & params, Expression *  ) {
+static string FuncRandom( const ExprArgs & params, Expression *  ) {
 	static RandGen rg( Expression::GetRNGSeed() );
 	return Str( rg.NextReal() );
 }
 
 // get current date in ISO format
-static string FuncToday( const deque <string> & params, Expression *  ) {
+static string FuncToday( const ExprArgs & params, Expression *  ) {
 	Date d = Date::Today();
 	return d.Str();
 }
 
 // get current time in hh:mm:ss format
-static string FuncNow( const deque <string> & params, Expression *  ) {
+static string FuncNow( const ExprArgs & params, Expression *  ) {
 	Time t = Time::Now();
 	return t.Str();
 }
 
 // compare params as strings ignoring case
-static string FuncStrEq( const deque <string> & params, Expression *  ) {
+static string FuncStrEq( const ExprArgs & params, Expression *  ) {
 	return Str( Equal( params[0], params[1]) );
 }
 
 // see if regex matches string
-static string FuncMatch( const deque <string> & params, Expression *  ) {
-	RegEx re( params[1] );
-	RegEx::Pos pos = re.FindIn( params[0] );
+static string FuncMatch( const ExprArgs & params, Expression * e ) {
+	RegEx::Pos pos = e->GetRegEx( params[1] ).FindIn( params[0] );
 	return pos.Found() ? "1" : "0";
 }
 
 // get environment variable, or empty string
-static string FuncGetenv( const deque <string> & params, Expression *  ) {
+static string FuncGetenv( const ExprArgs & params, Expression *  ) {
 	const char * val = std::getenv( params[0].c_str() );
 	return val == NULL ? "" : val;
 }
 
 // min and max
-static string FuncMin( const deque <string> & params, Expression *  ) {
-	if ( IsNumber( params[0] ) && IsNumber( params[1] )) {
-		double n1 = GetDParam( params, 0 );
-		double n2 = GetDParam( params, 1 );
+static string FuncMin( const ExprArgs & params, Expression *  ) {
+	double n1, n2;
+	if ( ParseReal( params[0], n1 ) && ParseReal( params[1], n2 ) ) {
 		return n1 < n2 ? params[0] : params[1];
 	}
 	else {
@@ -332,10 +334,9 @@ static string FuncMin( const deque <string> & params, Expression *  ) {
 	}
 }
 
-static string FuncMax( const deque <string> & params, Expression *  ) {
-	if ( IsNumber( params[0] ) && IsNumber( params[1] ))  {
-		double n1 = GetDParam( params, 0 );
-		double n2 = GetDParam( params, 1 );
+static string FuncMax( const ExprArgs & params, Expression *  ) {
+	double n1, n2;
+	if ( ParseReal( params[0], n1 ) && ParseReal( params[1], n2 ) ) {
 		return n1 > n2 ? params[0] : params[1];
 	}
 	else {
@@ -344,7 +345,7 @@ static string FuncMax( const deque <string> & params, Expression *  ) {
 }
 
 // date validation and element access
-static string FuncIsDate( const deque <string> & params, Expression *  ) {
+static string FuncIsDate( const ExprArgs & params, Expression *  ) {
 	try {
 		Date d( params[0] );
 	}
@@ -354,7 +355,7 @@ static string FuncIsDate( const deque <string> & params, Expression *  ) {
 	return "1";
 }
 
-static string FuncDay( const deque <string> & params, Expression *  ) {
+static string FuncDay( const ExprArgs & params, Expression *  ) {
 	try {
 		Date d( params[0] );
 		return Str( d.Day() );
@@ -364,7 +365,7 @@ static string FuncDay( const deque <string> & params, Expression *  ) {
 	}
 }
 
-static string FuncMonth( const deque <string> & params, Expression *  ) {
+static string FuncMonth( const ExprArgs & params, Expression *  ) {
 	try {
 		Date d( params[0] );
 		return Str( d.Month() );
@@ -374,7 +375,7 @@ static string FuncMonth( const deque <string> & params, Expression *  ) {
 	}
 }
 
-static string FuncYear( const deque <string> & params, Expression *  ) {
+static string FuncYear( const ExprArgs & params, Expression *  ) {
 	try {
 		Date d( params[0] );
 		return Str( d.Year() );
@@ -385,14 +386,14 @@ static string FuncYear( const deque <string> & params, Expression *  ) {
 }
 
 // get 1-based index of first param in comma-list
-static string FuncIndex( const deque <string> & params, Expression *  ) {
+static string FuncIndex( const ExprArgs & params, Expression *  ) {
 	CommaList cl( params[1] );
 	int idx = cl.Index( params[0] );
 	return Str( idx + 1 );
 }
 
 // pick 1-based value from comma list
-static string FuncPick( const deque <string> & params, Expression *  ) {
+static string FuncPick( const ExprArgs & params, Expression *  ) {
 	if ( ! IsInteger( params[0] )) {
 		ATHROW( "First parameter of pick() must be integer" );
 	}
@@ -407,7 +408,7 @@ static string FuncPick( const deque <string> & params, Expression *  ) {
 }
 
 // get field from current record - index is 1-based
-static string FuncField( const deque <string> & params, Expression * e ) {
+static string FuncField( const ExprArgs & params, Expression * e ) {
 	if ( ! IsInteger( params[0] )) {
 		ATHROW( "Parameter of field() must be integer" );
 	}
@@ -421,14 +422,14 @@ static string FuncField( const deque <string> & params, Expression * e ) {
 }
 
 // check if number is an integer
-static string FuncIsInt( const deque <string> & params, Expression * e ) {
+static string FuncIsInt( const ExprArgs & params, Expression * e ) {
 	return IsInteger( params[0] ) ? "1" : "0";
 }
 
 // try to match regex agains all  positional parameters
 // returns 1-based index of matching parameter, or 0 on no match
-static string FuncFind( const deque <string> & params, Expression * e ) {
-	RegEx re( params[0] );
+static string FuncFind( const ExprArgs & params, Expression * e ) {
+	const RegEx & re = e->GetRegEx( params[0] );
 	for ( unsigned int i = 0; i < e->PosParamCount(); i++ ) {
 		RegEx::Pos pos = re.FindIn( e->PosParam( i ) );
 		if ( pos.Found() ) {
@@ -439,18 +440,19 @@ static string FuncFind( const deque <string> & params, Expression * e ) {
 }
 
 // round number n to d decimal places
-static string FuncRound( const deque <string> & params, Expression * e ) {
+static string FuncRound( const ExprArgs & params, Expression * e ) {
 	if ( ! IsInteger( params[1] )) {
 		ATHROW( "Second parameter of round() must be integer" );
 	}
-	double n = IsNumber( params[0] ) ? ToReal( params[0] ) : 0.0 ;
+	double n;
+	if ( ! ParseReal( params[0], n ) ) {
+		n = 0.0;
+	}
 	int d = ToInteger( params[1] );
 	if ( d < 0 ) {
 		ATHROW( "Second parameter of round() must be non-negative" );
 	}
-	std::ostringstream os;
-	os << std::fixed << std::setprecision( d ) << n;
-	return os.str();
+	return RealStr( n, d );
 }
 
 //----------------------------------------------------------------------------
@@ -461,7 +463,7 @@ ADD_FUNC( "abs", 		FuncAbs, 		1 );
 ADD_FUNC( "bool", 		FuncBool, 		1 );
 ADD_FUNC( "day", 		FuncDay, 		1 );
 ADD_FUNC( "env", 		FuncGetenv, 	1 );
-ADD_FUNC( "field", 		FuncField, 		1 );
+ADD_FUNC( "field", 	FuncField, 		1 );
 ADD_FUNC( "find", 		FuncFind, 		1 );
 ADD_FUNC( "if", 		FuncIf, 		3 );
 ADD_FUNC( "index", 		FuncIndex, 		2 );
@@ -473,7 +475,7 @@ ADD_FUNC( "isnum", 		FuncIsNum, 		1 );
 ADD_FUNC( "month", 		FuncMonth, 		1 );
 ADD_FUNC( "not", 		FuncNot, 		1 );
 ADD_FUNC( "pos",		FuncPos, 		2 );
-ADD_FUNC( "random", 	FuncRandom, 	0 );
+ADD_STATEFUL_FUNC( "random", FuncRandom, 0 );
 ADD_FUNC( "sign",		FuncSign, 		1 );
 ADD_FUNC( "substr", 	FuncSubstr, 	3 );
 ADD_FUNC( "trim", 		FuncTrim, 		1 );
@@ -961,11 +963,14 @@ void ExprCompiler :: DumpRP( std::ostream & os, const Expression::RPNRep & rp )
 
 //----------------------------------------------------------------------------
 // Expression uses compiler to compile string rep of expression into Reverse
-// Polish form and then executes it. Alternatively, these stages can be
-// performed separately.
+// Polish form, which is then turned into a sequence of instructions for
+// the evaluator. Alternatively, these stages can be performed separately.
 //----------------------------------------------------------------------------
 
-Expression :: Expression() {
+Expression :: Expression()
+	: mBoundParams( 0 ),
+		mSP( 0 ), mUsesVars( false ), mStateful( false ), mBatchable( true ),
+		mBatchSize( 0 ), mBatchFail( 0 ), mCallSite( -1 ), mRegExUses( 0 ) {
 }
 
 Expression :: ~Expression() {
@@ -989,19 +994,15 @@ string Expression :: Evaluate( const std::string & expr ) {
 //----------------------------------------------------------------------------
 
 string Expression :: Evaluate( ) {
-	if ( mRPN.empty() ) {
+	if ( mCode.empty() ) {
 		ATHROW( "No compiled expression" );
 	}
-	string result;
-	unsigned int i = 0;
-	//ExprCompiler::DumpRP( std::cout, mRPN );
-	while( EvalSingleExpr( i, result ) ) {
-	}
-	return result;
+	Run();
+	return mResult.GetStr();
 }
 
 //----------------------------------------------------------------------------
-// compile to RP form, but don't evaluate expression
+// compile to RP form and generate code, but don't evaluate expression
 //----------------------------------------------------------------------------
 
 string Expression :: Compile( const std::string & expr ) {
@@ -1012,6 +1013,7 @@ string Expression :: Compile( const std::string & expr ) {
 	mRPN.clear();
 	ExprCompiler ec;
 	string emsg = ec.Compile( s, mRPN );
+	Generate();
 	return emsg;
 }
 
@@ -1020,31 +1022,389 @@ string Expression :: Compile( const std::string & expr ) {
 //----------------------------------------------------------------------------
 
 bool Expression :: IsCompiled() const {
-	return mRPN.size() != 0;
+	return mCode.size() != 0;
 }
 
 //----------------------------------------------------------------------------
-// Call named function, returning result of call.
-// If anything goes wrong with popping the stack it almost certainly means
-// the user didn't provide enough parameters.
+// Map operator names used in RPN to opcodes
 //----------------------------------------------------------------------------
 
-string Expression :: CallFunction( const string & name ) {
-	const AddFunc * af = mFuncs.GetPtr( name );
-	if ( af == 0 ) {
-		ATHROW( "Unknown function: " << name );
+struct OpCodeEntry {
+	const char * mOp;
+	ExprInstr::OpCode mCode;
+};
+
+static OpCodeEntry OpCodes[] = {
+	{".", ExprInstr::opCat },
+	{"+", ExprInstr::opAdd }, {"-", ExprInstr::opSub },
+	{"*", ExprInstr::opMul }, {"/", ExprInstr::opDiv },
+	{"%", ExprInstr::opMod },
+	{"==", ExprInstr::opEq }, {"<>", ExprInstr::opNe },
+	{"!=", ExprInstr::opNe }, {"<", ExprInstr::opLt },
+	{">", ExprInstr::opGt }, {"<=", ExprInstr::opLe },
+	{">=", ExprInstr::opGe },
+	{"&&", ExprInstr::opAnd }, {"||", ExprInstr::opOr },
+	{UMINUS_STR, ExprInstr::opNeg },
+	{RDVAR_STR, ExprInstr::opReadVar },
+	{FNCALL_STR, ExprInstr::opCallNamed },
+	{EXPR_SEP, ExprInstr::opEnd },
+	{NULL, ExprInstr::opBad }
+};
+
+//----------------------------------------------------------------------------
+// Add name used by variable, function or bad operator instruction. For
+// functions, we also look up the implementation now.
+//----------------------------------------------------------------------------
+
+unsigned int Expression :: AddName( const string & name ) {
+	mNames.push_back( name );
+	mNameFuncs.push_back( mFuncs.GetPtr( name ) );
+	return mNames.size() - 1;
+}
+
+//----------------------------------------------------------------------------
+// Generate code from the RPN. Variables followed by a read and function
+// names followed by a call become single instructions, so that names
+// are resolved once here rather than every time we evaluate. Constants
+// are stored as values, so numeric literals are only converted once.
+//
+// Code is built as a stack of fragments, each of which computes a single
+// value. This lets us see the operands of each operator, so that &&, ||
+// and if() can jump over operands that don't need evaluating, and so that
+// operators whose operands are all constants can be evaluated here. If the
+// RPN is malformed, the fragments are flattened and we just emit the
+// instructions in order, leaving the evaluator to report the error.
+//----------------------------------------------------------------------------
+
+void Expression :: Generate() {
+
+	mCode.clear();
+	mConsts.clear();
+	mNames.clear();
+	mNameFuncs.clear();
+
+	std::vector <Code> frags;
+	bool flat = false;
+
+	for ( unsigned int i = 0; i < mRPN.size(); i++ ) {
+
+		const ExprToken & tok = mRPN[i];
+		string next = i + 1 < mRPN.size()
+						&& mRPN[i + 1].Type() == ExprToken::etOp
+							? mRPN[i + 1].Value() : "";
+
+		if ( tok.Type() == ExprToken::etVar && next == RDVAR_STR ) {
+			if ( IsInteger( tok.Value() ) ) {
+				int n = ToInteger( tok.Value() ) - 1;
+				GenOp( frags, flat, ExprInstr( ExprInstr::opPosParam, n ), 0 );
+			}
+			else {
+				unsigned int slot = VarSlot( tok.Value() );
+				GenOp( frags, flat, ExprInstr( ExprInstr::opVar, slot ), 0 );
+			}
+			i++;
+		}
+		else if ( tok.Type() == ExprToken::etStr && next == FNCALL_STR ) {
+			unsigned int ni = AddName( tok.Value() );
+			const AddFunc * af = mNameFuncs[ni];
+			if ( af == 0 ) {
+				Flatten( frags, flat );
+				frags[0].push_back( ExprInstr( ExprInstr::opCall, ni ) );
+			}
+			else if ( Equal( tok.Value(), "if" ) && af->mParamCount == 3
+						&& ! flat && frags.size() >= 3 ) {
+				GenIf( frags );
+			}
+			else {
+				ExprInstr call( ExprInstr::opCall, ni );
+				GenOp( frags, flat, call, af->mParamCount );
+			}
+			i++;
+		}
+		else if ( tok.Type() == ExprToken::etOp ) {
+			unsigned int oi = 0;
+			while( OpCodes[oi].mOp && tok.Value() != OpCodes[oi].mOp ) {
+				oi++;
+			}
+			ExprInstr::OpCode op = OpCodes[oi].mCode;
+			if ( op == ExprInstr::opEnd ) {
+				Flatten( frags, flat );
+				Append( mCode, frags[0] );
+				mCode.push_back( ExprInstr( op ) );
+				frags.clear();
+				flat = false;
+			}
+			else if ( op == ExprInstr::opBad || op == ExprInstr::opCallNamed ) {
+				int arg = op == ExprInstr::opBad ? AddName( tok.Value() ) : 0;
+				Flatten( frags, flat );
+				frags[0].push_back( ExprInstr( op, arg ) );
+			}
+			else if ( op == ExprInstr::opNeg || op == ExprInstr::opReadVar ) {
+				GenOp( frags, flat, ExprInstr( op ), 1 );
+			}
+			else if ( ( op == ExprInstr::opAnd || op == ExprInstr::opOr )
+						&& ! flat && frags.size() >= 2 ) {
+				GenAndOr( frags, op );
+			}
+			else {
+				GenOp( frags, flat, ExprInstr( op ), 2 );
+			}
+		}
+		else {
+			// numbers, strings and variable names not being read
+			Code c( 1, ExprInstr( ExprInstr::opConst, AddConst( tok.Value() ) ) );
+			frags.push_back( c );
+		}
 	}
-	std::deque <string> params;
-	try {
-		for ( unsigned int i = 0; i < af->mParamCount; i++ ) {
-			params.push_front( PopStr() );
+
+	// anything left over is from a compilation error
+	if ( frags.size() ) {
+		Flatten( frags, flat );
+		Append( mCode, frags[0] );
+	}
+
+	mSiteRegEx.assign( mNames.size(), -1 );
+
+	mUsesVars = mStateful = false;
+	mBatchable = true;
+	for ( unsigned int i = 0; i < mCode.size(); i++ ) {
+		ExprInstr::OpCode op = mCode[i].mOp;
+		if ( op == ExprInstr::opVar || op == ExprInstr::opReadVar ) {
+			mUsesVars = true;
+		}
+		else if ( op == ExprInstr::opCall ) {
+			const AddFunc * af = mNameFuncs[ mCode[i].mArg ];
+			mStateful = mStateful || ( af && af->mStateful );
+		}
+		else if ( op == ExprInstr::opCallNamed ) {
+			mStateful = true;
+			mBatchable = false;
 		}
 	}
+}
+
+//----------------------------------------------------------------------------
+// Code generation helpers
+//----------------------------------------------------------------------------
+
+void Expression :: Append( Code & to, const Code & from ) {
+	to.insert( to.end(), from.begin(), from.end() );
+}
+
+unsigned int Expression :: AddConst( const string & val ) {
+	mConsts.push_back( ExprValue() );
+	mConsts.back().SetStr( val );
+	mConsts.back().IsNum();
+	return mConsts.size() - 1;
+}
+
+bool Expression :: IsConst( const Code & c ) const {
+	return c.size() == 1 && c[0].mOp == ExprInstr::opConst;
+}
+
+//----------------------------------------------------------------------------
+// Merge all fragments into one, which we then just append to
+//----------------------------------------------------------------------------
+
+void Expression :: Flatten( std::vector <Code> & frags, bool & flat ) {
+	Code c;
+	for ( unsigned int i = 0; i < frags.size(); i++ ) {
+		Append( c, frags[i] );
+	}
+	frags.clear();
+	frags.push_back( c );
+	flat = true;
+}
+
+//----------------------------------------------------------------------------
+// Replace the top nargs fragments with a fragment that evaluates them and
+// then applies the instruction, folding the result if all were constants.
+//----------------------------------------------------------------------------
+
+void Expression :: GenOp( std::vector <Code> & frags, bool & flat,
+							const ExprInstr & in, unsigned int nargs ) {
+	if ( flat || frags.size() < nargs ) {
+		Flatten( frags, flat );
+		frags[0].push_back( in );
+		return;
+	}
+
+	bool allconst = nargs > 0 && in.mOp != ExprInstr::opCall
+						&& in.mOp != ExprInstr::opReadVar;
+	Code c;
+	for ( unsigned int i = frags.size() - nargs; i < frags.size(); i++ ) {
+		allconst = allconst && IsConst( frags[i] );
+		Append( c, frags[i] );
+	}
+	frags.resize( frags.size() - nargs );
+	c.push_back( in );
+	if ( allconst ) {
+		Fold( c );
+	}
+	frags.push_back( c );
+}
+
+//----------------------------------------------------------------------------
+// The right operand of && and || is skipped if the left decides the result.
+// The jump instructions leave the boolean result on the stack if they jump,
+// otherwise they pop the left operand.
+//----------------------------------------------------------------------------
+
+void Expression :: GenAndOr( std::vector <Code> & frags,
+								ExprInstr::OpCode op ) {
+	Code rhs = frags.back();
+	frags.pop_back();
+	Code lhs = frags.back();
+	frags.pop_back();
+
+	bool isand = op == ExprInstr::opAnd;
+	Code c;
+	if ( IsConst( lhs ) && mConsts[ lhs[0].mArg ].ToBool() != isand ) {
+		c.push_back( ExprInstr( ExprInstr::opConst,
+									AddConst( isand ? "0" : "1" ) ) );
+	}
+	else {
+		if ( ! IsConst( lhs ) ) {
+			Append( c, lhs );
+			ExprInstr::OpCode jmp = isand ? ExprInstr::opAndJump
+											: ExprInstr::opOrJump;
+			c.push_back( ExprInstr( jmp, rhs.size() + 1 ) );
+		}
+		Append( c, rhs );
+		c.push_back( ExprInstr( ExprInstr::opBool ) );
+		if ( IsConst( rhs ) && IsConst( lhs ) ) {
+			Fold( c );
+		}
+	}
+	frags.push_back( c );
+}
+
+//----------------------------------------------------------------------------
+// if() only evaluates the branch selected by its condition - if that is a
+// constant, only the selected branch is generated.
+//----------------------------------------------------------------------------
+
+void Expression :: GenIf( std::vector <Code> & frags ) {
+	Code no = frags.back();
+	frags.pop_back();
+	Code yes = frags.back();
+	frags.pop_back();
+	Code cond = frags.back();
+	frags.pop_back();
+
+	Code c;
+	if ( IsConst( cond ) ) {
+		c = mConsts[ cond[0].mArg ].ToBool() ? yes : no;
+	}
+	else {
+		Append( c, cond );
+		c.push_back( ExprInstr( ExprInstr::opJumpFalse, yes.size() + 1 ) );
+		Append( c, yes );
+		c.push_back( ExprInstr( ExprInstr::opJump, no.size() ) );
+		Append( c, no );
+	}
+	frags.push_back( c );
+}
+
+//----------------------------------------------------------------------------
+// Evaluate constant code now, replacing it with its result. If evaluation
+// fails we leave the code alone, so the error is reported at run time.
+//----------------------------------------------------------------------------
+
+void Expression :: Fold( Code & c ) {
+	Code saved;
+	saved.swap( mCode );
+	mCode = c;
+	mCode.push_back( ExprInstr( ExprInstr::opEnd ) );
+	try {
+		Run();
+		mConsts.push_back( mResult );
+		c.assign( 1, ExprInstr( ExprInstr::opConst, mConsts.size() - 1 ) );
+	}
 	catch( ... ) {
+	}
+	mCode.swap( saved );
+}
+
+//----------------------------------------------------------------------------
+// Call function, replacing its parameters on the stack with its result.
+// If there are too few values on the stack it almost certainly means
+// the user didn't provide enough parameters.
+//----------------------------------------------------------------------------
+
+static void CheckCall( const string & name, const Expression::AddFunc * af,
+							unsigned int nvals ) {
+	if ( af == 0 ) {
+		ATHROW( "Unknown function: " << name );
+	}
+	if ( nvals < af->mParamCount ) {
 		ATHROW( "Function " << name << "() given the wrong number of parameters."
 					<< " It takes "<< af->mParamCount << "." );
 	}
-	return af->mFunc( params, this );
+}
+
+void Expression :: CallFunction( const string & name, const AddFunc * af,
+									int site ) {
+	CheckCall( name, af, mSP );
+	unsigned int np = af->mParamCount;
+	ExprArgs params( np ? &mStack[mSP - np] : 0, np );
+	mCallSite = site;
+	string result = af->mFunc( params, this );
+	mCallSite = -1;
+	mSP -= np;
+	Push().SetStr( result );
+}
+
+//----------------------------------------------------------------------------
+// Get compiled regex for use by the function being called. Compiled regexes
+// are kept in a small cache, least recently used going first when it is
+// full. Each call site remembers the entry it used last, so a site whose
+// pattern is a literal finds its regex without searching the cache.
+//----------------------------------------------------------------------------
+
+const unsigned int REGEX_CACHE_SIZE = 16;
+
+const RegEx & Expression :: GetRegEx( const string & pattern ) {
+
+	mRegExUses++;
+	int site = mCallSite >= 0 && mCallSite < (int) mSiteRegEx.size()
+					? mCallSite : -1;
+	if ( site >= 0 ) {
+		int ci = mSiteRegEx[ site ];
+		if ( ci >= 0 && mRegExCache[ ci ].mPattern == pattern ) {
+			mRegExCache[ ci ].mLastUse = mRegExUses;
+			return mRegExCache[ ci ].mRegEx;
+		}
+	}
+
+	int found = -1, oldest = 0;
+	for ( unsigned int i = 0; i < mRegExCache.size(); i++ ) {
+		if ( mRegExCache[i].mPattern == pattern ) {
+			found = i;
+			break;
+		}
+		if ( mRegExCache[i].mLastUse < mRegExCache[ oldest ].mLastUse ) {
+			oldest = i;
+		}
+	}
+
+	if ( found < 0 ) {
+		CachedRegEx cre( pattern );
+		if ( mRegExCache.size() < REGEX_CACHE_SIZE ) {
+			mRegExCache.push_back( cre );
+			found = mRegExCache.size() - 1;
+		}
+		else {
+			mRegExCache[ oldest ] = cre;
+			found = oldest;
+		}
+	}
+
+	mRegExCache[ found ].mLastUse = mRegExUses;
+	if ( site >= 0 ) {
+		mSiteRegEx[ site ] = found;
+	}
+	return mRegExCache[ found ].mRegEx;
 }
 
 //----------------------------------------------------------------------------
@@ -1052,11 +1412,24 @@ string Expression :: CallFunction( const string & name ) {
 //----------------------------------------------------------------------------
 
 unsigned int Expression :: PosParamCount() const {
-	return mPosParams.size();
+	return PosParams().size();
 }
 
 string Expression :: PosParam( unsigned int i ) const {
-	return mPosParams.at( i );
+	return PosParams().at( i );
+}
+
+const vector <string> & Expression :: PosParams() const {
+	return mBoundParams ? * mBoundParams : mPosParams;
+}
+
+//----------------------------------------------------------------------------
+// Use caller's vector as the positional parameters without copying it. The
+// vector must not change or be destroyed while we are being evaluated.
+//----------------------------------------------------------------------------
+
+void Expression :: BindPosParams( const vector <string> & params ) {
+	mBoundParams = & params;
 }
 
 //----------------------------------------------------------------------------
@@ -1064,6 +1437,10 @@ string Expression :: PosParam( unsigned int i ) const {
 //----------------------------------------------------------------------------
 
 void Expression :: AddPosParam( const string & s ) {
+	if ( mBoundParams ) {
+		mPosParams = * mBoundParams;
+		mBoundParams = 0;
+	}
 	mPosParams.push_back( s );
 }
 
@@ -1073,177 +1450,659 @@ void Expression :: AddPosParam( const string & s ) {
 
 void Expression :: ClearPosParams() {
 	mPosParams.clear();
+	mBoundParams = 0;
 }
 
 //----------------------------------------------------------------------------
-// evaluate a single expression terminated by expression separator
+// Stack helpers. The stack only ever grows, and popping just moves the
+// stack pointer, so that the strings in the values keep their buffers
+// from one evaluation to the next.
 //----------------------------------------------------------------------------
 
-bool Expression :: EvalSingleExpr( unsigned int & ei, string & result ) {
+ExprValue & Expression :: Push() {
+	if ( mSP == mStack.size() ) {
+		mStack.push_back( ExprValue() );
+	}
+	return mStack[ mSP++ ];
+}
 
-	// do not remove this - we need to preserve previous result
-	if ( ei >= mRPN.size() ) {
-		return false;
+ExprValue & Expression :: Operand( unsigned int n ) {
+	if ( mSP < n ) {
+		ATHROW( "Invalid expression" );
 	}
+	return mStack[ mSP - n ];
+}
 
-	result = "";
-	Clear( mStack );
+//----------------------------------------------------------------------------
+// Operations on values, shared by the row and batch evaluators. The result
+// always replaces the left operand.
+//----------------------------------------------------------------------------
 
-	while( ei < mRPN.size() ) {
+static double NumValue( ExprValue & v ) {
+	if ( ! v.IsNum() ) {
+		ATHROW( "Invalid numeric value " << v.GetStr() );
+	}
+	return v.GetNum();
+}
 
-		ExprToken tok = mRPN.at( ei++ );
+static void Arith( ExprInstr::OpCode op, ExprValue & lhs, ExprValue & rhs ) {
+	double r = NumValue( rhs );
+	if ( op == ExprInstr::opDiv && r == 0 ) {
+		ATHROW( "Divide by zero" );
+	}
+	double l = NumValue( lhs );
+	switch( op ) {
+		case ExprInstr::opAdd:	lhs.SetNum( l + r ); break;
+		case ExprInstr::opSub:	lhs.SetNum( l - r ); break;
+		case ExprInstr::opMul:	lhs.SetNum( l * r ); break;
+		case ExprInstr::opDiv:	lhs.SetNum( l / r ); break;
+		default: {
+			if ( l < 0 || r < 0 ) {
+				ATHROW( "Invalid operands for % operator" );
+			}
+			lhs.SetStr( Str( int(l) % int(r) ) );
+		}
+	}
+}
 
-		if ( tok == ExprToken::MakeSep() ) {
-			if ( mStack.size() != 1 ) {
-				ATHROW( "Invalid expression" );
-			//	ATHROW( "Invalid expression in EvalSingleExpr stack "
-			//				<< ei << " " << mStack.size() );
+//----------------------------------------------------------------------------
+// handle comparison operators - if both values are numbers, compare them
+// numerically, otherwise compare as strings
+//----------------------------------------------------------------------------
+
+static void Compare( ExprInstr::OpCode op, ExprValue & lv, ExprValue & rv ) {
+
+	int cmp;
+	if ( rv.IsNum() && lv.IsNum() ) {
+		double dr = rv.GetNum(), dl = lv.GetNum();
+		cmp = dl < dr ? -1 : (dl > dr ? 1 : 0);
+	}
+	else {
+		cmp = lv.GetStr().compare( rv.GetStr() );
+	}
+
+	bool b;
+	switch( op ) {
+		case ExprInstr::opEq:	b = cmp == 0; break;
+		case ExprInstr::opNe:	b = cmp != 0; break;
+		case ExprInstr::opLt:	b = cmp < 0; break;
+		case ExprInstr::opGt:	b = cmp > 0; break;
+		case ExprInstr::opLe:	b = cmp <= 0; break;
+		default:				b = cmp >= 0; break;
+	}
+	lv.SetNum( b ? 1 : 0 );
+}
+
+static void Logic( ExprInstr::OpCode op, ExprValue & lhs, ExprValue & rhs ) {
+	bool r = rhs.ToBool();
+	bool l = lhs.ToBool();
+	bool b = op == ExprInstr::opAnd ? l && r : l || r;
+	lhs.SetNum( b ? 1 : 0 );
+}
+
+double Expression :: NumOperand( unsigned int n ) {
+	return NumValue( Operand( n ) );
+}
+
+//----------------------------------------------------------------------------
+// Run the compiled code. Each expression leaves a single value on the stack
+// when it reaches a separator - the result is that of the last expression.
+//----------------------------------------------------------------------------
+
+void Expression :: Run() {
+
+	mSP = 0;
+	mCallSite = -1;
+	mResult.SetStr( "" );
+
+	for ( unsigned int pc = 0; pc < mCode.size(); pc++ ) {
+
+		const ExprInstr & in = mCode[pc];
+
+		switch( in.mOp ) {
+
+			case ExprInstr::opConst: {
+				Push() = mConsts[ in.mArg ];
+				break;
+			}
+
+			case ExprInstr::opPosParam: {
+				if ( in.mArg < 0 ) {
+					ATHROW( "Invalid positional parameter " << in.mArg );
+				}
+				unsigned int n = in.mArg;
+				const vector <string> & params = PosParams();
+				Push().SetStr( n < params.size() ? params[n] : "" );
+				break;
+			}
+
+			case ExprInstr::opVar: {
+				if ( ! mVarSet[ in.mArg ] ) {
+					ATHROW( "Unknown variable: " << mVarNames[ in.mArg ] );
+				}
+				Push().SetStr( mVarVals[ in.mArg ] );
+				break;
+			}
+
+			case ExprInstr::opReadVar: {
+				ExprValue & v = Operand( 1 );
+				v.SetStr( GetVar( v.GetStr() ) );
+				break;
+			}
+
+			case ExprInstr::opCall: {
+				CallFunction( mNames[ in.mArg ], mNameFuncs[ in.mArg ], in.mArg );
+				break;
+			}
+
+			case ExprInstr::opCallNamed: {
+				string name = Operand( 1 ).GetStr();
+				mSP--;
+				CallFunction( name, mFuncs.GetPtr( name ), -1 );
+				break;
+			}
+
+			case ExprInstr::opCat: {
+				const string & rhs = Operand( 1 ).GetStr();
+				Operand( 2 ).Append( rhs );
+				mSP--;
+				break;
+			}
+
+			case ExprInstr::opAdd: case ExprInstr::opSub:
+			case ExprInstr::opMul: case ExprInstr::opDiv:
+			case ExprInstr::opMod: {
+				ExprValue & rhs = Operand( 1 );
+				Arith( in.mOp, Operand( 2 ), rhs );
+				mSP--;
+				break;
+			}
+
+			case ExprInstr::opNeg: {
+				Operand( 1 ).SetNum( - NumOperand( 1 ) );
+				break;
+			}
+
+			case ExprInstr::opEq: case ExprInstr::opNe:
+			case ExprInstr::opLt: case ExprInstr::opGt:
+			case ExprInstr::opLe: case ExprInstr::opGe: {
+				ExprValue & rhs = Operand( 1 );
+				Compare( in.mOp, Operand( 2 ), rhs );
+				mSP--;
+				break;
+			}
+
+			case ExprInstr::opAnd: case ExprInstr::opOr: {
+				ExprValue & rhs = Operand( 1 );
+				Logic( in.mOp, Operand( 2 ), rhs );
+				mSP--;
+				break;
+			}
+
+			case ExprInstr::opJump: {
+				pc += in.mArg;
+				break;
+			}
+
+			case ExprInstr::opJumpFalse: {
+				bool b = Operand( 1 ).ToBool();
+				mSP--;
+				if ( ! b ) {
+					pc += in.mArg;
+				}
+				break;
+			}
+
+			case ExprInstr::opAndJump: case ExprInstr::opOrJump: {
+				ExprValue & v = Operand( 1 );
+				bool b = v.ToBool();
+				if ( b == (in.mOp == ExprInstr::opOrJump) ) {
+					v.SetNum( b ? 1 : 0 );
+					pc += in.mArg;
+				}
+				else {
+					mSP--;
+				}
+				break;
+			}
+
+			case ExprInstr::opBool: {
+				ExprValue & v = Operand( 1 );
+				v.SetNum( v.ToBool() ? 1 : 0 );
+				break;
+			}
+
+			case ExprInstr::opEnd: {
+				if ( mSP != 1 ) {
+					ATHROW( "Invalid expression" );
+				}
+				std::swap( mResult, mStack[0] );
+				mSP = 0;
+				break;
+			}
+
+			default: {
+				ATHROW( "Unknown operator: "  << mNames[ in.mArg ] );
 			}
-			result = mStack.top();
-			return true;
 		}
-		else if ( tok.Type() == ExprToken::etNum
-					|| tok.Type() == ExprToken::etStr ) {
-			mStack.push( tok.Value() );
+	}
+}
+
+//----------------------------------------------------------------------------
+// Batch evaluation runs each instruction over all the active rows of a
+// block before moving on to the next instruction, so instructions are
+// dispatched once per block rather than once per row. Each stack slot
+// becomes a column of values, one per row. The depth of the stack at each
+// instruction doesn't depend on the row, so rows that take a jump wait at
+// its target and rejoin the active rows there. A row whose evaluation
+// fails drops out - we only need to remember the earliest failure, as
+// callers must stop at that row.
+//
+// Code that calls functions by computed name may need a different stack
+// depth for each row, so it is run a row at a time.
+//----------------------------------------------------------------------------
+
+void Expression :: RunBatch( const Batch & rows, unsigned int n,
+								const Selection & sel ) {
+
+	if ( mCode.empty() ) {
+		ATHROW( "No compiled expression" );
+	}
+	if ( n > rows.size() || n > sel.size() ) {
+		ATHROW( "Invalid batch size " << n );
+	}
+
+	if ( mBatchSize < n ) {
+		mBatchSize = n;
+		for ( unsigned int i = 0; i < mBatchStack.size(); i++ ) {
+			mBatchStack[i].resize( n );
 		}
-		else if ( tok.Type() == ExprToken::etOp ) {
-			ExecOp( tok );
+		mBatchResult.resize( n );
+	}
+
+	mBatchFail = n;
+	mBatchError = std::exception_ptr();
+	mActive.clear();
+	for ( unsigned int i = 0; i < n; i++ ) {
+		if ( sel[i] ) {
+			mActive.push_back( i );
+			mBatchResult[i].SetStr( "" );
 		}
-		else if ( tok.Type() == ExprToken::etVar ) {
-			mStack.push( tok.Value() );
+	}
+
+	const vector <string> * bound = mBoundParams;
+	mCallSite = -1;
+
+	if ( ! mBatchable ) {
+		RunBatchRows( rows );
+		mBoundParams = bound;
+		return;
+	}
+
+	mPending.resize( mCode.size() + 1 );
+	mPendingDepth.assign( mCode.size() + 1, -1 );
+
+	unsigned int sp = 0;
+	for ( unsigned int pc = 0; pc < mCode.size(); pc++ ) {
+
+		if ( mPendingDepth[pc] >= 0 ) {
+			sp = mPendingDepth[pc];
+			mActive.insert( mActive.end(),
+							mPending[pc].begin(), mPending[pc].end() );
+			mPending[pc].clear();
 		}
-		else {
-			tok.DumpOn( std::cerr );
-			ATHROW( "Not implemented in EvalSingleExpr" );
+		while( mBatchStack.size() <= sp ) {
+			mBatchStack.push_back( vector <ExprValue>( mBatchSize ) );
+		}
+
+		const ExprInstr & in = mCode[pc];
+		BatchOp( pc, sp, rows );
+
+		switch( in.mOp ) {
+			case ExprInstr::opConst: case ExprInstr::opPosParam:
+			case ExprInstr::opVar: {
+				sp++;
+				break;
+			}
+			case ExprInstr::opCall: {
+				const AddFunc * af = mNameFuncs[ in.mArg ];
+				unsigned int np = af ? af->mParamCount : 0;
+				sp = sp >= np ? sp - np + 1 : 1;
+				break;
+			}
+			case ExprInstr::opReadVar: case ExprInstr::opNeg:
+			case ExprInstr::opBool: {
+				break;
+			}
+			case ExprInstr::opJump: {
+				BatchJump( pc, sp );
+				break;
+			}
+			case ExprInstr::opJumpFalse: case ExprInstr::opAndJump:
+			case ExprInstr::opOrJump: {
+				BatchJump( pc, in.mOp == ExprInstr::opAndJump
+							|| in.mOp == ExprInstr::opOrJump ? sp : sp - 1 );
+				sp = sp ? sp - 1 : 0;
+				break;
+			}
+			case ExprInstr::opEnd: {
+				sp = 0;
+				break;
+			}
+			default: {
+				sp = sp ? sp - 1 : 0;
+				break;
+			}
 		}
 	}
-	return false;
+	mBoundParams = bound;
 }
 
 //----------------------------------------------------------------------------
-// helper to pop string from stack or report error
+// Rows that the jump instruction at pc has removed from the active rows
+// will need the stack to be at depth sp when they rejoin.
 //----------------------------------------------------------------------------
 
-string Expression :: PopStr() {
-	if ( mStack.size() == 0 ) {
-		ATHROW( "Invalid expression" );
+void Expression :: BatchJump( unsigned int pc, unsigned int sp ) {
+	unsigned int target = pc + mCode[pc].mArg + 1;
+	if ( target < mPendingDepth.size() ) {
+		mPendingDepth[ target ] = sp;
 	}
-	string s = mStack.top();
-	mStack.pop();
-	return s;
 }
 
 //----------------------------------------------------------------------------
-// helper to pop number from stack
+// Evaluate rows one at a time for code that can't be run by columns
 //----------------------------------------------------------------------------
 
-double 	Expression ::  PopNum() {
-	string s = PopStr();
-	if ( ! IsNumber( s ) ) {
-		ATHROW( "Invalid numeric value " << s );
+void Expression :: RunBatchRows( const Batch & rows ) {
+	for ( unsigned int i = 0; i < mActive.size(); i++ ) {
+		unsigned int row = mActive[i];
+		mBoundParams = & rows[ row ];
+		try {
+			Run();
+			std::swap( mBatchResult[ row ], mResult );
+		}
+		catch( ... ) {
+			BatchFail( row );
+			break;
+		}
 	}
-	return ToReal( s );
 }
 
 //----------------------------------------------------------------------------
-// push boolean rep to stack
+// Row has failed - remember the error if it is the earliest failure. This
+// is called from a catch block, and any exception is kept, not just ours,
+// so it can be rethrown once the earlier rows have been dealt with.
 //----------------------------------------------------------------------------
 
-void Expression :: PushBool( bool b ) {
-	mStack.push( b ? "1" : "0"  );
+void Expression :: BatchFail( unsigned int row ) {
+	if ( row < mBatchFail ) {
+		mBatchFail = row;
+		mBatchError = std::current_exception();
+	}
+}
+
+ExprValue & Expression :: BatchOperand( unsigned int sp, unsigned int n,
+											unsigned int row ) {
+	if ( sp < n ) {
+		ATHROW( "Invalid expression" );
+	}
+	return mBatchStack[ sp - n ][ row ];
 }
 
 //----------------------------------------------------------------------------
-// handle comparison operators
+// Perform single instruction for all active rows. Rows that take a jump
+// are moved to the list of rows waiting at its target.
 //----------------------------------------------------------------------------
 
-void Expression :: DoCompare( const string & op ) {
+void Expression :: BatchOp( unsigned int pc, unsigned int sp,
+								const Batch & rows ) {
 
-	string rhs = PopStr();
-	string lhs = PopStr();
+	const ExprInstr & in = mCode[pc];
+	if ( in.mOp == ExprInstr::opCall ) {
+		BatchCall( in, sp, rows );
+		return;
+	}
 
-	if ( IsNumber( rhs ) && IsNumber( lhs ) ) {
-		double dr = ToReal( rhs );
-		double dl = ToReal( lhs );
-		if ( op == "==" ) {
-			PushBool( dl == dr );
-		}
-		else if ( op == "<>" || op == "!="  ) {		// we allow either
-			PushBool( dl != dr );
-		}
-		else if ( op == "<" ) {
-			PushBool( dl < dr );
-		}
-		else if ( op == ">" ) {
-			PushBool( dl > dr );
+	unsigned int nactive = 0;
+	for ( unsigned int i = 0; i < mActive.size(); i++ ) {
+
+		unsigned int row = mActive[i];
+		if ( row >= mBatchFail ) {
+			continue;
 		}
-		else if ( op == ">=" ) {
-			PushBool( dl >= dr );
+
+		bool keep = true;
+		try {
+			switch( in.mOp ) {
+
+				case ExprInstr::opConst: {
+					mBatchStack[ sp ][ row ] = mConsts[ in.mArg ];
+					break;
+				}
+
+				case ExprInstr::opPosParam: {
+					if ( in.mArg < 0 ) {
+						ATHROW( "Invalid positional parameter " << in.mArg );
+					}
+					unsigned int n = in.mArg;
+					const vector <string> & params = rows[ row ];
+					mBatchStack[ sp ][ row ].SetStr( n < params.size()
+														? params[n] : "" );
+					break;
+				}
+
+				case ExprInstr::opVar: {
+					if ( ! mVarSet[ in.mArg ] ) {
+						ATHROW( "Unknown variable: " << mVarNames[ in.mArg ] );
+					}
+					mBatchStack[ sp ][ row ].SetStr( mVarVals[ in.mArg ] );
+					break;
+				}
+
+				case ExprInstr::opReadVar: {
+					ExprValue & v = BatchOperand( sp, 1, row );
+					mBoundParams = & rows[ row ];
+					v.SetStr( GetVar( v.GetStr() ) );
+					break;
+				}
+
+				case ExprInstr::opCat: {
+					const string & rhs = BatchOperand( sp, 1, row ).GetStr();
+					BatchOperand( sp, 2, row ).Append( rhs );
+					break;
+				}
+
+				case ExprInstr::opAdd: case ExprInstr::opSub:
+				case ExprInstr::opMul: case ExprInstr::opDiv:
+				case ExprInstr::opMod: {
+					ExprValue & rhs = BatchOperand( sp, 1, row );
+					Arith( in.mOp, BatchOperand( sp, 2, row ), rhs );
+					break;
+				}
+
+				case ExprInstr::opNeg: {
+					ExprValue & v = BatchOperand( sp, 1, row );
+					v.SetNum( - NumValue( v ) );
+					break;
+				}
+
+				case ExprInstr::opEq: case ExprInstr::opNe:
+				case ExprInstr::opLt: case ExprInstr::opGt:
+				case ExprInstr::opLe: case ExprInstr::opGe: {
+					ExprValue & rhs = BatchOperand( sp, 1, row );
+					Compare( in.mOp, BatchOperand( sp, 2, row ), rhs );
+					break;
+				}
+
+				case ExprInstr::opAnd: case ExprInstr::opOr: {
+					ExprValue & rhs = BatchOperand( sp, 1, row );
+					Logic( in.mOp, BatchOperand( sp, 2, row ), rhs );
+					break;
+				}
+
+				case ExprInstr::opBool: {
+					ExprValue & v = BatchOperand( sp, 1, row );
+					v.SetNum( v.ToBool() ? 1 : 0 );
+					break;
+				}
+
+				case ExprInstr::opJump: {
+					keep = false;
+					break;
+				}
+
+				case ExprInstr::opJumpFalse: {
+					keep = BatchOperand( sp, 1, row ).ToBool();
+					break;
+				}
+
+				case ExprInstr::opAndJump: case ExprInstr::opOrJump: {
+					ExprValue & v = BatchOperand( sp, 1, row );
+					bool b = v.ToBool();
+					if ( b == (in.mOp == ExprInstr::opOrJump) ) {
+						v.SetNum( b ? 1 : 0 );
+						keep = false;
+					}
+					break;
+				}
+
+				case ExprInstr::opEnd: {
+					if ( sp != 1 ) {
+						ATHROW( "Invalid expression" );
+					}
+					std::swap( mBatchResult[ row ], mBatchStack[0][ row ] );
+					break;
+				}
+
+				default: {
+					ATHROW( "Unknown operator: "  << mNames[ in.mArg ] );
+				}
+			}
+			if ( keep ) {
+				mActive[ nactive++ ] = row;
+			}
+			else {
+				mPending[ pc + in.mArg + 1 ].push_back( row );
+			}
 		}
-		else if ( op == "<=" ) {
-			PushBool( dl <= dr );
+		catch( ... ) {
+			BatchFail( row );
 		}
 	}
-	else {
-		if ( op == "==" ) {
-			PushBool( lhs == rhs );
-		}
-		else if ( op == "<>" || op == "!=" ) {
-			PushBool( lhs != rhs );
-		}
-		else if ( op == "<" ) {
-			PushBool( lhs < rhs );
-		}
-		else if ( op == ">" ) {
-			PushBool( lhs > rhs );
+	mActive.resize( nactive );
+}
+
+//----------------------------------------------------------------------------
+// Call function for all active rows. The parameters for each row are
+// swapped out of their columns so they can be passed in the same way as
+// for the row evaluator, and functions that look at the positional
+// parameters see the row being evaluated.
+//----------------------------------------------------------------------------
+
+void Expression :: BatchCall( const ExprInstr & in, unsigned int sp,
+								const Batch & rows ) {
+
+	const string & name = mNames[ in.mArg ];
+	const AddFunc * af = mNameFuncs[ in.mArg ];
+	unsigned int np = af ? af->mParamCount : 0;
+	mBatchArgs.resize( np );
+
+	unsigned int nactive = 0;
+	for ( unsigned int i = 0; i < mActive.size(); i++ ) {
+		unsigned int row = mActive[i];
+		if ( row >= mBatchFail ) {
+			continue;
 		}
-		else if ( op == ">=" ) {
-			PushBool( lhs >= rhs );
+		try {
+			CheckCall( name, af, sp );
+			for ( unsigned int j = 0; j < np; j++ ) {
+				std::swap( mBatchArgs[j], mBatchStack[ sp - np + j ][ row ] );
+			}
+			mBoundParams = & rows[ row ];
+			mCallSite = in.mArg;
+			string result = af->mFunc( ExprArgs( np ? & mBatchArgs[0] : 0, np ),
+											this );
+			mCallSite = -1;
+			mBatchStack[ sp - np ][ row ].SetStr( result );
+			mActive[ nactive++ ] = row;
 		}
-		else if ( op == "<=" ) {
-			PushBool( lhs <= rhs );
+		catch( ... ) {
+			mCallSite = -1;
+			BatchFail( row );
 		}
 	}
+	mActive.resize( nactive );
 }
 
 //----------------------------------------------------------------------------
-// convert string to bool - 0 or empty is false, anything else is true
+// Evaluate compiled expression for the first n rows of a block, skipping
+// rows that are not selected. Returns the number of rows evaluated - if
+// this is less than n, evaluation failed for the row at that index, and
+// ThrowBatchError() will throw the exception the row evaluator would have
+// thrown. Results for the rows before the failure are valid.
 //----------------------------------------------------------------------------
 
-bool Expression :: ToBool( const std::string & s )  {
-	if ( IsNumber(s ) ) {
-		double d = ToReal( s );
-		return d != 0.0;
+unsigned int Expression :: EvaluateBatch( const Batch & rows, unsigned int n,
+											const Selection & sel,
+											vector <string> & results ) {
+	RunBatch( rows, n, sel );
+	if ( results.size() < n ) {
+		results.resize( n );
 	}
-	else {
-		return s != "";
+	for ( unsigned int i = 0; i < mBatchFail; i++ ) {
+		if ( sel[i] ) {
+			results[i] = mBatchResult[i].GetStr();
+		}
 	}
+	return mBatchFail;
 }
 
 //----------------------------------------------------------------------------
-// Handle the && and || operators. Currently we don't do short-circuited
-// evaluation, but we certainly ought to.
+// As above, but only say which of the rows give a true result
 //----------------------------------------------------------------------------
 
-void Expression :: DoAndOr( const std::string & op ) {
-	string rhs = PopStr();
-	string lhs = PopStr();
-	bool ok = ToBool( lhs );
-	if ( ok ) {
-		if ( op == "&&" ) {
-			PushBool( ToBool( rhs ) );
-		}
-		else {
-			PushBool( ok );
-		}
+unsigned int Expression :: SelectBatch( const Batch & rows, unsigned int n,
+											const Selection & sel,
+											Selection & selected ) {
+	RunBatch( rows, n, sel );
+	selected.assign( n, 0 );
+	for ( unsigned int i = 0; i < mBatchFail; i++ ) {
+		selected[i] = sel[i] && mBatchResult[i].ToBool();
+	}
+	return mBatchFail;
+}
+
+void Expression :: ThrowBatchError() const {
+	std::rethrow_exception( mBatchError );
+}
+
+//----------------------------------------------------------------------------
+// Batch evaluation evaluates each expression for a whole block of rows in
+// turn, so callers that set variables for each row, or that evaluate more
+// than one expression for each row, need to know if that would make a
+// difference.
+//----------------------------------------------------------------------------
+
+bool Expression :: UsesVars() const {
+	return mUsesVars;
+}
+
+bool Expression :: IsStateful() const {
+	return mStateful;
+}
+
+//----------------------------------------------------------------------------
+// convert string to bool - 0 or empty is false, anything else is true
+//----------------------------------------------------------------------------
+
+bool Expression :: ToBool( const std::string & s )  {
+	double d;
+	if ( ParseReal( s, d ) ) {
+		return d != 0.0;
 	}
 	else {
-		if ( op == "||" ) {
-			PushBool( ToBool( rhs ) );
-		}
-		else {
-			PushBool( ok );
-		}
+		return s != "";
 	}
 }
 
@@ -1258,99 +2117,113 @@ string Expression :: GetVar( const string & var ) const {
 		if ( n < 0 ) {
 			ATHROW( "Invalid positional parameter " << n );
 		}
-		if ( n >= (int) mPosParams.size() ) {
+		const vector <string> & params = PosParams();
+		if ( n >= (int) params.size() ) {
 			return "";
 		}
 		else {
-			return mPosParams[n];
+			return params[n];
 		}
 	}
 	else {
-		const string * val = mVars.GetPtr( var );
-		if ( val == 0 ) {
+		const unsigned int * slot = mVarSlots.GetPtr( var );
+		if ( slot == 0 || ! mVarSet[ * slot ] ) {
 			ATHROW( "Unknown variable: " << var );
 		}
-		return * val;
+		return mVarVals[ * slot ];
 	}
 }
 
 //----------------------------------------------------------------------------
-// clear all named variables
+// Named variables live in slots, which compiled code refers to by index.
+// Clearing the variables keeps the slots, so that compiled code stays
+// valid, but referring to a cleared variable is an error until it is
+// given a value again.
 //----------------------------------------------------------------------------
 
 void Expression :: ClearVars() {
-	mVars.Clear();
+	mVarSet.assign( mVarSet.size(), false );
+}
+
+//----------------------------------------------------------------------------
+// Get slot for named variable, creating an unset slot if there isn't one.
+// Callers that set the same variable for every row can look the slot up
+// once and then use SetVar().
+//----------------------------------------------------------------------------
+
+unsigned int Expression :: VarSlot( const string & name ) {
+	const unsigned int * slot = mVarSlots.GetPtr( name );
+	if ( slot ) {
+		return * slot;
+	}
+	unsigned int n = mVarNames.size();
+	mVarSlots.Add( name, n );
+	mVarNames.push_back( name );
+	mVarVals.push_back( "" );
+	mVarSet.push_back( false );
+	return n;
+}
+
+void Expression :: SetVar( unsigned int slot, const string & val ) {
+	if ( slot >= mVarVals.size() ) {
+		ATHROW( "Invalid variable slot " << slot );
+	}
+	mVarVals[ slot ] = val;
+	mVarSet[ slot ] = true;
 }
 
 //----------------------------------------------------------------------------
 // add named variable, overwriting any exist ing value of same name
 //----------------------------------------------------------------------------
 void Expression :: AddVar( const string & name, const string & val ) {
-	mVars.Replace( name, val );
+	SetVar( VarSlot( name ), val );
 }
 
 //----------------------------------------------------------------------------
-// Given a token containing an operator, execute it, pushing result to stack
+// Value conversions. Strings are only parsed as numbers once, and numbers
+// are only formatted as strings when something asks for the string.
 //----------------------------------------------------------------------------
 
-void Expression :: ExecOp( const ExprToken & tok ) {
-	string op = tok.Value();
-	if ( op == "." ) {
-		string s = PopStr();
-		mStack.push( PopStr() + s );
-	}
-	else if ( op == "+" ) {
-		mStack.push( Str( PopNum() + PopNum() ) );
-	}
-	else if ( op == "-" ) {
-		double n = PopNum();
-		mStack.push( Str( PopNum() - n ) );
-	}
-	else if ( op == "*" ) {
-		mStack.push( Str( PopNum() * PopNum() ) );
-	}
-	else if ( op == "/" ) {
-		double n = PopNum();
-		if ( n == 0 ) {
-			ATHROW( "Divide by zero" );
-		}
-		mStack.push( Str( PopNum() / n ) );
-	}
-	else if ( op == "%" ) {
-		double rhs = PopNum();
-		double lhs = PopNum();
-		if ( lhs < 0 || rhs < 0 ) {
-			ATHROW( "Invalid operands for % operator" );
-		}
-		int n = int(lhs) % int(rhs);
-		mStack.push( Str( n ) );
-	}
-	else if ( op == "*" ) {
-		mStack.push( Str( PopNum() * PopNum() ) );
-	}
-	else if ( In( op, IgnoreCase, "==", "<>", "!=", "<", ">", "<=", ">=", NULL ) ) {
-		DoCompare( op );
-	}
-	else if ( op == "&&" || op == "||" ) {
-		DoAndOr( op );
-	}
-	else if ( op == UMINUS_STR ) {
-		double d = - PopNum();
-		mStack.push( Str( d ) );
-	}
-	else if ( op == RDVAR_STR ) {
-		string s = PopStr();
-		mStack.push( GetVar( s ) );
-	}
-	else if ( op == FNCALL_STR ) {
-		string fun = PopStr();
-		mStack.push( CallFunction( fun ) );
+void ExprValue :: SetNum( double d ) {
+	mHasStr = false;
+	mNumState = nsNum;
+	mNum = d;
+}
+
+void ExprValue :: SetStr( const string & s ) {
+	mHasStr = true;
+	mNumState = nsUnknown;
+	mStr = s;
+}
+
+void ExprValue :: Append( const string & s ) {
+	GetStr();
+	mStr += s;
+	mNumState = nsUnknown;
+}
+
+bool ExprValue :: IsNum() {
+	if ( mNumState == nsUnknown ) {
+		mNumState = ParseReal( mStr, mNum ) ? nsNum : nsNotNum;
 	}
-	else {
-		ATHROW( "Unknown operator: "  << op );
+	return mNumState == nsNum;
+}
+
+double ExprValue :: GetNum() const {
+	return mNum;
+}
+
+const string & ExprValue :: GetStr() {
+	if ( ! mHasStr ) {
+		mStr = Str( mNum );
+		mHasStr = true;
 	}
+	return mStr;
 }
 
+bool ExprValue :: ToBool() {
+	return IsNum() ? mNum != 0.0 : GetStr() != "";
+}
 
 //----------------------------------------------------------------------------
 
@@ -1362,6 +2235,7 @@ void Expression :: ExecOp( const ExprToken & tok ) {
 
 #ifdef ALIB_TEST
 #include "a_myth.h"
+#include <stdexcept>
 using namespace ALib;
 using namespace std;
 
@@ -1536,6 +2410,174 @@ DEFTEST( RegExTest ) {
 	FAILNE( s, "1" );
 }
 
+DEFTEST( TypedValueTest ) {
+	Expression e;
+	string s = e.Evaluate( "1.50 . 'x'" );
+	FAILNE( s, "1.50x" );
+	s = e.Evaluate( "(1 / 3) * 3 == 1" );
+	FAILNE( s, "1" );
+	s = e.Evaluate( "1 + 2 . 'x'" );
+	FAILNE( s, "3x" );
+	s = e.Evaluate( "'10' < '9'" );
+	FAILNE( s, "0" );
+	s = e.Evaluate( "'abc' < 'abd'" );
+	FAILNE( s, "1" );
+	MUST_THROW( e.Evaluate( "1 + 'a'" ) );
+	MUST_THROW( e.Evaluate( "nosuch(1)" ) );
+	e.AddPosParam( "2" );
+	e.Compile( "$1 * 3" );
+	FAILNE( e.Evaluate(), "6" );
+	FAILNE( e.Evaluate(), "6" );
+}
+
+DEFTEST( ShortCircuitTest ) {
+	Expression e;
+	e.AddPosParam( "0" );
+	e.AddPosParam( "5" );
+	string s = e.Evaluate( "$1 && 'x' + 1" );
+	FAILNE( s, "0" );
+	s = e.Evaluate( "$2 || 'x' + 1" );
+	FAILNE( s, "1" );
+	s = e.Evaluate( "$2 && 'x'" );
+	FAILNE( s, "1" );
+	s = e.Evaluate( "if( $1, 'x' + 1, $2 * 2 )" );
+	FAILNE( s, "10" );
+	s = e.Evaluate( "if( $2 > 1, 'big', 1 / 0 )" );
+	FAILNE( s, "big" );
+	MUST_THROW( e.Evaluate( "$2 && 'x' + 1" ) );
+}
+
+DEFTEST( FoldTest ) {
+	Expression e;
+	e.Compile( "1 + 2 * 3 . 'x'" );
+	FAILNE( e.Evaluate(), "7x" );
+	e.Compile( "0 && $1; 2 > 1 || $1" );
+	FAILNE( e.Evaluate(), "1" );
+	e.Compile( "if( 1, 'a', 'x' + 1 )" );
+	FAILNE( e.Evaluate(), "a" );
+	e.Compile( "1 / 0" );
+	MUST_THROW( e.Evaluate() );
+}
+
+DEFTEST( RegExCacheTest ) {
+	Expression e;
+	e.AddPosParam( "abc" );
+	e.AddPosParam( "x" );
+	e.Compile( "match( $1, '^a' ) . match( $1, $2 ) . find( 'x' )" );
+	FAILNE( e.Evaluate(), "102" );
+	FAILNE( e.Evaluate(), "102" );
+	const RegEx & r1 = e.GetRegEx( "b+" );
+	const RegEx & r2 = e.GetRegEx( "b+" );
+	FAILNE( & r1, & r2 );
+	for ( int i = 0; i < 40; i++ ) {
+		FAILIF( ! e.GetRegEx( Str( i ) ).FindIn( Str( i ) ).Found() );
+	}
+	FAILNE( e.Evaluate(), "102" );
+}
+
+DEFTEST( BindTest ) {
+	Expression e;
+	e.Compile( "$3 . $1" );
+	vector <string> row;
+	row.push_back( "a" );
+	row.push_back( "b" );
+	row.push_back( "c" );
+	e.BindPosParams( row );
+	FAILNE( e.Evaluate(), "ca" );
+	row[0] = "x";
+	FAILNE( e.Evaluate(), "cx" );
+	FAILNE( e.PosParamCount(), 3 );
+	e.Compile( "field(2)" );
+	FAILNE( e.Evaluate(), "b" );
+	e.AddPosParam( "d" );
+	row.clear();
+	FAILNE( e.PosParamCount(), 4 );
+}
+
+DEFTEST( VarSlotTest ) {
+	Expression e;
+	e.Compile( "$count * 2 . $Name" );
+	MUST_THROW( e.Evaluate() );
+	unsigned int slot = e.VarSlot( "COUNT" );
+	e.SetVar( slot, "21" );
+	e.AddVar( "name", "x" );
+	FAILNE( e.Evaluate(), "42x" );
+	e.SetVar( slot, "1" );
+	FAILNE( e.Evaluate(), "2x" );
+	FAILNE( e.VarSlot( "count" ), slot );
+	e.ClearVars();
+	MUST_THROW( e.Evaluate() );
+	e.AddVar( "count", "3" );
+	e.AddVar( "name", "" );
+	FAILNE( e.Evaluate(), "6" );
+	FAILNE( e.Evaluate( "max( $count, 10 ) . len( 'abc' )" ), "103" );
+}
+
+DEFTEST( BatchTest ) {
+	const char * exprs[] = {
+		"$1 * 2 + $2", "$1 > 2 && $3 != 'b' || $2 == ''",
+		"if( $1 % 2, upper( $3 ), len( $3 ) . '!' )", "field( 3 ) . $1",
+		"10 / ($1 - 3)", "$3 + 1", "$$1", 0
+	};
+	Expression::Batch rows;
+	for ( int i = 0; i < 6; i++ ) {
+		vector <string> row;
+		row.push_back( Str( i ) );
+		row.push_back( i == 4 ? "" : Str( i * 0.5 ) );
+		row.push_back( i % 2 ? "a" : "b" );
+		rows.push_back( row );
+	}
+	Expression::Selection sel( rows.size(), 1 ), selected;
+	sel[1] = 0;
+	for ( int i = 0; exprs[i]; i++ ) {
+		Expression e;
+		e.Compile( exprs[i] );
+		vector <string> results;
+		unsigned int n = e.EvaluateBatch( rows, rows.size(), sel, results );
+		unsigned int ns = e.SelectBatch( rows, rows.size(), sel, selected );
+		FAILNE( n, ns );
+		for ( unsigned int r = 0; r < rows.size(); r++ ) {
+			if ( ! sel[r] ) {
+				continue;
+			}
+			e.BindPosParams( rows[r] );
+			string expect;
+			try {
+				expect = e.Evaluate();
+			}
+			catch( const Exception & ex ) {
+				FAILNE( n, r );
+				MUST_THROW( e.ThrowBatchError() );
+				break;
+			}
+			FAILIF( n <= r );
+			FAILNEM( results[r], expect, exprs[i] );
+			FAILNE( (bool) selected[r], Expression::ToBool( expect ) );
+		}
+	}
+	Expression e;
+	e.Compile( "$n . random()" );
+	FAILIF( ! e.UsesVars() );
+	FAILIF( ! e.IsStateful() );
+
+	// errors that are not ours must also be kept until the good rows are used
+	Expression::Batch srows( 3, vector <string>( 1, "abcdefg" ) );
+	srows[2][0] = "ab";
+	Expression::Selection ssel( srows.size(), 1 );
+	vector <string> results;
+	e.Compile( "substr( $1, 5, 1 )" );
+	FAILNE( e.EvaluateBatch( srows, srows.size(), ssel, results ), 2 );
+	FAILNE( results[1], "e" );
+	bool caught = false;
+	try {
+		e.ThrowBatchError();
+	}
+	catch( const std::out_of_range & ) {
+		caught = true;
+	}
+	FAILIF( ! caught );
+}
+
 struct ExprTest {
 	const char * expr;
 	const char * result;
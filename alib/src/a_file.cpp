@@ -11,8 +11,19 @@
 #include "a_except.h"
 #include "a_str.h"
 #include "a_collect.h"
+#include "a_win.h"
 // We assume support for dirent - true for MinGW and Linux.
 #include <dirent.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+
+#ifndef ALIB_WINAPI
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 
 using std::string;
@@ -289,6 +300,184 @@ bool DirExists( const std::string & dirname ) {
 	return DirEnt::Exists( dirname );
 }
 
+//---------------------------------------------------------------------------
+// Get stamp of file. Returns false if the file can't be accessed.
+//---------------------------------------------------------------------------
+
+const unsigned long long NSEC_PER_SEC = 1000000000ULL;
+
+bool GetFileStamp( const string & fname, FileStamp & fs ) {
+	struct stat st;
+	if ( stat( fname.c_str(), & st ) != 0 ) {
+		return false;
+	}
+	fs.mSize = st.st_size;
+	fs.mInode = st.st_ino;
+	fs.mDevice = st.st_dev;
+#ifdef ALIB_WINAPI
+	fs.mModTime = st.st_mtime * NSEC_PER_SEC;
+	fs.mChangeTime = st.st_ctime * NSEC_PER_SEC;
+#else
+	fs.mModTime = st.st_mtim.tv_sec * NSEC_PER_SEC + st.st_mtim.tv_nsec;
+	fs.mChangeTime = st.st_ctim.tv_sec * NSEC_PER_SEC + st.st_ctim.tv_nsec;
+#endif
+	return true;
+}
+
+bool FileStamp :: operator == ( const FileStamp & fs ) const {
+	return mSize == fs.mSize && mModTime == fs.mModTime
+			&& mChangeTime == fs.mChangeTime
+			&& mInode == fs.mInode && mDevice == fs.mDevice;
+}
+
+//---------------------------------------------------------------------------
+// Reading a regular file never waits, so only poll pipes and terminals.
+// With glibc we can see if a whole line is already buffered, and save
+// the system call. Elsewhere buffered data is not seen, so this may say we
+// would wait when we would not, but never the other way round.
+//---------------------------------------------------------------------------
+
+bool StdinWouldWait() {
+#ifdef ALIB_WINAPI
+	return false;
+#else
+	static int regular = -1;
+	if ( regular < 0 ) {
+		struct stat st;
+		regular = fstat( 0, & st ) == 0 && S_ISREG( st.st_mode );
+	}
+	if ( regular ) {
+		return false;
+	}
+#ifdef __GLIBC__
+	if ( stdin->_IO_read_ptr < stdin->_IO_read_end
+			&& memchr( stdin->_IO_read_ptr, '\n',
+						stdin->_IO_read_end - stdin->_IO_read_ptr ) ) {
+		return false;
+	}
+#endif
+	struct pollfd pfd;
+	pfd.fd = 0;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	return poll( & pfd, 1, 0 ) == 0;
+#endif
+}
+
+//---------------------------------------------------------------------------
+// Memory mapped file
+//---------------------------------------------------------------------------
+
+MappedFile :: MappedFile()
+	: mData( 0 ), mSize( 0 ), mOpen( false ), mFile( 0 ), mMap( 0 ) {
+}
+
+MappedFile :: ~MappedFile() {
+	Close();
+}
+
+bool MappedFile :: IsOpen() const {
+	return mOpen;
+}
+
+const char * MappedFile :: Data() const {
+	return mData;
+}
+
+unsigned long long MappedFile :: Size() const {
+	return mSize;
+}
+
+//---------------------------------------------------------------------------
+// Map whole file, returning false if it can't be mapped. An empty file
+// can be opened, but has no data.
+//---------------------------------------------------------------------------
+
+bool MappedFile :: Open( const string & fname ) {
+
+	Close();
+
+#ifdef ALIB_WINAPI
+	HANDLE fh = CreateFileA( fname.c_str(), GENERIC_READ, FILE_SHARE_READ,
+								NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+								NULL );
+	if ( fh == INVALID_HANDLE_VALUE ) {
+		return false;
+	}
+	LARGE_INTEGER size;
+	if ( ! GetFileSizeEx( fh, & size ) ) {
+		CloseHandle( fh );
+		return false;
+	}
+	mFile = fh;
+	mSize = size.QuadPart;
+	if ( mSize ) {
+		HANDLE mh = CreateFileMappingA( fh, NULL, PAGE_READONLY, 0, 0, NULL );
+		void * p = mh ? MapViewOfFile( mh, FILE_MAP_READ, 0, 0, 0 ) : NULL;
+		if ( p == NULL ) {
+			if ( mh ) {
+				CloseHandle( mh );
+			}
+			CloseHandle( fh );
+			mFile = 0;
+			mSize = 0;
+			return false;
+		}
+		mMap = mh;
+		mData = (const char *) p;
+	}
+#else
+	int fd = open( fname.c_str(), O_RDONLY );
+	if ( fd < 0 ) {
+		return false;
+	}
+	struct stat st;
+	if ( fstat( fd, & st ) != 0 ) {
+		close( fd );
+		return false;
+	}
+	mSize = st.st_size;
+	if ( mSize ) {
+		void * p = mmap( 0, mSize, PROT_READ, MAP_SHARED, fd, 0 );
+		if ( p == MAP_FAILED ) {
+			close( fd );
+			mSize = 0;
+			return false;
+		}
+		mData = (const char *) p;
+	}
+	close( fd );		// mapping stays valid
+#endif
+
+	mOpen = true;
+	return true;
+}
+
+//---------------------------------------------------------------------------
+// Unmap file if it is mapped
+//---------------------------------------------------------------------------
+
+void MappedFile :: Close() {
+#ifdef ALIB_WINAPI
+	if ( mData ) {
+		UnmapViewOfFile( mData );
+	}
+	if ( mMap ) {
+		CloseHandle( (HANDLE) mMap );
+	}
+	if ( mFile ) {
+		CloseHandle( (HANDLE) mFile );
+	}
+#else
+	if ( mData ) {
+		munmap( (void *) mData, mSize );
+	}
+#endif
+	mData = 0;
+	mSize = 0;
+	mOpen = false;
+	mFile = mMap = 0;
+}
 
 //---------------------------------------------------------------------------
 
@@ -324,6 +513,25 @@ DEFTEST( FileTest ) {
 	FAILIF( ! DirExists( "/" ) );
 }
 
+DEFTEST( MappedFileTest ) {
+	MappedFile mf;
+	FAILIF( mf.Open( "not_there" ) );
+	FAILIF( mf.IsOpen() );
+	FAILIF( ! mf.Open( "Makefile" ) );
+	string s;
+	FileRead( "Makefile", s );
+	FAILNE( mf.Size(), s.size() );
+	FAILIF( string( mf.Data(), mf.Size() ) != s );
+	FileStamp fs, fs2;
+	FAILIF( ! GetFileStamp( "Makefile", fs ) );
+	FAILNE( fs.mSize, s.size() );
+	FAILIF( ! GetFileStamp( "Makefile", fs2 ) );
+	FAILIF( ! (fs == fs2) );
+	FAILIF( GetFileStamp( "not_there", fs ) );
+	mf.Close();
+	FAILIF( mf.IsOpen() );
+}
+
 #endif
 
 // end
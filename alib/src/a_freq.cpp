@@ -0,0 +1,190 @@
+//---------------------------------------------------------------------------
+// a_freq.cpp
+//
+// approximate most frequent items in a stream
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#include "a_base.h"
+#include "a_freq.h"
+#include <algorithm>
+
+using std::string;
+using std::vector;
+
+namespace ALib {
+
+//---------------------------------------------------------------------------
+// Items are kept in a min-heap ordered on count, so that the item to be
+// replaced is always at the top. The heap holds indexes into the item
+// vector, and we track where each item is in the heap.
+//---------------------------------------------------------------------------
+
+FrequentItems :: FrequentItems( unsigned int capacity )
+	: mCapacity( std::max( capacity, 1u ) ), mCount( 0 ) {
+	mItems.reserve( mCapacity );
+	mHeap.reserve( mCapacity );
+	mHeapPos.reserve( mCapacity );
+}
+
+//---------------------------------------------------------------------------
+// Count key, replacing least frequent key if we are full. The replaced
+// count becomes the error of the new key.
+//---------------------------------------------------------------------------
+
+void FrequentItems :: Add( const string & key ) {
+
+	mCount++;
+	IndexMap::iterator it = mIndex.find( key );
+	if ( it != mIndex.end() ) {
+		mItems[it->second].mCount++;
+		SiftDown( mHeapPos[it->second] );
+	}
+	else if ( mItems.size() < mCapacity ) {
+		unsigned int idx = mItems.size();
+		mItems.push_back( Item( key ) );
+		mItems.back().mCount = 1;
+		mHeap.push_back( idx );
+		mHeapPos.push_back( mHeap.size() - 1 );
+		mIndex.insert( std::make_pair( key, idx ) );
+		SiftUp( mHeap.size() - 1 );
+	}
+	else {
+		unsigned int idx = mHeap[0];
+		Item & item = mItems[idx];
+		mIndex.erase( item.mKey );
+		item.mKey = key;
+		item.mError = item.mCount;
+		item.mCount++;
+		mIndex.insert( std::make_pair( key, idx ) );
+		SiftDown( 0 );
+	}
+}
+
+//---------------------------------------------------------------------------
+// Heap helpers
+//---------------------------------------------------------------------------
+
+bool FrequentItems :: Less( unsigned int h1, unsigned int h2 ) const {
+	return mItems[mHeap[h1]].mCount < mItems[mHeap[h2]].mCount;
+}
+
+void FrequentItems :: Swap( unsigned int h1, unsigned int h2 ) {
+	std::swap( mHeap[h1], mHeap[h2] );
+	mHeapPos[mHeap[h1]] = h1;
+	mHeapPos[mHeap[h2]] = h2;
+}
+
+void FrequentItems :: SiftUp( unsigned int hpos ) {
+	while( hpos > 0 ) {
+		unsigned int parent = (hpos - 1) / 2;
+		if ( ! Less( hpos, parent ) ) {
+			break;
+		}
+		Swap( hpos, parent );
+		hpos = parent;
+	}
+}
+
+void FrequentItems :: SiftDown( unsigned int hpos ) {
+	unsigned int n = mHeap.size();
+	while( true ) {
+		unsigned int least = hpos, left = 2 * hpos + 1, right = left + 1;
+		if ( left < n && Less( left, least ) ) {
+			least = left;
+		}
+		if ( right < n && Less( right, least ) ) {
+			least = right;
+		}
+		if ( least == hpos ) {
+			break;
+		}
+		Swap( hpos, least );
+		hpos = least;
+	}
+}
+
+//---------------------------------------------------------------------------
+// Total number of keys added
+//---------------------------------------------------------------------------
+
+unsigned long FrequentItems :: Count() const {
+	return mCount;
+}
+
+unsigned int FrequentItems :: Capacity() const {
+	return mCapacity;
+}
+
+//---------------------------------------------------------------------------
+// Get the n most frequent items, highest count first. Ties are ordered by
+// key so that output is repeatable.
+//---------------------------------------------------------------------------
+
+static bool MoreFrequent( const FrequentItems::Item & a,
+							const FrequentItems::Item & b ) {
+	if ( a.mCount != b.mCount ) {
+		return a.mCount > b.mCount;
+	}
+	return a.mKey < b.mKey;
+}
+
+void FrequentItems :: Top( unsigned int n, vector <Item> & items ) const {
+	items = mItems;
+	std::sort( items.begin(), items.end(), MoreFrequent );
+	if ( items.size() > n ) {
+		items.resize( n );
+	}
+}
+
+//------------------------------------------------------------------------
+
+} // end namespace
+
+//----------------------------------------------------------------------------
+// Tests
+//----------------------------------------------------------------------------
+
+#ifdef ALIB_TEST
+
+#include "a_myth.h"
+#include "a_str.h"
+using namespace ALib;
+using namespace std;
+
+DEFSUITE( "a_freq" );
+
+DEFTEST( ExactWhenRoomy ) {
+	FrequentItems fi( 10 );
+	const char * keys[] = { "a", "b", "a", "c", "a", "b" };
+	for ( unsigned int i = 0; i < 6; i++ ) {
+		fi.Add( keys[i] );
+	}
+	vector <FrequentItems::Item> top;
+	fi.Top( 2, top );
+	FAILNE( top.size(), 2 );
+	FAILNE( top[0].mKey, "a" );
+	FAILNE( top[0].mCount, 3 );
+	FAILNE( top[0].mError, 0 );
+	FAILNE( top[1].mKey, "b" );
+	FAILNE( top[1].mCount, 2 );
+}
+
+DEFTEST( HeavyHitterSurvives ) {
+	FrequentItems fi( 4 );
+	for ( int i = 0; i < 1000; i++ ) {
+		fi.Add( "hot" );
+		fi.Add( Str( i ) );
+	}
+	vector <FrequentItems::Item> top;
+	fi.Top( 1, top );
+	FAILNE( top[0].mKey, "hot" );
+	FAILIF( top[0].mCount - top[0].mError > 1000 );
+	FAILIF( top[0].mCount < 1000 );
+	FAILNE( fi.Count(), 2000 );
+}
+
+#endif
+
+// end
@@ -0,0 +1,280 @@
+//---------------------------------------------------------------------------
+// a_hashset.cpp
+//
+// compact hashed set of strings for fast membership tests
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#include "a_base.h"
+#include "a_except.h"
+#include "a_hashset.h"
+#include <cctype>
+#include <climits>
+#include <cstring>
+
+using std::string;
+
+namespace ALib {
+
+//---------------------------------------------------------------------------
+// The table starts small and doubles whenever it becomes half full. The
+// Bloom filter is only worth having when the table is too big for cache -
+// it uses one byte per slot, with each key setting four bits in a single
+// 64-bit word so that a lookup costs one memory access.
+//---------------------------------------------------------------------------
+
+const unsigned int INIT_SLOTS = 64;
+const unsigned int BLOOM_SLOTS = 1 << 19;
+const unsigned int BLOOM_WORD_SLOTS = 8;
+
+//---------------------------------------------------------------------------
+// Create empty set
+//---------------------------------------------------------------------------
+
+StringSet :: StringSet( bool icase )
+	: mIgnoreCase( icase ), mSize( 0 ) {
+	Clear();
+}
+
+//---------------------------------------------------------------------------
+// Remove all strings
+//---------------------------------------------------------------------------
+
+void StringSet :: Clear() {
+	Slot empty = { 0, 0 };
+	mSlots.assign( INIT_SLOTS, empty );
+	mChars.clear();
+	mBloom.clear();
+	mSize = 0;
+}
+
+unsigned int StringSet :: Size() const {
+	return mSize;
+}
+
+//---------------------------------------------------------------------------
+// FNV-1a, followed by a final mix so that all bits depend on all bytes -
+// we take the slot from the low bits and the tag from the high ones.
+//---------------------------------------------------------------------------
+
+const unsigned long long FNV_BASIS = 14695981039346656037ULL;
+const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+static unsigned long long Mix( unsigned long long h ) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+unsigned long long HashBytes( const char * p, unsigned int len ) {
+	unsigned long long h = FNV_BASIS;
+	for ( unsigned int i = 0; i < len; i++ ) {
+		h ^= (unsigned char) p[i];
+		h *= FNV_PRIME;
+	}
+	return Mix( h );
+}
+
+StringSet::Hash StringSet :: HashOf( const string & s ) const {
+	if ( ! mIgnoreCase ) {
+		return HashBytes( s.data(), s.size() );
+	}
+	Hash h = FNV_BASIS;
+	for ( unsigned int i = 0; i < s.size(); i++ ) {
+		h ^= std::tolower( (unsigned char) s[i] );
+		h *= FNV_PRIME;
+	}
+	return Mix( h );
+}
+
+//---------------------------------------------------------------------------
+// Strings are stored in mChars as a four byte length followed by the
+// characters, so no per-string allocation is needed.
+//---------------------------------------------------------------------------
+
+bool StringSet :: Same( const Slot & slot, const string & s ) const {
+	const char * p = & mChars[ slot.mOffset - 1 ];
+	unsigned int len;
+	std::memcpy( & len, p, sizeof( len ) );
+	if ( len != s.size() ) {
+		return false;
+	}
+	p += sizeof( len );
+	if ( ! mIgnoreCase ) {
+		return std::memcmp( p, s.data(), len ) == 0;
+	}
+	for ( unsigned int i = 0; i < len; i++ ) {
+		if ( std::tolower( (unsigned char) p[i] )
+				!= std::tolower( (unsigned char) s[i] ) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------
+// Find slot containing s, or the empty slot where it would go.
+//---------------------------------------------------------------------------
+
+unsigned int StringSet :: Probe( const string & s, Hash h ) const {
+	unsigned int mask = mSlots.size() - 1;
+	unsigned int tag = (unsigned int)( h >> 32 );
+	unsigned int i = (unsigned int) h & mask;
+	while( mSlots[i].mOffset ) {
+		if ( mSlots[i].mTag == tag && Same( mSlots[i], s ) ) {
+			break;
+		}
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+//---------------------------------------------------------------------------
+// Bloom filter bits are taken from parts of the hash not used to pick the
+// filter word.
+//---------------------------------------------------------------------------
+
+static unsigned long long BloomBits( unsigned long long h ) {
+	return (1ULL << (h & 63)) | (1ULL << ((h >> 6) & 63))
+			| (1ULL << ((h >> 12) & 63)) | (1ULL << ((h >> 18) & 63));
+}
+
+void StringSet :: BloomAdd( Hash h ) {
+	unsigned int w = (unsigned int)( h >> 40 ) & (mBloom.size() - 1);
+	mBloom[w] |= BloomBits( h );
+}
+
+bool StringSet :: BloomMayHave( Hash h ) const {
+	unsigned int w = (unsigned int)( h >> 40 ) & (mBloom.size() - 1);
+	Hash bits = BloomBits( h );
+	return (mBloom[w] & bits) == bits;
+}
+
+//---------------------------------------------------------------------------
+// Double the table size, rehashing the stored strings. We don't keep the
+// full hash, so it is recomputed from the string.
+//---------------------------------------------------------------------------
+
+void StringSet :: Grow() {
+	Slot empty = { 0, 0 };
+	std::vector <Slot> old( mSlots.size() * 2, empty );
+	old.swap( mSlots );
+	if ( mSlots.size() >= BLOOM_SLOTS ) {
+		mBloom.assign( mSlots.size() / BLOOM_WORD_SLOTS, 0 );
+	}
+	string s;
+	for ( unsigned int i = 0; i < old.size(); i++ ) {
+		if ( old[i].mOffset ) {
+			const char * p = & mChars[ old[i].mOffset - 1 ];
+			unsigned int len;
+			std::memcpy( & len, p, sizeof( len ) );
+			s.assign( p + sizeof( len ), len );
+			Hash h = HashOf( s );
+			mSlots[ Probe( s, h ) ] = old[i];
+			if ( mBloom.size() ) {
+				BloomAdd( h );
+			}
+		}
+	}
+}
+
+//---------------------------------------------------------------------------
+// Add string to set - adding an existing string has no effect.
+//---------------------------------------------------------------------------
+
+void StringSet :: Add( const string & s ) {
+	Hash h = HashOf( s );
+	unsigned int i = Probe( s, h );
+	if ( mSlots[i].mOffset ) {
+		return;
+	}
+	unsigned int len = s.size();
+	if ( mChars.size() + sizeof( len ) + len >= UINT_MAX ) {
+		ATHROW( "String set too large" );
+	}
+	mSlots[i].mTag = (unsigned int)( h >> 32 );
+	mSlots[i].mOffset = mChars.size() + 1;
+	const char * lp = (const char *) & len;
+	mChars.insert( mChars.end(), lp, lp + sizeof( len ) );
+	mChars.insert( mChars.end(), s.begin(), s.end() );
+	if ( mBloom.size() ) {
+		BloomAdd( h );
+	}
+	if ( ++mSize * 2 > mSlots.size() ) {
+		Grow();
+	}
+}
+
+//---------------------------------------------------------------------------
+// Is string in set?
+//---------------------------------------------------------------------------
+
+bool StringSet :: Contains( const string & s ) const {
+	Hash h = HashOf( s );
+	if ( mBloom.size() && ! BloomMayHave( h ) ) {
+		return false;
+	}
+	return mSlots[ Probe( s, h ) ].mOffset != 0;
+}
+
+//------------------------------------------------------------------------
+
+} // end namespace
+
+//----------------------------------------------------------------------------
+// Tests
+//----------------------------------------------------------------------------
+
+#ifdef ALIB_TEST
+
+#include "a_myth.h"
+#include "a_str.h"
+using namespace ALib;
+using namespace std;
+
+DEFSUITE( "a_hashset" );
+
+DEFTEST( AddContains ) {
+	StringSet ss;
+	FAILIF( ss.Contains( "" ) );
+	ss.Add( "foo" );
+	ss.Add( "bar" );
+	ss.Add( "foo" );
+	ss.Add( "" );
+	FAILNE( ss.Size(), 3 );
+	FAILIF( ! ss.Contains( "foo" ) );
+	FAILIF( ! ss.Contains( "bar" ) );
+	FAILIF( ! ss.Contains( "" ) );
+	FAILIF( ss.Contains( "fo" ) );
+	FAILIF( ss.Contains( "FOO" ) );
+	ss.Clear();
+	FAILNE( ss.Size(), 0 );
+	FAILIF( ss.Contains( "foo" ) );
+}
+
+DEFTEST( CaseInsensitive ) {
+	StringSet ss( true );
+	ss.Add( "Foo" );
+	ss.Add( "FOO" );
+	FAILNE( ss.Size(), 1 );
+	FAILIF( ! ss.Contains( "foo" ) );
+	FAILIF( ! ss.Contains( "fOO" ) );
+	FAILIF( ss.Contains( "fo" ) );
+}
+
+DEFTEST( ManyWithBloom ) {
+	StringSet ss;
+	for ( int i = 0; i < 400000; i += 2 ) {
+		ss.Add( Str( i ) );
+	}
+	FAILNE( ss.Size(), 200000 );
+	for ( int i = 0; i < 400000; i++ ) {
+		FAILNE( ss.Contains( Str( i ) ), i % 2 == 0 );
+	}
+}
+
+#endif
+
+// end
@@ -0,0 +1,203 @@
+//---------------------------------------------------------------------------
+// a_lsearch.cpp
+//
+// search for any of a set of literal strings
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#include "a_base.h"
+#include "a_lsearch.h"
+#include <map>
+#include <deque>
+#include <algorithm>
+
+using std::string;
+using std::vector;
+
+namespace ALib {
+
+//---------------------------------------------------------------------------
+// Nothing is built until we search
+//---------------------------------------------------------------------------
+
+LiteralSearch :: LiteralSearch() : mBuilt( false ) {
+}
+
+void LiteralSearch :: Add( const string & lit ) {
+	mLiterals.push_back( lit );
+	mBuilt = false;
+}
+
+unsigned int LiteralSearch :: Size() const {
+	return mLiterals.size();
+}
+
+void LiteralSearch :: Clear() {
+	mLiterals.clear();
+	mBuilt = false;
+}
+
+//---------------------------------------------------------------------------
+// Get child of node on character c, or -1 if there isn't one. The root has
+// a full table, as most characters are looked up there. Other nodes keep
+// their edges sorted on character, so memory use is proportional to the
+// total length of the literals.
+//---------------------------------------------------------------------------
+
+int LiteralSearch :: Child( int node, unsigned char c ) const {
+	if ( node == 0 ) {
+		return mRoot[c];
+	}
+	const Node & n = mNodes[node];
+	unsigned int lo = n.mFirst, hi = n.mFirst + n.mCount;
+	while( lo < hi ) {
+		unsigned int mid = (lo + hi) / 2;
+		if ( mEdges[mid].mChar < c ) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	return lo < n.mFirst + n.mCount && mEdges[lo].mChar == c
+				? mEdges[lo].mNode : -1;
+}
+
+//---------------------------------------------------------------------------
+// Build a trie of the literals, then work out the failure links breadth
+// first. As we only want to know if anything matches, a node is an output
+// if any node on its failure chain ends a literal.
+//---------------------------------------------------------------------------
+
+void LiteralSearch :: Build() const {
+	typedef std::map <unsigned char, int> Kids;
+	vector <Kids> kids( 1 );
+	mNodes.assign( 1, Node() );
+	for ( unsigned int i = 0; i < mLiterals.size(); i++ ) {
+		int node = 0;
+		for ( unsigned int j = 0; j < mLiterals[i].size(); j++ ) {
+			unsigned char c = mLiterals[i][j];
+			Kids::const_iterator it = kids[node].find( c );
+			if ( it == kids[node].end() ) {
+				kids[node].insert( std::make_pair( c, (int) mNodes.size() ) );
+				node = mNodes.size();
+				mNodes.push_back( Node() );
+				kids.push_back( Kids() );
+			}
+			else {
+				node = it->second;
+			}
+		}
+		mNodes[node].mOut = true;
+	}
+
+	mEdges.clear();
+	mRoot.assign( 256, -1 );
+	for ( unsigned int i = 0; i < mNodes.size(); i++ ) {
+		mNodes[i].mFirst = mEdges.size();
+		mNodes[i].mCount = kids[i].size();
+		for ( Kids::const_iterator it = kids[i].begin();
+					it != kids[i].end(); ++it ) {
+			mEdges.push_back( Edge( it->first, it->second ) );
+			if ( i == 0 ) {
+				mRoot[it->first] = it->second;
+			}
+		}
+	}
+
+	std::deque <int> todo( 1, 0 );
+	while( ! todo.empty() ) {
+		int node = todo.front();
+		todo.pop_front();
+		const Node & n = mNodes[node];
+		for ( unsigned int i = n.mFirst; i < n.mFirst + n.mCount; i++ ) {
+			int child = mEdges[i].mNode;
+			int fail = 0;
+			if ( node != 0 ) {
+				int f = n.mFail;
+				while( f != 0 && Child( f, mEdges[i].mChar ) < 0 ) {
+					f = mNodes[f].mFail;
+				}
+				fail = std::max( Child( f, mEdges[i].mChar ), 0 );
+			}
+			mNodes[child].mFail = fail;
+			mNodes[child].mOut = mNodes[child].mOut || mNodes[fail].mOut;
+			todo.push_back( child );
+		}
+	}
+	mBuilt = true;
+}
+
+//---------------------------------------------------------------------------
+// See if s contains any of the literals
+//---------------------------------------------------------------------------
+
+bool LiteralSearch :: FindIn( const string & s ) const {
+	if ( ! mBuilt ) {
+		Build();
+	}
+	if ( mNodes[0].mOut ) {
+		return true;
+	}
+	int node = 0;
+	for ( unsigned int i = 0; i < s.size(); i++ ) {
+		unsigned char c = s[i];
+		int next;
+		while( (next = Child( node, c )) < 0 && node != 0 ) {
+			node = mNodes[node].mFail;
+		}
+		node = next < 0 ? 0 : next;
+		if ( mNodes[node].mOut ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+//------------------------------------------------------------------------
+
+} // end namespace
+
+//----------------------------------------------------------------------------
+// Tests
+//----------------------------------------------------------------------------
+
+#ifdef ALIB_TEST
+
+#include "a_myth.h"
+#include "a_str.h"
+using namespace ALib;
+using namespace std;
+
+DEFSUITE( "a_lsearch" );
+
+DEFTEST( Overlapping ) {
+	LiteralSearch ls;
+	ls.Add( "he" );
+	ls.Add( "she" );
+	ls.Add( "his" );
+	ls.Add( "hers" );
+	FAILNE( ls.FindIn( "ushers" ), true );
+	FAILNE( ls.FindIn( "ahis" ), true );
+	FAILNE( ls.FindIn( "hxs sh" ), false );
+	FAILNE( ls.FindIn( "" ), false );
+	ls.Add( "" );
+	FAILNE( ls.FindIn( "" ), true );
+}
+
+DEFTEST( ManyLiterals ) {
+	LiteralSearch ls;
+	for ( int i = 0; i < 2000; i++ ) {
+		ls.Add( "id" + Str( i * 7 ) + "x" );
+	}
+	FAILNE( ls.Size(), 2000 );
+	FAILNE( ls.FindIn( "zzid693x" ), true );
+	FAILNE( ls.FindIn( "zzid694x" ), false );
+	FAILNE( ls.FindIn( "id13993id13986x" ), true );
+}
+
+#endif
+
+// end
+
@@ -0,0 +1,299 @@
+//---------------------------------------------------------------------------
+// a_quantile.cpp
+//
+// exact and approximate quantiles for alib
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#include "a_base.h"
+#include "a_quantile.h"
+#include <algorithm>
+#include <cmath>
+
+using std::string;
+using std::vector;
+
+namespace ALib {
+
+//---------------------------------------------------------------------------
+// Quantiles must be expressed as fractions
+//---------------------------------------------------------------------------
+
+static void CheckQuantile( double q ) {
+	if ( q < 0.0 || q > 1.0 ) {
+		ATHROW( "Quantile out of range" );
+	}
+}
+
+//---------------------------------------------------------------------------
+// Helper to order quantile indexes by quantile value
+//---------------------------------------------------------------------------
+
+struct QIndexLess {
+
+	QIndexLess( const vector <double> & qs ) : mQs( qs ) {}
+
+	bool operator()( unsigned int a, unsigned int b ) const {
+		return mQs[a] < mQs[b];
+	}
+
+	const vector <double> & mQs;
+};
+
+//---------------------------------------------------------------------------
+// Quantiles are processed in ascending order so that each selection only
+// needs to partition the part of the vector above the previous one. Where
+// the quantile falls between two ranks, the upper value is the smallest
+// value above the lower rank, which selection has already moved there.
+//---------------------------------------------------------------------------
+
+void Quantiles( vector <double> & v, const vector <double> & qs,
+					vector <double> & results ) {
+
+	if ( v.size() == 0 ) {
+		ATHROW( "No values for quantile" );
+	}
+
+	vector <unsigned int> order;
+	for ( unsigned int i = 0; i < qs.size(); i++ ) {
+		CheckQuantile( qs[i] );
+		order.push_back( i );
+	}
+	std::sort( order.begin(), order.end(), QIndexLess( qs ) );
+
+	results.resize( qs.size() );
+	unsigned int start = 0;
+	for ( unsigned int i = 0; i < order.size(); i++ ) {
+		double h = qs[order[i]] * (v.size() - 1);
+		unsigned int lo = (unsigned int) std::floor( h );
+		double f = h - lo;
+		std::nth_element( v.begin() + start, v.begin() + lo, v.end() );
+		double d = v[lo];
+		if ( f > 0 && lo + 1 < v.size() ) {
+			double hi = * std::min_element( v.begin() + lo + 1, v.end() );
+			d = (1 - f) * d + f * hi;
+		}
+		results[order[i]] = d;
+		start = lo;
+	}
+}
+
+//---------------------------------------------------------------------------
+// Single quantile
+//---------------------------------------------------------------------------
+
+double Quantile( vector <double> & v, double q ) {
+	vector <double> qs( 1, q ), results;
+	Quantiles( v, qs, results );
+	return results[0];
+}
+
+//---------------------------------------------------------------------------
+// Sketch holds a stack of compactors. Items at level h each stand for 2^h
+// of the original values. When the sketch is full, the lowest compactor
+// that is over capacity is sorted and either the odd or the even items are
+// promoted to the next level. The choice is random, but we use our own
+// fixed-seed generator so that results are repeatable.
+//---------------------------------------------------------------------------
+
+const unsigned int MIN_CAPACITY = 8;
+
+QuantileSketch :: QuantileSketch( unsigned int k )
+	: mLevels( 1 ), mK( std::max( k, MIN_CAPACITY ) ), mSize( 0 ),
+		mMaxSize( 0 ), mRandom( 2463534242u ), mExact( true ),
+		mCount( 0 ), mMin( 0 ), mMax( 0 ) {
+	SetCapacities();
+}
+
+//---------------------------------------------------------------------------
+// Capacities shrink geometrically towards the lowest levels, so need to be
+// recalculated whenever a level is added.
+//---------------------------------------------------------------------------
+
+void QuantileSketch :: SetCapacities() {
+	mCapacities.clear();
+	mMaxSize = 0;
+	for ( unsigned int h = 0; h < mLevels.size(); h++ ) {
+		unsigned int depth = mLevels.size() - h - 1;
+		double cap = std::ceil( mK * std::pow( 2.0 / 3.0, (double) depth ) );
+		mCapacities.push_back( std::max( (unsigned int) cap, MIN_CAPACITY ) );
+		mMaxSize += mCapacities.back();
+	}
+}
+
+//---------------------------------------------------------------------------
+// Add single value
+//---------------------------------------------------------------------------
+
+void QuantileSketch :: Add( double d ) {
+	if ( mCount == 0 ) {
+		mMin = mMax = d;
+	}
+	else {
+		mMin = std::min( mMin, d );
+		mMax = std::max( mMax, d );
+	}
+	mLevels[0].push_back( d );
+	mSize++;
+	mCount += 1;
+	if ( mSize >= mMaxSize ) {
+		Compress();
+	}
+}
+
+//---------------------------------------------------------------------------
+// Compact the first level that is over capacity. Uses xorshift to pick
+// between odd and even items.
+//---------------------------------------------------------------------------
+
+void QuantileSketch :: Compress() {
+	for ( unsigned int h = 0; h < mLevels.size(); h++ ) {
+		if ( mLevels[h].size() < mCapacities[h] ) {
+			continue;
+		}
+		if ( h + 1 == mLevels.size() ) {
+			mLevels.push_back( Compactor() );
+			SetCapacities();
+		}
+		Compactor & c = mLevels[h];
+		Compactor & next = mLevels[h + 1];
+		std::sort( c.begin(), c.end() );
+		unsigned int n = c.size() - c.size() % 2;
+		mRandom ^= mRandom << 13;
+		mRandom ^= mRandom >> 17;
+		mRandom ^= mRandom << 5;
+		for ( unsigned int i = mRandom & 1; i < n; i += 2 ) {
+			next.push_back( c[i] );
+		}
+		c.erase( c.begin(), c.begin() + n );
+		mSize -= n / 2;
+		mExact = false;
+		return;
+	}
+}
+
+//---------------------------------------------------------------------------
+// Number of values added
+//---------------------------------------------------------------------------
+
+double QuantileSketch :: Count() const {
+	return mCount;
+}
+
+//---------------------------------------------------------------------------
+// Return value whose weighted rank first reaches the requested fraction
+// of the values seen. The extremes are always known exactly.
+//---------------------------------------------------------------------------
+
+double QuantileSketch :: Quantile( double q ) const {
+	CheckQuantile( q );
+	if ( mCount == 0 ) {
+		ATHROW( "No values for quantile" );
+	}
+	if ( q == 0.0 ) {
+		return mMin;
+	}
+	else if ( q == 1.0 ) {
+		return mMax;
+	}
+
+	vector <std::pair <double,double> > items;
+	for ( unsigned int h = 0; h < mLevels.size(); h++ ) {
+		double w = std::ldexp( 1.0, h );
+		for ( unsigned int i = 0; i < mLevels[h].size(); i++ ) {
+			items.push_back( std::make_pair( mLevels[h][i], w ) );
+		}
+	}
+	std::sort( items.begin(), items.end() );
+
+	double target = q * mCount, cum = 0;
+	for ( unsigned int i = 0; i < items.size(); i++ ) {
+		cum += items[i].second;
+		if ( cum >= target ) {
+			return items[i].first;
+		}
+	}
+	return mMax;
+}
+
+//---------------------------------------------------------------------------
+// Error in the rank of a single quantile, as a fraction of the count. This
+// is the empirical 99% confidence fit published for KLL sketches, which
+// works out at about 1.3% for the default k of 200.
+//---------------------------------------------------------------------------
+
+double QuantileSketch :: RankError() const {
+	return mExact ? 0 : 2.296 / std::pow( (double) mK, 0.9723 );
+}
+
+//------------------------------------------------------------------------
+
+} // end namespace
+
+//----------------------------------------------------------------------------
+// Tests
+//----------------------------------------------------------------------------
+
+#ifdef ALIB_TEST
+
+#include "a_myth.h"
+using namespace ALib;
+using namespace std;
+
+DEFSUITE( "a_quantile" );
+
+DEFTEST( ExactMedian ) {
+	double odd[] = { 5, 1, 4, 2, 3 };
+	vector <double> v( odd, odd + 5 );
+	FAILNE( Quantile( v, 0.5 ), 3.0 );
+	double even[] = { 40, 10, 30, 20 };
+	v.assign( even, even + 4 );
+	FAILNE( Quantile( v, 0.5 ), 25.0 );
+}
+
+DEFTEST( ExactQuantiles ) {
+	vector <double> v;
+	for ( int i = 100; i >= 0; i-- ) {
+		v.push_back( i );
+	}
+	vector <double> qs, r;
+	qs.push_back( 0.99 );
+	qs.push_back( 0.0 );
+	qs.push_back( 0.5 );
+	qs.push_back( 1.0 );
+	Quantiles( v, qs, r );
+	FAILNE( r.size(), 4 );
+	FAILNE( r[0], 99.0 );
+	FAILNE( r[1], 0.0 );
+	FAILNE( r[2], 50.0 );
+	FAILNE( r[3], 100.0 );
+	MUST_THROW( Quantile( v, 1.5 ) );
+}
+
+DEFTEST( SketchSmall ) {
+	QuantileSketch qs;
+	for ( int i = 1; i <= 100; i++ ) {
+		qs.Add( i );
+	}
+	FAILNE( qs.RankError(), 0.0 );
+	FAILNE( qs.Quantile( 0.5 ), 50.0 );
+	FAILNE( qs.Quantile( 1.0 ), 100.0 );
+}
+
+DEFTEST( SketchLarge ) {
+	QuantileSketch qs( 200 );
+	const int N = 100000;
+	for ( int i = 0; i < N; i++ ) {
+		qs.Add( (i * 7919) % N );
+	}
+	FAILNE( qs.Count(), N );
+	double err = qs.RankError();
+	FAILIF( err <= 0.0 || err > 0.02 );
+	double q = qs.Quantile( 0.9 );
+	FAILIF( fabs( q - 0.9 * N ) > err * N + 1 );
+}
+
+#endif
+
+// end
@@ -5,9 +5,8 @@
 //
 // Basic ideas and encoding scheme taken from "Software Tools In Pascal"
 // by Kernighan & Plauger, but have been heavily re-worked to make them
-// (I hope) more C++ friendly.
-//
-// ??? needs re-factoring after adding saved pattern matches ???
+// (I hope) more C++ friendly. Matching no longer backtracks - instead the
+// encoding is run as an automaton, so searches take linear time.
 //
 // Copyright (C) 2006 Neil Butterworth
 //---------------------------------------------------------------------------
@@ -15,6 +14,8 @@
 #include <iostream>
 #include "a_base.h"
 #include <bitset>
+#include <map>
+#include <algorithm>
 #include "a_except.h"
 #include "a_regex.h"
 #include "a_str.h"
@@ -145,6 +146,18 @@ class RegEx::CharBitMap {
 			mBits.flip();
 		}
 
+		// the only char in the map, or -1 if not exactly one
+		int Single() const {
+			if ( mBits.count() != 1 ) {
+				return -1;
+			}
+			unsigned int c = 0;
+			while( ! mBits.test( c ) ) {
+				c++;
+			}
+			return c;
+		}
+
 		string ToString() const {
 			string s;
 			for ( unsigned char i = 0; i < MAXSIZE; i++ ) {
@@ -160,9 +173,10 @@ class RegEx::CharBitMap {
 			return s;
 		}
 
+		enum { MAXSIZE = 128 };
+
 	private:
 
-		enum { MAXSIZE = 128 };
 		std::bitset <MAXSIZE> mBits;
 };
 
@@ -175,6 +189,8 @@ class RegEx::CharBitMap {
 
 class RegEx::Encoding {
 
+	friend class RegExSet;
+
 	public:
 
 		// create encoded regexp from string representation
@@ -209,13 +225,12 @@ class RegEx::Encoding {
 			return mEntries[i].Type() == Entry::Char;
 		}
 
-		bool Match( unsigned char c, unsigned int i ) const;
+		// find leftmost match at or after start in non-empty string
+		Pos Find( const string & s, unsigned int start ) const;
 
 		void ClearAllSaved();
 		unsigned int SavedCount() const;
 		std::string SavedAt( unsigned int i ) const;
-		void ClearSavedPat( unsigned int  ei, unsigned int len  ) const;
-		unsigned int GetSavedPatLen( unsigned int ei ) const;
 
 	private:
 
@@ -225,7 +240,45 @@ class RegEx::Encoding {
 		void MakeLastEntryCaseInsense();
 		void SetLastEntryTag();
 
-		void AddToSavedPat( unsigned char c, unsigned int ei ) const;
+		enum Outcome { NoMatch, Matched, BadChar };
+
+		// transition to automaton state caused by matching an entry
+		struct Move {
+			Move( unsigned int state, unsigned int entry )
+				: mState( state ), mEntry( entry ) {}
+			unsigned int mState, mEntry;
+		};
+
+		// threads of a simulation in priority order, each with its
+		// start position and saved pattern begin/end positions
+		struct Threads {
+			void Clear() {
+				mStates.clear();
+				mStarts.clear();
+				mSaved.clear();
+			}
+			unsigned int Size() const {
+				return mStates.size();
+			}
+			void Add( unsigned int state, unsigned int start,
+						const int * saved, unsigned int nsaved ) {
+				mStates.push_back( state );
+				mStarts.push_back( start );
+				mSaved.insert( mSaved.end(), saved, saved + nsaved );
+			}
+			std::vector <unsigned int> mStates, mStarts;
+			std::vector <int> mSaved;
+		};
+
+		void NewStep() const;
+		Outcome Follow( unsigned int state, int c, unsigned int offset,
+							std::vector <Move> & moves ) const;
+		bool MayMatch( const string & s, unsigned int start ) const;
+		Pos Simulate( const string & s, unsigned int start ) const;
+		void FindLiteral();
+		bool Prefilter( const string & s, unsigned int & start ) const;
+		int DFAState( const std::vector <unsigned int> & states ) const;
+		int DFANext( int ds, unsigned char c ) const;
 
 		class Entry {
 
@@ -258,6 +311,10 @@ class RegEx::Encoding {
 					return mMap.Contains( c );
 				}
 
+				int Single() const {
+					return mType == Char ? mMap.Single() : -1;
+				}
+
 				// used to convert char to closure#ifndef
 				void ChangeType( EType t ) {
 					mType = t;
@@ -297,6 +354,22 @@ class RegEx::Encoding {
 		bool mInSavedPat;
 		mutable std::vector <string> mSaved;
 
+		bool mAnchored;
+		string mLiteral;
+		int mLitBefore;
+		bool mLitFixed, mLitAtEnd;
+		mutable std::vector <unsigned int> mMark;
+		mutable unsigned int mMarkGen;
+		mutable std::vector <Move> mMoves;
+		mutable Threads mThreads[2];
+
+		typedef std::map <std::vector <unsigned int>, int> DFAIndex;
+		mutable DFAIndex mDFAIndex;
+		mutable std::vector <std::vector <unsigned int> > mDFASets;
+		mutable std::vector <int> mDFANext;
+		mutable std::vector <char> mDFAAccept;
+		mutable int mDFAStart;
+
 };
 
 //---------------------------------------------------------------------------
@@ -327,33 +400,6 @@ void RegEx::Encoding :: CheckPrevChar( int i ) const {
 	}
 }
 
-//----------------------------------------------------------------------------
-// Add character c to saved pattern indicated by the tag of the encoding
-// entry indexed by ei. If tag is zero, this encoding is not part of a
-// saved pattern, so discard the character.
-//----------------------------------------------------------------------------
-
-void RegEx::Encoding ::AddToSavedPat( unsigned char c,
-											unsigned int ei ) const {
-	unsigned int i = mEntries.at(ei).Tag();
-	if ( i ) {
-		mSaved.at(i - 1) += c;
-	}
-}
-
-//----------------------------------------------------------------------------
-// Clear the saved patter referenced by the tag of encoding entre ei down to
-// length specified by len.
-//----------------------------------------------------------------------------
-
-void RegEx::Encoding :: ClearSavedPat( unsigned int  ei,
-										unsigned int len ) const {
-	unsigned int i = mEntries.at(ei).Tag();
-	if ( i ) {
-		mSaved.at(i - 1).resize( len );
-	}
-}
-
 //----------------------------------------------------------------------------
 // Reset all saved pattern matches.
 //----------------------------------------------------------------------------
@@ -381,33 +427,372 @@ string RegEx::Encoding :: SavedAt( unsigned int i ) const {
 	return mSaved.at(i);
 }
 
-//----------------------------------------------------------------------------
-// Get length of a saved pattern referenced by encoding entries tag
-//----------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+// Matching is done by simulating an automaton built from the encoding. State
+// 2*i means we are about to match entry i, and state 2*i+1 that we are in
+// the closure at entry i and have matched at least one character with it.
+// State 2*Size() means the whole regex has matched.
+//
+// The rules give the same results as the recursive matcher this replaced,
+// quirks included - at the end of the string, an entry that still has to
+// be matched fails unless it is the '$' marker or a closure that has already
+// matched something, and '?' never gives back a character it has matched.
+// Testing a character outside the bitmap range is reported as an outcome
+// rather than thrown straight away, so that a higher priority thread can
+// still win, just as the recursive matcher would never have got as far as
+// testing that character.
+//---------------------------------------------------------------------------
+
+const int DFA_UNKNOWN = -1;			// transition not yet computed
+const int DFA_SIMULATE = -2;		// need to simulate to decide on match
+const unsigned int DFA_MAX_STATES = 256;
+
+//---------------------------------------------------------------------------
+// Start processing a new string position. States marked with the current
+// generation have been seen at this position.
+//---------------------------------------------------------------------------
 
-unsigned int RegEx::Encoding :: GetSavedPatLen( unsigned int ei ) const {
-	unsigned int i = mEntries.at(ei).Tag();
-	if ( i ) {
-		return mSaved.at( i - 1 ).size();
+void RegEx::Encoding :: NewStep() const {
+	if ( ++mMarkGen == 0 ) {
+		std::fill( mMark.begin(), mMark.end(), 0 );
+		mMarkGen = 1;
 	}
-	else {
-		return 0;
+}
+
+//---------------------------------------------------------------------------
+// Take a thread in state through all the transitions that don't consume the
+// character c (-1 at end of string) at offset. Transitions that do consume c
+// are added to moves in priority order. A state already seen at this offset
+// was reached by a thread with higher priority, so the thread is dropped.
+//---------------------------------------------------------------------------
+
+RegEx::Encoding::Outcome RegEx::Encoding :: Follow( unsigned int state,
+										int c, unsigned int offset,
+										vector <Move> & moves ) const {
+	while( mMark[state] != mMarkGen ) {
+		mMark[state] = mMarkGen;
+		unsigned int ei = state / 2;
+		if ( ei == Size() ) {
+			return Matched;
+		}
+		const Entry & e = mEntries[ei];
+		if ( e.Type() == Entry::End ) {
+			if ( c < 0 ) {
+				return Matched;
+			}
+			return c >= CharBitMap::MAXSIZE ? BadChar : NoMatch;
+		}
+		else if ( c < 0 ) {
+			if ( e.Type() != Entry::Close || ! (state & 1) ) {
+				return NoMatch;
+			}
+		}
+		else if ( e.Type() == Entry::Begin ) {
+			if ( offset != 0 ) {
+				return NoMatch;
+			}
+		}
+		else if ( c >= CharBitMap::MAXSIZE ) {
+			return BadChar;
+		}
+		else if ( e.Match( c ) ) {
+			if ( e.Type() == Entry::Close ) {
+				moves.push_back( Move( state | 1, ei ) );
+			}
+			else {
+				moves.push_back( Move( 2 * (ei + 1), ei ) );
+				return NoMatch;
+			}
+		}
+		else if ( e.Type() == Entry::Char ) {
+			return NoMatch;
+		}
+		state = 2 * (ei + 1);
+	}
+	return NoMatch;
+}
+
+//---------------------------------------------------------------------------
+// Get index of lazily built DFA state for a set of automaton states, or
+// DFA_SIMULATE if there are too many DFA states. Also works out if the
+// state matches at the end of the string.
+//---------------------------------------------------------------------------
+
+int RegEx::Encoding :: DFAState( const vector <unsigned int> & states ) const {
+	DFAIndex::const_iterator it = mDFAIndex.find( states );
+	if ( it != mDFAIndex.end() ) {
+		return it->second;
+	}
+	if ( mDFASets.size() >= DFA_MAX_STATES ) {
+		return DFA_SIMULATE;
+	}
+
+	int ds = mDFASets.size();
+	mDFASets.push_back( states );
+	mDFAIndex.insert( std::make_pair( states, ds ) );
+	mDFANext.resize( mDFANext.size() + 256, DFA_UNKNOWN );
+
+	NewStep();
+	bool accept = false;
+	for ( unsigned int i = 0; i < states.size(); i++ ) {
+		accept = accept || Follow( states[i], -1, 1, mMoves ) == Matched;
+	}
+	mDFAAccept.push_back( accept );
+	return ds;
+}
+
+//---------------------------------------------------------------------------
+// Compute transition from DFA state on character c. Unless the regex is
+// anchored, a new thread starts at every character. If any thread could
+// end here, we need to simulate to find out which one wins.
+//---------------------------------------------------------------------------
+
+int RegEx::Encoding :: DFANext( int ds, unsigned char c ) const {
+	NewStep();
+	mMoves.clear();
+	bool end = false;
+	const vector <unsigned int> & states = mDFASets[ds];
+	for ( unsigned int i = 0; i < states.size() && ! end; i++ ) {
+		end = Follow( states[i], c, 1, mMoves ) != NoMatch;
+	}
+	if ( ! end && ! mAnchored ) {
+		end = Follow( 0, c, 1, mMoves ) != NoMatch;
+	}
+
+	int next = DFA_SIMULATE;
+	if ( ! end ) {
+		vector <unsigned int> nstates;
+		for ( unsigned int i = 0; i < mMoves.size(); i++ ) {
+			nstates.push_back( mMoves[i].mState );
+		}
+		std::sort( nstates.begin(), nstates.end() );
+		nstates.erase( std::unique( nstates.begin(), nstates.end() ),
+						nstates.end() );
+		next = DFAState( nstates );
+	}
+	mDFANext[ds * 256 + c] = next;
+	return next;
+}
+
+//---------------------------------------------------------------------------
+// Run the DFA over the string to see if it can match at all - this is much
+// cheaper than simulation, and is all that is needed for most failures.
+//---------------------------------------------------------------------------
+
+bool RegEx::Encoding :: MayMatch( const string & s,
+									unsigned int start ) const {
+	if ( mAnchored && start > 0 ) {
+		return false;
+	}
+	if ( mDFAStart < 0 ) {
+		mDFAStart = DFAState( vector <unsigned int>( mAnchored ? 1 : 0, 2 ) );
+	}
+
+	int ds = mDFAStart;
+	for ( unsigned int i = start; i < s.size(); i++ ) {
+		unsigned char c = s[i];
+		int next = mDFANext[ds * 256 + c];
+		if ( next == DFA_UNKNOWN ) {
+			next = DFANext( ds, c );
+		}
+		if ( next == DFA_SIMULATE ) {
+			return true;
+		}
+		ds = next;
+		if ( mAnchored && mDFASets[ds].empty() ) {
+			return false;
+		}
+	}
+	return mDFAAccept[ds];
+}
+
+//---------------------------------------------------------------------------
+// Simulate the automaton with a prioritised list of threads, so that we get
+// the leftmost match and the one the recursive matcher would have chosen
+// there. Once a thread ends, lower priority threads are dropped but higher
+// priority ones carry on and may replace it. The winning thread's saved
+// pattern positions give the saved matches.
+//---------------------------------------------------------------------------
+
+RegEx::Pos RegEx::Encoding :: Simulate( const string & s,
+										unsigned int start ) const {
+	const unsigned int nsaved = 2 * mSaved.size();
+	const vector <int> nopos( nsaved, -1 );
+	vector <int> saved( nopos );
+	Outcome outcome = NoMatch;
+	unsigned int mstart = 0, mend = 0;
+
+	Threads * cur = & mThreads[0], * next = & mThreads[1];
+	cur->Clear();
+	for ( unsigned int i = start; ; i++ ) {
+		if ( outcome == NoMatch && i < s.size() && ! (mAnchored && i > 0) ) {
+			cur->Add( 0, i, nopos.data(), nsaved );
+		}
+		if ( cur->Size() == 0 ) {
+			break;
+		}
+
+		int c = i < s.size() ? (unsigned char) s[i] : -1;
+		NewStep();
+		next->Clear();
+		for ( unsigned int t = 0; t < cur->Size(); t++ ) {
+			mMoves.clear();
+			Outcome r = Follow( cur->mStates[t], c, i, mMoves );
+			const int * tsaved = cur->mSaved.data() + t * nsaved;
+			for ( unsigned int m = 0; m < mMoves.size(); m++ ) {
+				next->Add( mMoves[m].mState, cur->mStarts[t], tsaved, nsaved );
+				unsigned int tag = mEntries[mMoves[m].mEntry].Tag();
+				if ( tag ) {
+					int * p = next->mSaved.data() + next->mSaved.size()
+								- nsaved + 2 * (tag - 1);
+					if ( p[0] < 0 ) {
+						p[0] = i;
+					}
+					p[1] = i + 1;
+				}
+			}
+			if ( r != NoMatch ) {
+				outcome = r;
+				mstart = cur->mStarts[t];
+				mend = i;
+				saved.assign( tsaved, tsaved + nsaved );
+				break;
+			}
+		}
+
+		std::swap( cur, next );
+		if ( i >= s.size() ) {
+			break;
+		}
+	}
+
+	if ( outcome == BadChar ) {
+		ATHROW( "Character value " << int( (unsigned char) s[mend] )
+					<< " too big" );
+	}
+	else if ( outcome == NoMatch ) {
+		return Pos();
+	}
+
+	for ( unsigned int i = 0; i < mSaved.size(); i++ ) {
+		if ( saved[2 * i] >= 0 ) {
+			mSaved[i] = s.substr( saved[2 * i], saved[2 * i + 1] - saved[2 * i] );
+		}
+	}
+	return Pos( mstart, mend - mstart, true );
+}
+
+//---------------------------------------------------------------------------
+// Find the longest run of entries that must each match one particular char.
+// Every match must contain this literal, so we can look for it with a fast
+// substring search before running the automaton. We also note how many
+// chars can come before it in a match (-1 if a closure makes that
+// unbounded), whether that number is fixed, and whether the literal must
+// be at the end of the string.
+//---------------------------------------------------------------------------
+
+void RegEx::Encoding :: FindLiteral() {
+	string run;
+	int before = 0;
+	bool fixed = true;
+	for ( unsigned int i = 0; i <= Size(); i++ ) {
+		int c = i < Size() ? mEntries[i].Single() : -1;
+		if ( c >= 0 ) {
+			run += char( c );
+			continue;
+		}
+		if ( run.size() > mLiteral.size() ) {
+			mLiteral = run;
+			mLitBefore = before;
+			mLitFixed = fixed;
+			mLitAtEnd = i + 1 == Size() && IsEnd( i );
+		}
+		if ( before >= 0 ) {
+			before += run.size();
+		}
+		run = "";
+		if ( i < Size() ) {
+			if ( IsClosure( i ) ) {
+				before = -1;
+				fixed = false;
+			}
+			else if ( IsZeroOne( i ) ) {
+				fixed = false;
+				before += before >= 0 ? 1 : 0;
+			}
+			else if ( IsChar( i ) && before >= 0 ) {
+				before++;
+			}
+		}
 	}
 }
+
 //----------------------------------------------------------------------------
-// see if regexp character indexed by 'i' can match target char 'c'. If it
-// does, add the matched character to the relevant saved pattern (if any).
+// See if string has any chars the automaton would refuse to test
 //----------------------------------------------------------------------------
 
-bool RegEx::Encoding :: Match( unsigned char c, unsigned int i ) const {
-	if ( i >= Size() ) {
-		ATHROW( "Invalid Encoding index: " << i );
+static bool IsAscii( const string & s, unsigned int start ) {
+	unsigned char bits = 0;
+	for ( unsigned int i = start; i < s.size(); i++ ) {
+		bits |= (unsigned char) s[i];
+	}
+	return bits < RegEx::CharBitMap::MAXSIZE;
+}
+
+//---------------------------------------------------------------------------
+// Check for the required literal. If it isn't there we can't match, and if
+// it is we can skip starting positions too far in front of it. But if the
+// string has chars outside the bitmap range, we leave everything to the
+// automaton, which must report them just as the recursive matcher did.
+//---------------------------------------------------------------------------
+
+bool RegEx::Encoding :: Prefilter( const string & s,
+									unsigned int & start ) const {
+	const unsigned int len = mLiteral.size();
+	if ( len == 0 ) {
+		return true;
+	}
+
+	string::size_type pos;
+	if ( mLitAtEnd ) {
+		pos = s.size() >= start + len ? s.size() - len : string::npos;
+		if ( pos != string::npos && s.compare( pos, len, mLiteral ) != 0 ) {
+			pos = string::npos;
+		}
+	}
+	else if ( mAnchored && mLitFixed ) {
+		pos = mLitBefore;
+		if ( s.size() < pos + len || s.compare( pos, len, mLiteral ) != 0 ) {
+			pos = string::npos;
+		}
+	}
+	else if ( len == 1 ) {
+		pos = s.find( mLiteral[0], start );
+	}
+	else {
+		pos = s.find( mLiteral, start );
+	}
+
+	if ( pos == string::npos ) {
+		return ! IsAscii( s, start );
 	}
-	bool matched =  mEntries[i].Match( c );
-	if ( matched ) {
-		AddToSavedPat( c, i );
+	if ( mLitBefore >= 0 && ! mAnchored
+			&& pos > start + mLitBefore && IsAscii( s, start ) ) {
+		start = pos - mLitBefore;
 	}
-	return matched;
+	return true;
+}
+
+//---------------------------------------------------------------------------
+// Find leftmost match, only simulating if the DFA says we might match
+//---------------------------------------------------------------------------
+
+RegEx::Pos RegEx::Encoding :: Find( const string & s,
+									unsigned int start ) const {
+	if ( ! Prefilter( s, start ) ) {
+		return Pos();
+	}
+	return MayMatch( s, start ) ? Simulate( s, start ) : Pos();
 }
 
 //---------------------------------------------------------------------------
@@ -506,7 +891,9 @@ void RegEx::Encoding :: EncodeCharClass( CharSource & src ) {
 //---------------------------------------------------------------------------
 
 RegEx::Encoding :: Encoding( const string & expr, bool csense )
-					: mNextTag( 1 ), mInSavedPat( false ) {
+					: mNextTag( 1 ), mInSavedPat( false ), mAnchored( false ),
+						mLitBefore( -1 ), mLitFixed( false ), mLitAtEnd( false ),
+						mMarkGen( 0 ), mDFAStart( -1 ) {
 
 	CharSource src( expr );
 	CharSource::Char c;
@@ -559,6 +946,10 @@ RegEx::Encoding :: Encoding( const string & expr, bool csense )
 		SetLastEntryTag();
 
 	}
+
+	mAnchored = Size() && IsBegin( 0 );
+	FindLiteral();
+	mMark.resize( 2 * Size() + 2, 0 );
 }
 
 //---------------------------------------------------------------------------
@@ -622,17 +1013,6 @@ unsigned int RegEx :: SavedMatchCount() const {
 	return mEnc->SavedCount();
 }
 
-//---------------------------------------------------------------------------
-// Check if the character s[sindex] matches an encoded regexp character
-//---------------------------------------------------------------------------
-
-bool RegEx :: MatchChar( const std::string & s,
-							 unsigned int sindex,
-							 unsigned int eindex ) const {
-
-	return mEnc->Match( s[sindex], eindex );
-}
-
 //---------------------------------------------------------------------------
 // Main user-callable function. See if a regexp can be found in a string
 // starting at Pos start. Returns a Pos object containing
@@ -651,17 +1031,7 @@ RegEx::Pos RegEx :: FindIn( const string & s, unsigned int start ) const {
 	}
 
 	mEnc->ClearAllSaved();
-	Pos pos;
-
-
-	for ( unsigned int i = start; i < ssize; i++ ) {
-		pos = MatchAt( s, i, 0 );
-		if ( pos.Found() ) {
-			return pos;
-		}
-	}
-
-	return pos;
+	return mEnc->Find( s, start );
 }
 
 //----------------------------------------------------------------------------
@@ -758,124 +1128,198 @@ unsigned int RegEx :: ReplaceAllIn( string & s, const string & v ) {
 }
 
 //---------------------------------------------------------------------------
-// Match a maximum of 'maxlen' characters of the string 's' starting st
-// index 'si' against the encoded closure indexed by 'eindex'.
-// Returns actual number of characters that were matched.
+// Ditches any encoding
+//---------------------------------------------------------------------------
+
+void RegEx :: Clear() {
+	delete mEnc;
+	mEnc = 0;
+}
+
+//---------------------------------------------------------------------------
+// Return string rep of encoding for debug etc.
 //---------------------------------------------------------------------------
 
-unsigned int RegEx :: MatchClosure( const std::string & s,
-										unsigned int si,
-										unsigned int eindex,
-										unsigned int maxlen ) const {
-	unsigned int n = 0, sz = s.size();
-	while( n < maxlen && si + n < sz && MatchChar( s, si + n, eindex ) ) {
-		n++;
+string RegEx :: GetEncoding() const {
+	if ( mEnc == 0 ) {
+		return "Empty regex";
+	}
+	else {
+		return mEnc->ToString();
 	}
-	return n;
 }
 
 //---------------------------------------------------------------------------
-// Recursive routine that does all the real work. The basic idea is that
-// if we have a closure (encoding indexed by 'eindex'), we try to match
-// against the longest possible substring and then try to match the rest
-// of the string (recursively) aginst the rest of the regex. Non-closure
-// regex characters are handled iteratively.
-//
-// If matching fails, we reduce the length of the closure match by one
-// amd try again. If the length of the closure match falls to zero & we still
-// can't match the remainder, we have failed.
-//
-// we now also have to deal with saved patterns, shortening the saved match
-// if a closure match fails and and the closure length is reduced.
+// A regex set keeps a copy of everything added, in order. Literals are also
+// added to an Aho-Corasick search, and regexes get a range of state numbers
+// in a DFA that runs all their automatons at once.
 //---------------------------------------------------------------------------
 
-RegEx::Pos RegEx :: MatchAt( const string & s,
-								unsigned int start,
-								unsigned int eindex )	const {
+const int SET_MATCHED = -2;				// some regex in set has matched
+const unsigned int SET_MAX_STATES = 4096;
+
+RegExSet :: RegExSet() : mBase( 1, 0 ), mDFAStart( -1 ) {
+}
 
-	const Pos NOTFOUND;					// "search failed" return value
-	const unsigned int SZ = s.size();	// search string size
+void RegExSet :: Add( const RegEx & re ) {
+	mRegExes.push_back( mAll.size() );
+	mAll.push_back( re );
+	mBase.push_back( mBase.back() + 2 * re.mEnc->Size() + 2 );
+	ClearDFA();
+}
 
-	unsigned int matchlen = UINT_MAX;	// big closure length to start with
-	unsigned int sindex = 0;			// place we are at in searched string
+void RegExSet :: AddLiteral( const string & lit ) {
+	mAll.push_back( RegEx( RegEx::Escape( lit ) ) );
+	mLiterals.Add( lit );
+}
 
-	while( start + sindex < SZ && eindex < mEnc->Size() ) {
+unsigned int RegExSet :: Size() const {
+	return mAll.size();
+}
 
-		unsigned int spatlen = mEnc->GetSavedPatLen( eindex );
+void RegExSet :: Clear() {
+	mAll.clear();
+	mRegExes.clear();
+	mBase.assign( 1, 0 );
+	mLiterals.Clear();
+	ClearDFA();
+}
 
-		if ( mEnc->IsClosure( eindex ) ) {			// zero/many closure
-			matchlen = MatchClosure( s, start + sindex, eindex, matchlen );
-			// recursively try to match everything following closure
-			Pos pos = MatchAt( s, start + sindex + matchlen, eindex + 1 );
-			if ( pos.Found() ) {
-				return Pos( start, sindex + matchlen + pos.Length(), true );
-			}
-			else if ( matchlen > 0 ) {
-				mEnc->ClearSavedPat( eindex, spatlen );
-				matchlen--;			// failed - reduce length of closure match
-				continue;			// and try again
-			}
-			else {
-				return NOTFOUND;	// failed - unwind recursion
-			}
+void RegExSet :: ClearDFA() const {
+	mDFAIndex.clear();
+	mDFASets.clear();
+	mDFANext.clear();
+	mDFAAccept.clear();
+	mDFAStart = -1;
+}
+
+//---------------------------------------------------------------------------
+// Get index of DFA state for a sorted set of states, throwing away all the
+// DFA states we have if there are too many of them.
+//---------------------------------------------------------------------------
+
+int RegExSet :: DFAState( const vector <unsigned int> & states ) const {
+	DFAIndex::const_iterator it = mDFAIndex.find( states );
+	if ( it != mDFAIndex.end() ) {
+		return it->second;
+	}
+	if ( mDFASets.size() >= SET_MAX_STATES ) {
+		ClearDFA();
+	}
+
+	int ds = mDFASets.size();
+	mDFASets.push_back( states );
+	mDFAIndex.insert( std::make_pair( states, ds ) );
+	mDFANext.resize( mDFANext.size() + 256, DFA_UNKNOWN );
+
+	vector <RegEx::Encoding::Move> moves;
+	bool accept = false;
+	unsigned int j = 0;
+	for ( unsigned int k = 0; k < mRegExes.size() && ! accept; k++ ) {
+		const RegEx::Encoding * enc = mAll[mRegExes[k]].mEnc;
+		enc->NewStep();
+		for ( ; j < states.size() && states[j] < mBase[k + 1]; j++ ) {
+			accept = accept || enc->Follow( states[j] - mBase[k], -1, 1,
+												moves ) == RegEx::Encoding::Matched;
 		}
-		else if ( mEnc->IsBegin( eindex ) ) {	// begin string
-			if ( start + sindex == 0 ) {
-				eindex++;
-			}
-			else {
-				return NOTFOUND;
-			}
+	}
+	mDFAAccept.push_back( accept );
+	return ds;
+}
+
+//---------------------------------------------------------------------------
+// Compute transition from DFA state on c. This is as for a single regex,
+// but goes through the states of each regex in turn.
+//---------------------------------------------------------------------------
+
+int RegExSet :: DFANext( int ds, unsigned char c ) const {
+	vector <RegEx::Encoding::Move> moves;
+	vector <unsigned int> nstates;
+	const vector <unsigned int> & states = mDFASets[ds];
+	unsigned int j = 0;
+	for ( unsigned int k = 0; k < mRegExes.size(); k++ ) {
+		const RegEx::Encoding * enc = mAll[mRegExes[k]].mEnc;
+		enc->NewStep();
+		moves.clear();
+		bool end = false;
+		for ( ; j < states.size() && states[j] < mBase[k + 1]; j++ ) {
+			end = end || enc->Follow( states[j] - mBase[k], c, 1, moves )
+								!= RegEx::Encoding::NoMatch;
 		}
-		else if ( mEnc->IsZeroOne( eindex ) ) {	// zero/one closure
-			if ( MatchChar( s, start + sindex, eindex ) ) {
-				sindex++;
-			}
-			eindex++;
+		if ( ! enc->mAnchored ) {
+			end = end || enc->Follow( 0, c, 1, moves )
+								!= RegEx::Encoding::NoMatch;
 		}
-		else if ( MatchChar( s, start + sindex, eindex ) ) {	// single char
-			sindex++;
-			eindex++;
+		if ( end ) {
+			mDFANext[ds * 256 + c] = SET_MATCHED;
+			return SET_MATCHED;
 		}
-		else {
-			return NOTFOUND;
+		for ( unsigned int m = 0; m < moves.size(); m++ ) {
+			nstates.push_back( mBase[k] + moves[m].mState );
 		}
 	}
 
-	// if we have walked over all encoded regexp characters except
-	// for the end($) marker (if there is one) then success!
-	if ((start + sindex == SZ
-			&& eindex < mEnc->Size()
-			&& mEnc->IsEnd( eindex )
-		)
-		|| eindex == mEnc->Size() ) {
-		return Pos( start, sindex, true );
-	}
-	else {
-		return NOTFOUND;
+	std::sort( nstates.begin(), nstates.end() );
+	nstates.erase( std::unique( nstates.begin(), nstates.end() ),
+					nstates.end() );
+	unsigned int size = mDFASets.size();
+	int next = DFAState( nstates );
+	if ( mDFASets.size() >= size ) {
+		mDFANext[ds * 256 + c] = next;
 	}
+	return next;
 }
 
 //---------------------------------------------------------------------------
-// Ditches any encoding
+// Run the combined DFA to see if any of the regexes match
 //---------------------------------------------------------------------------
 
-void RegEx :: Clear() {
-	delete mEnc;
-	mEnc = 0;
+bool RegExSet :: MatchRegExes( const string & s ) const {
+	if ( mDFAStart < 0 ) {
+		vector <unsigned int> states;
+		for ( unsigned int k = 0; k < mRegExes.size(); k++ ) {
+			if ( mAll[mRegExes[k]].mEnc->mAnchored ) {
+				states.push_back( mBase[k] + 2 );
+			}
+		}
+		mDFAStart = DFAState( states );
+	}
+
+	int ds = mDFAStart;
+	for ( unsigned int i = 0; i < s.size(); i++ ) {
+		unsigned char c = s[i];
+		int next = mDFANext[ds * 256 + c];
+		if ( next == DFA_UNKNOWN ) {
+			next = DFANext( ds, c );
+		}
+		if ( next == SET_MATCHED ) {
+			return true;
+		}
+		ds = next;
+	}
+	return mDFAAccept[ds];
 }
 
 //---------------------------------------------------------------------------
-// Return string rep of encoding for debug etc.
+// See if anything in the set can be found in s. Strings the automatons
+// can't deal with are tried against each regex in turn, so they fail in
+// the same way as they would for RegEx::FindIn. A single regex is left to
+// itself, as it can make use of its literal prefilter.
 //---------------------------------------------------------------------------
 
-string RegEx :: GetEncoding() const {
-	if ( mEnc == 0 ) {
-		return "Empty regex";
+bool RegExSet :: FindIn( const string & s ) const {
+	if ( mAll.size() == 1 || s.empty() || ! IsAscii( s, 0 ) ) {
+		for ( unsigned int i = 0; i < mAll.size(); i++ ) {
+			if ( mAll[i].FindIn( s ).Found() ) {
+				return true;
+			}
+		}
+		return false;
 	}
-	else {
-		return mEnc->ToString();
+	if ( mLiterals.Size() && mLiterals.FindIn( s ) ) {
+		return true;
 	}
+	return mRegExes.size() && MatchRegExes( s );
 }
 
 //------------------------------------------------------------------------
@@ -1039,6 +1483,86 @@ DEFTEST( EmptyStr ) {
 	FAILNE( p.Found(), false );
 }
 
+// matching is linear, so this used to take forever
+
+DEFTEST( NoBacktrack ) {
+	string s( 5000, 'a' );
+	RegEx re( "a*a*a*a*a*a*a*a*a*a*b" );
+	RegEx::Pos p = re.FindIn( s );
+	FAILNE( p.Found(), false );
+	s += 'b';
+	p = re.FindIn( s );
+	FAILNE( p.Found(), true );
+	FAILNE( p.Start(), 0 );
+	FAILNE( p.Length(), 5001 );
+}
+
+// results must be the same as the old recursive matcher, odd or not
+
+DEFTEST( SameAsRecursive ) {
+	RegEx re1( "ab*c*" );
+	RegEx::Pos p = re1.FindIn( "ab" );
+	FAILNE( p.Found(), true );
+	FAILNE( p.Length(), 1 );
+	p = re1.FindIn( "abbx" );
+	FAILNE( p.Length(), 3 );
+
+	RegEx re2( "a?ab" );
+	FAILNE( re2.FindIn( "ab" ).Found(), false );
+
+	RegEx re3( "$" );
+	FAILNE( re3.FindIn( "abc" ).Found(), false );
+
+	RegEx re4( "a" );
+	FAILNE( re4.FindIn( "a\xc3" ).Found(), true );
+	MUST_THROW( re4.FindIn( "\xc3" "a" ) );
+}
+
+// required literals are searched for before running the automaton
+
+DEFTEST( Literal ) {
+	RegEx re1( "ERR[A-Z]*.*timeout" );
+	FAILNE( re1.FindIn( "an ERROR: timeout" ).Start(), 3 );
+	FAILNE( re1.FindIn( "an ERROR: time out" ).Found(), false );
+	MUST_THROW( re1.FindIn( "\xc3 ERROR" ) );
+
+	RegEx re2( "^AC?ME-" );
+	FAILNE( re2.FindIn( "AME-1" ).Found(), true );
+	FAILNE( re2.FindIn( "ACME-1" ).Length(), 5 );
+	FAILNE( re2.FindIn( "x ACME-1" ).Found(), false );
+
+	RegEx re3( "[0-9]xyz$" );
+	FAILNE( re3.FindIn( "1xyz 2xyz" ).Start(), 5 );
+	FAILNE( re3.FindIn( "1xyz 2xy" ).Found(), false );
+}
+
+// sets of regexes and literals are searched for in one pass
+
+DEFTEST( RegExSetTest ) {
+	RegExSet rs;
+	rs.AddLiteral( "a.b" );
+	rs.Add( RegEx( "^x[0-9]+$" ) );
+	rs.Add( RegEx( "zz", RegEx::Insensitive ) );
+	FAILNE( rs.Size(), 3 );
+	FAILNE( rs.FindIn( "--a.b--" ), true );
+	FAILNE( rs.FindIn( "--axb--" ), false );
+	FAILNE( rs.FindIn( "x123" ), true );
+	FAILNE( rs.FindIn( "x123y" ), false );
+	FAILNE( rs.FindIn( "aZz" ), true );
+	FAILNE( rs.FindIn( "" ), false );
+	MUST_THROW( rs.FindIn( "\xc3" ) );
+}
+
+// saved matches only contain characters from the match itself
+
+DEFTEST( SavedInMatch ) {
+	RegEx re( "\\(..b\\)" );
+	RegEx::Pos p = re.FindIn( "baaaba" );
+	FAILNE( p.Found(), true );
+	FAILNE( p.Start(), 2 );
+	FAILNE( re.SavedMatch(0), "aab" );
+}
+
 #endif
 
 //----------------------------------------------------------------------------
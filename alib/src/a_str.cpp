@@ -7,6 +7,7 @@
 //---------------------------------------------------------------------------
 
 #include <math.h>
+#include <cmath>
 #include <stdarg.h>
 #include <iomanip>
 #include <cstring>
@@ -486,14 +487,169 @@ string Squeeze( const string & s, const string & out ) {
 	return t;
 }
 
-//------------------------------------------------------------------------/
-// Is string a valid numeric value? Anythiong too big (or small) is
-// considered no to be valid.
+//------------------------------------------------------------------------
+// Fast real number parsing. Plain decimal numbers with no more than 19
+// digits and a small exponent (which covers almost all CSV data) are
+// converted directly - the digits are accumulated exactly in a 64-bit
+// integer and then scaled by an exactly representable power of ten, which
+// is a single correctly rounded operation (Clinger's fast path). Anything
+// else is handed to strtod, so results are always correctly rounded and
+// the set of strings accepted is unchanged.
 //------------------------------------------------------------------------
 
-bool IsNumber( const std::string & s ) {
+typedef unsigned long long DigitBuf;
+
+const int MAX_FAST_DIGITS = 19;				// always fit in 64 bits
+const int MAX_FAST_EXP = 22;				// 10^22 is exact in a double
+const DigitBuf MAX_FAST_MANTISSA = 1ULL << 53;
+
+static const double POW10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool IsDigit( char c ) {
+	return c >= '0' && c <= '9';
+}
+
+//------------------------------------------------------------------------
+// On little-endian machines we can test and convert eight digits at a
+// time by treating them as a single 64-bit word.
+//------------------------------------------------------------------------
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define ALIB_SWAR_DIGITS
+
+static inline bool IsEightDigits( DigitBuf v ) {
+	return (((v + 0x4646464646464646ULL) | (v - 0x3030303030303030ULL))
+				& 0x8080808080808080ULL) == 0;
+}
+
+static inline unsigned int EightDigits( DigitBuf v ) {
+	v -= 0x3030303030303030ULL;
+	v = (v * 10) + (v >> 8);
+	v = (((v & 0x000000FF000000FFULL) * 0x000F424000000064ULL)
+		+ (((v >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL))
+		>> 32;
+	return (unsigned int) v;
+}
+
+#endif
+
+//------------------------------------------------------------------------
+// Accumulate run of digits into mantissa, returning pointer past them.
+// Digits beyond the first MAX_FAST_DIGITS are counted but not stored -
+// the caller will not use the fast path in that case.
+//------------------------------------------------------------------------
+
+static const char * ReadDigits( const char * p, const char * end,
+									DigitBuf & mant, int & ndigits ) {
+#ifdef ALIB_SWAR_DIGITS
+	while( end - p >= 8 && ndigits + 8 <= MAX_FAST_DIGITS ) {
+		DigitBuf v;
+		std::memcpy( & v, p, 8 );
+		if ( ! IsEightDigits( v ) ) {
+			break;
+		}
+		mant = mant * 100000000 + EightDigits( v );
+		ndigits += 8;
+		p += 8;
+	}
+#endif
+	while( p != end && IsDigit( * p ) ) {
+		if ( ndigits < MAX_FAST_DIGITS ) {
+			mant = mant * 10 + (* p - '0');
+		}
+		ndigits++;
+		p++;
+	}
+	return p;
+}
+
+//------------------------------------------------------------------------
+// Try to convert using fast path, returning false if we can't.
+//------------------------------------------------------------------------
+
+static bool FastParseReal( const string & s, double & d ) {
+
+	const char * p = s.data(), * end = p + s.size();
+	bool neg = false;
+	if ( p != end && (* p == '-' || * p == '+') ) {
+		neg = * p++ == '-';
+	}
+
+	DigitBuf mant = 0;
+	int ndigits = 0;
+	p = ReadDigits( p, end, mant, ndigits );
+	int exp10 = 0;
+	if ( p != end && * p == '.' ) {
+		const char * frac = ++p;
+		p = ReadDigits( p, end, mant, ndigits );
+		exp10 = - int( p - frac );
+	}
+	if ( ndigits == 0 || ndigits > MAX_FAST_DIGITS ) {
+		return false;
+	}
+
+	if ( p != end && (* p == 'e' || * p == 'E') ) {
+		p++;
+		bool eneg = false;
+		if ( p != end && (* p == '-' || * p == '+') ) {
+			eneg = * p++ == '-';
+		}
+		int e = 0, edigits = 0;
+		while( p != end && IsDigit( * p ) && edigits < 4 ) {
+			e = e * 10 + (* p++ - '0');
+			edigits++;
+		}
+		if ( edigits == 0 ) {
+			return false;
+		}
+		exp10 += eneg ? -e : e;
+	}
+
+	if ( p != end || mant > MAX_FAST_MANTISSA
+				|| exp10 < - MAX_FAST_EXP || exp10 > MAX_FAST_EXP ) {
+		return false;
+	}
+
+	d = double( mant );
+	if ( exp10 < 0 ) {
+		d /= POW10[ - exp10 ];
+	}
+	else {
+		d *= POW10[ exp10 ];
+	}
+	if ( neg ) {
+		d = -d;
+	}
+	return true;
+}
+
+//------------------------------------------------------------------------
+// Parse string as a real number, returning success and setting 'd'. This
+// is the routine everything else should use when it needs both to check
+// and to convert a value. Strings that strtod rejects without looking past
+// the first character are rejected without calling it.
+//------------------------------------------------------------------------
+
+bool ParseReal( const string & s, double & d ) {
+
+	if ( FastParseReal( s, d ) ) {
+		return true;
+	}
+
+	STRSIZE first = s.size() && (s[0] == '-' || s[0] == '+') ? 1 : 0;
+	if ( first < s.size() ) {
+		char c = s[first];
+		if ( isalpha( (unsigned char) c ) && c != 'i' && c != 'I'
+					&& c != 'n' && c != 'N' ) {
+			return false;
+		}
+	}
+
 	char * p;
-	double d = strtod( s.c_str(), & p );
+	d = strtod( s.c_str(), & p );
 	if ( fabs( d ) == HUGE_VAL ) {			// too big?
 		return false;
 	}
@@ -502,6 +658,16 @@ bool IsNumber( const std::string & s ) {
 	}
 }
 
+//------------------------------------------------------------------------
+// Is string a valid numeric value? Anythiong too big (or small) is
+// considered no to be valid.
+//------------------------------------------------------------------------
+
+bool IsNumber( const std::string & s ) {
+	double d;
+	return ParseReal( s, d );
+}
+
 //------------------------------------------------------------------------
 // Is string a valid integer (but not a real) value?
 //------------------------------------------------------------------------
@@ -547,9 +713,8 @@ long ToInteger( const string & s, const string & emsg ) {
 //------------------------------------------------------------------------
 
 double ToReal( const string & s, const string & emsg ) {
-	char * p;
-	double rv = strtod( s.c_str(), & p );
-	if ( * p != 0 || fabs( rv ) == HUGE_VAL ) {
+	double rv;
+	if ( ! ParseReal( s, rv ) ) {
 		string m = emsg.size() == 0
 					? "Invalid real value " + SQuote( s )
 					: Replace( emsg, "%s", s );
@@ -558,6 +723,273 @@ double ToReal( const string & s, const string & emsg ) {
 	return rv;
 }
 
+//------------------------------------------------------------------------
+// Fast number formatting. Digits are produced from 64-bit integers, with
+// reals first scaled by an exact power of ten. Where the scaled value is
+// too close to a rounding boundary to be sure of the result, or too big
+// for an integer, we use snprintf, which knows the exact binary value.
+//------------------------------------------------------------------------
+
+const double MAX_EXACT_INT = 9007199254740992.0;		// 2^53
+const double SCALE_ERROR = 4e-16;						// > 1/2 ulp
+
+//------------------------------------------------------------------------
+// Write digits of unsigned value to buffer, returning number written
+//------------------------------------------------------------------------
+
+static unsigned int WriteUInt( DigitBuf n, char * buf ) {
+	char tmp[24];
+	unsigned int len = 0;
+	do {
+		tmp[len++] = '0' + n % 10;
+		n /= 10;
+	} while( n );
+	for ( unsigned int i = 0; i < len; i++ ) {
+		buf[i] = tmp[len - i - 1];
+	}
+	return len;
+}
+
+//------------------------------------------------------------------------
+// Write r / 10^places in fixed point, optionally dropping trailing zeros
+// (and the point, if nothing follows it) as printf's %g does. Output
+// buffer must have room for 48 characters.
+//------------------------------------------------------------------------
+
+static unsigned int WriteFixed( bool neg, DigitBuf r, int places,
+									bool trim, char * out ) {
+	char digits[24];
+	int nd = WriteUInt( r, digits );
+	int intdigits = nd - places;
+	char * p = out;
+	if ( neg ) {
+		* p++ = '-';
+	}
+	if ( intdigits <= 0 ) {
+		* p++ = '0';
+	}
+	else {
+		std::memcpy( p, digits, intdigits );
+		p += intdigits;
+	}
+	if ( places > 0 ) {
+		char * point = p;
+		* p++ = '.';
+		for ( int i = intdigits; i < nd; i++ ) {
+			* p++ = i < 0 ? '0' : digits[i];
+		}
+		if ( trim ) {
+			while( p[-1] == '0' ) {
+				p--;
+			}
+			if ( p - 1 == point ) {
+				p--;
+			}
+		}
+	}
+	return p - out;
+}
+
+//------------------------------------------------------------------------
+// Copy formatted output to caller's buffer with snprintf semantics
+//------------------------------------------------------------------------
+
+static unsigned int CopyOut( const char * tmp, unsigned int len,
+								char * buf, unsigned int size ) {
+	if ( size > 0 ) {
+		unsigned int n = len < size ? len : size - 1;
+		std::memcpy( buf, tmp, n );
+		buf[n] = 0;
+	}
+	return len;
+}
+
+//------------------------------------------------------------------------
+// Scale value and round to nearest integer, failing if too big or if the
+// result can't be trusted because the scaled value is close to a tie.
+//------------------------------------------------------------------------
+
+static bool ScaleAndRound( double a, int places, DigitBuf & r ) {
+	if ( places > MAX_FAST_EXP ) {
+		return false;
+	}
+	double scaled = a * POW10[ places ];
+	if ( ! (scaled < MAX_EXACT_INT) ) {
+		return false;
+	}
+	double whole = std::floor( scaled );
+	double frac = scaled - whole;
+	if ( std::fabs( frac - 0.5 ) <= scaled * SCALE_ERROR ) {
+		return false;
+	}
+	r = DigitBuf( whole ) + (frac > 0.5 ? 1 : 0);
+	return true;
+}
+
+//------------------------------------------------------------------------
+// Shortest round trip form. We want the fewest decimal places such that
+// the rounded digits read back as the value - as the digits are an exact
+// integer and the power of ten is exact, reading back is a single
+// correctly rounded division, which is what we test.
+//------------------------------------------------------------------------
+
+static bool FastShortest( double d, char * out, unsigned int & len ) {
+	double a = std::fabs( d );
+	for ( int places = 0; places <= MAX_FAST_EXP; places++ ) {
+		DigitBuf r;
+		if ( ! ScaleAndRound( a, places, r ) ) {
+			return false;
+		}
+		if ( double( r ) / POW10[ places ] == a ) {
+			len = WriteFixed( std::signbit( d ), r, places, false, out );
+			return true;
+		}
+	}
+	return false;
+}
+
+//------------------------------------------------------------------------
+// Format as for printf's %g with given number of significant digits. We
+// only handle the cases where %g would use fixed point notation.
+//------------------------------------------------------------------------
+
+static bool FastGeneral( double d, int sig, char * out, unsigned int & len ) {
+	double a = std::fabs( d );
+	if ( ! (a >= 1e-4 && a < 1e15) || sig > 15 ) {
+		return false;
+	}
+
+	// decimal exponent - misjudging it when a is within rounding error
+	// of a power of ten gives the same digits, as the power is the result
+	int x = 0;
+	if ( a >= 1.0 ) {
+		while( a >= POW10[ x + 1 ] ) {
+			x++;
+		}
+	}
+	else {
+		x = -1;
+		while( a * POW10[ - x ] < 1.0 ) {
+			x--;
+		}
+	}
+	if ( x < -4 || x >= sig ) {
+		return false;
+	}
+
+	int places = sig - 1 - x;
+	DigitBuf r;
+	if ( ! ScaleAndRound( a, places, r ) ) {
+		return false;
+	}
+	if ( double( r ) >= POW10[ sig ] ) {		// rounded up to next power
+		if ( ++x >= sig ) {
+			return false;
+		}
+		r /= 10;
+		places--;
+	}
+	len = WriteFixed( d < 0, r, places, true, out );
+	return true;
+}
+
+//------------------------------------------------------------------------
+// Format real, either in shortest or fixed point form
+//------------------------------------------------------------------------
+
+unsigned int FormatReal( double d, char * buf, unsigned int size,
+							int places ) {
+	char tmp[48];
+	unsigned int len;
+	if ( places < 0 ) {
+		if ( FastShortest( d, tmp, len ) ) {
+			return CopyOut( tmp, len, buf, size );
+		}
+		for ( int prec = 15; prec < 17; prec++ ) {
+			len = std::snprintf( tmp, sizeof(tmp), "%.*g", prec, d );
+			double rd;
+			if ( ParseReal( tmp, rd ) && rd == d ) {
+				return CopyOut( tmp, len, buf, size );
+			}
+		}
+		return std::snprintf( buf, size, "%.17g", d );
+	}
+	else {
+		DigitBuf r;
+		if ( ScaleAndRound( std::fabs( d ), places, r ) ) {
+			len = WriteFixed( std::signbit( d ), r, places, false, tmp );
+			return CopyOut( tmp, len, buf, size );
+		}
+		return std::snprintf( buf, size, "%.*f", places, d );
+	}
+}
+
+//------------------------------------------------------------------------
+// String versions of the above. Fixed point values may be too long for
+// a stack buffer, in which case we try again on the heap.
+//------------------------------------------------------------------------
+
+string RealStr( double d, int places ) {
+	char buf[ REAL_BUFSIZE ];
+	unsigned int len = FormatReal( d, buf, sizeof(buf), places );
+	if ( len < sizeof(buf) ) {
+		return string( buf, len );
+	}
+	vector <char> big( len + 1 );
+	FormatReal( d, & big[0], big.size(), places );
+	return string( & big[0], len );
+}
+
+string Str( double d ) {
+	char buf[ REAL_BUFSIZE ];
+	unsigned int len;
+	if ( FastGeneral( d, 6, buf, len ) ) {
+		return string( buf, len );
+	}
+	else if ( d == 0 ) {
+		return std::signbit( d ) ? "-0" : "0";
+	}
+	len = std::snprintf( buf, sizeof(buf), "%g", d );
+	return string( buf, len );
+}
+
+//------------------------------------------------------------------------
+// Integer versions all use the same digit writer
+//------------------------------------------------------------------------
+
+static string SignedStr( long n ) {
+	char buf[ REAL_BUFSIZE ];
+	unsigned int len = 0;
+	DigitBuf u = n;
+	if ( n < 0 ) {
+		buf[len++] = '-';
+		u = 0 - u;
+	}
+	len += WriteUInt( u, buf + len );
+	return string( buf, len );
+}
+
+static string UnsignedStr( unsigned long n ) {
+	char buf[ REAL_BUFSIZE ];
+	return string( buf, WriteUInt( n, buf ) );
+}
+
+string Str( int n ) {
+	return SignedStr( n );
+}
+
+string Str( long n ) {
+	return SignedStr( n );
+}
+
+string Str( unsigned int n ) {
+	return UnsignedStr( n );
+}
+
+string Str( unsigned long n ) {
+	return UnsignedStr( n );
+}
+
 //---------------------------------------------------------------------------
 // Convert string to boolean as per numerics
 //---------------------------------------------------------------------------
@@ -1133,6 +1565,56 @@ DEFTEST( BinStrTest ) {
 	FAILIF( s != "11111111111111111111111111111110" );
 }
 
+DEFTEST( ParseRealTest ) {
+	double d;
+	FAILIF( ! ParseReal( "1.5", d ) );
+	FAILNE( d, 1.5 );
+	FAILIF( ! ParseReal( "-0.25e2", d ) );
+	FAILNE( d, -25.0 );
+	FAILIF( ! ParseReal( "12345678.125", d ) );
+	FAILNE( d, 12345678.125 );
+	FAILIF( ! ParseReal( "0.1", d ) );
+	FAILNE( d, 0.1 );
+	FAILIF( ! ParseReal( "123456789012345678901234", d ) );
+	FAILNE( d, 123456789012345678901234.0 );
+	FAILIF( ! ParseReal( "1e-300", d ) );
+	FAILNE( d, 1e-300 );
+	FAILIF( ! ParseReal( " 42", d ) );
+	FAILNE( d, 42.0 );
+	FAILIF( ! ParseReal( "", d ) );
+	FAILIF( ParseReal( "abc", d ) );
+	FAILIF( ParseReal( "1e", d ) );
+	FAILIF( ParseReal( "1.2.3", d ) );
+	FAILIF( ParseReal( "1e400", d ) );
+	FAILIF( ! IsNumber( "-7" ) );
+	FAILIF( IsNumber( "-" ) );
+	FAILNE( ToReal( "3.25" ), 3.25 );
+	MUST_THROW( ToReal( "x1" ) );
+}
+
+DEFTEST( FormatRealTest ) {
+	FAILNE( Str( 42 ), "42" );
+	FAILNE( Str( -7L ), "-7" );
+	FAILNE( Str( 1.0 / 3.0 ), "0.333333" );
+	FAILNE( Str( 2.5 ), "2.5" );
+	FAILNE( Str( -1234567.0 ), "-1.23457e+06" );
+	FAILNE( Str( 0.0001 ), "0.0001" );
+	FAILNE( Str( 0.00001 ), "1e-05" );
+	FAILNE( Str( 999999.6 ), "1e+06" );
+	FAILNE( RealStr( 0.1 + 0.2 ), "0.30000000000000004" );
+	FAILNE( RealStr( 0.3 ), "0.3" );
+	FAILNE( RealStr( -12.0 ), "-12" );
+	FAILNE( RealStr( 1e100 ), "1e+100" );
+	FAILNE( RealStr( 2.675, 2 ), "2.67" );
+	FAILNE( RealStr( -0.001, 2 ), "-0.00" );
+	FAILNE( RealStr( 1.5, 0 ), "2" );
+	char buf[ REAL_BUFSIZE ];
+	FAILNE( FormatReal( 1.25, buf, sizeof(buf) ), 4 );
+	FAILNE( string( buf ), "1.25" );
+	FAILNE( FormatReal( 1e30, buf, sizeof(buf), 2 ), 34 );
+	FAILNE( string( buf ).size(), REAL_BUFSIZE - 1 );
+}
+
 DEFTEST( StrToVecTest ) {
 	string s = "foo\nbar\none two\n";
 	vector <string> v;
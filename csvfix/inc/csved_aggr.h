@@ -0,0 +1,70 @@
+//---------------------------------------------------------------------------
+// csved_aggr.h
+//
+// hash-based group-by aggregation
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#ifndef INC_CSVED_AGGR_H
+#define INC_CSVED_AGGR_H
+
+#include "a_base.h"
+#include "csved_command.h"
+#include "csved_types.h"
+#include <unordered_map>
+
+namespace CSVED {
+
+//---------------------------------------------------------------------------
+
+class AggregateCommand : public Command {
+
+	public:
+
+		AggregateCommand( const std::string & name,
+							const std::string & desc );
+
+		int Execute( ALib::CommandLine & cmd );
+
+	private:
+
+		enum AggType { Count, Sum, Average, Min, Max };
+
+		struct Aggregate {
+			Aggregate( AggType type, unsigned int field )
+				: mType( type ), mField( field ) {}
+			AggType mType;
+			unsigned int mField;
+		};
+
+		struct Group {
+			Group( const CSVRow & key, unsigned int nvals )
+				: mKey( key ), mCount( 0 ), mVals( nvals, 0.0 ) {}
+			CSVRow mKey;
+			unsigned long mCount;
+			std::vector <double> mVals;
+		};
+
+		void ProcessFlags( const ALib::CommandLine & cmd );
+		void AddAggregates( AggType type, const std::string & fields );
+		void Accumulate( const CSVRow & row );
+		void WriteGroups( IOManager & io );
+		void MakeKey( const CSVRow & row );
+		double GetValue( const CSVRow & row, unsigned int field ) const;
+
+		FieldList mGroupFields;
+		std::vector <Aggregate> mAggs;
+
+		typedef std::unordered_map <std::string, unsigned int> IndexMap;
+		IndexMap mIndex;
+		std::vector <Group> mGroups;
+		std::string mKey;
+};
+
+//------------------------------------------------------------------------
+
+}	// end namespace
+
+#endif
+
@@ -18,6 +18,13 @@
 
 namespace CSVED {
 
+//------------------------------------------------------------------------
+// Number of rows read at a time by commands that evaluate expressions
+// for a batch of rows
+//------------------------------------------------------------------------
+
+const unsigned int BATCH_SIZE = 1024;
+
 //------------------------------------------------------------------------
 // Base class for all commands - handles flags, help etc.
 //----------------------------------------------------------------------------
@@ -52,6 +59,12 @@ class Command {
 		bool Skip( const CSVRow & r );
 		bool Pass( const CSVRow & r );
 
+		bool CanBatchSkipPass() const;
+		unsigned int SkipPassBatch( const CSVTable & rows, unsigned int n,
+									ALib::Expression::Selection & skip,
+									ALib::Expression::Selection & pass,
+									ALib::Expression * & failed );
+
 	private:
 
 		std::string mName, mDesc;
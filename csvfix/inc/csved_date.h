@@ -31,16 +31,16 @@ class MaskedDateReader {
 		void SetYearBase( unsigned int ybase );
 		void SetMonths( const std::string & months );
 
-		bool Read( const std::string & s, ALib::Date & d );
+		bool Read( const std::string & s, ALib::Date & d ) const;
 
 	private:
 
 		char ReadDMY( const std::string & mask, unsigned int & pos );
 		std::string ReadSep( const std::string & mask, unsigned int & pos );
 
-		void MakeDay( const std::string & s, int & day  );
-		void MakeMonth( const std::string & s, int & day  );
-		void MakeYear( const std::string & s, int & day  );
+		void MakeDay( const char * b, const char * e, int & day ) const;
+		void MakeMonth( const char * b, const char * e, int & month ) const;
+		void MakeYear( const char * b, const char * e, int & year ) const;
 
 		char mDMY[3];
 		std::string mSep[2];
@@ -17,6 +17,7 @@ namespace CSVED {
 class DiffCommand : public Command {
 
 	friend class Differ;
+	friend class KeyedDiffer;
 
 	public:
 
@@ -30,7 +31,7 @@ class DiffCommand : public Command {
 
 		void ProcessFlags( ALib::CommandLine & cmd );
 
-		FieldList mFields;
+		FieldList mFields, mKeys;
 		bool mReport, mTrim, mIgnoreCase;
 };
 
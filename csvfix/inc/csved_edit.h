@@ -11,6 +11,7 @@
 
 #include "a_base.h"
 #include "csved_command.h"
+#include "a_regex.h"
 
 namespace CSVED {
 
@@ -35,12 +36,15 @@ class EditCommand : public Command {
 			char mCmd;
 			std::string mFrom, mTo;
 			std::string mOpts;
+			ALib::RegEx mRegEx;
+			bool mCompiled;
 		
 			EditSubCmd( char cmd, 
 							const std::string & from,
 							const std::string & to, 
 							const std::string & opts )
-				: mCmd( cmd ), mFrom( from ), mTo( to ), mOpts( opts ) {
+				: mCmd( cmd ), mFrom( from ), mTo( to ), mOpts( opts ),
+					mCompiled( false ) {
 			}
 		};
 
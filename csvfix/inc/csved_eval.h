@@ -12,6 +12,7 @@
 #include "a_base.h"
 #include "a_expr.h"
 #include "csved_command.h"
+#include "csved_evalvars.h"
 
 namespace CSVED {
 
@@ -30,19 +31,31 @@ class EvalCommand : public Command {
 
 		struct FieldEx {
 			FieldEx( int field, const ALib::Expression & e )
-				: mField( field ), mExpr( e ) {}
+				: mField( field ), mExpr( e ),
+					mVars( GetVarSlots( mExpr ) ) {}
 			int mField;
 			ALib::Expression mExpr;
+			VarSlots mVars;
 		};
 
 		void SetParams( const CSVRow & row, class IOManager & iom );
 		void Evaluate( CSVRow & row );
+		void ApplyResults( CSVRow & row );
+
+		bool CanBatch() const;
+		void ExecuteBatched( IOManager & io );
+		void EvaluateBatch( IOManager & io, unsigned int n );
 
 		void GetExpressions( ALib::CommandLine & cmd );
 		std::vector <FieldEx> mFieldExprs;
 		std::vector <bool> mIsIf;
+		std::vector <std::pair <int, std::string> > mResults;
 		bool mDiscardInput;
 
+		CSVTable mBatch;
+		ALib::Expression::Selection mSkipped, mPassed, mSelected;
+		std::vector <std::vector <std::string> > mBatchResults;
+
 };
 
 
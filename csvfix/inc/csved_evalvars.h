@@ -20,9 +20,19 @@ const char * const LINE_VAR 	= "line";	// var containing current line no
 const char * const FILE_VAR 	= "file";	// var containing current file name
 const char * const FIELD_VAR 	= "fields"; // var containing CSV field count
 
+// slots for the variables in an expression - looked up once, so that
+// setting them for each row does not need to look up their names
+
+struct VarSlots {
+	unsigned int mLine, mFile, mFields;
+};
+
+VarSlots GetVarSlots( ALib::Expression & e );
+
 // utility function to add variables
 
-void AddVars( ALib::Expression & e, const IOManager & io, const CSVRow & row );
+void AddVars( ALib::Expression & e, const VarSlots & vs,
+				const IOManager & io, const CSVRow & row );
 
 
 } // namespace
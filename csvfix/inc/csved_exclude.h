@@ -13,6 +13,7 @@
 #include "a_expr.h"
 
 #include "csved_command.h"
+#include "csved_evalvars.h"
 #include "csved_types.h"
 
 namespace CSVED {
@@ -36,6 +37,7 @@ class ExcludeCommand : public Command {
 
 		FieldList mFields;
 		ALib::Expression mExpr;
+		VarSlots mVars;
 		bool mReverse;
 };
 
@@ -11,9 +11,54 @@
 
 #include "a_base.h"
 #include "csved_command.h"
+#include "a_exec.h"
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 namespace CSVED {
 
+//---------------------------------------------------------------------------
+// Co-process used by exec -co. Input is buffered and written by the caller,
+// while a thread reads the command's output into a queue of lines, so the
+// command can never block writing output that we are not yet ready for.
+//---------------------------------------------------------------------------
+
+class ExecCoprocess {
+
+	CANNOT_COPY( ExecCoprocess );
+
+	public:
+
+		ExecCoprocess( const std::string & cmd );
+		~ExecCoprocess();
+
+		void Send( const std::string & line );
+		void EndInput();
+		bool TryGetLine( std::string & line );
+		bool GetLine( std::string & line );
+		int Finish();
+
+	private:
+
+		void Run();
+		void ReadLines( std::vector <char> & buf );
+		void WriteInput();
+		bool TakeLine( std::string & line );
+
+		ALib::Coprocess mProc;
+		std::string mInBuf;
+		unsigned long mInLines, mSent, mReceived;
+		std::deque <std::string> mLines;
+		std::mutex mLock;
+		std::condition_variable mChanged;
+		bool mEOF;
+		std::exception_ptr mError;
+		std::thread mThread;
+};
+
 //---------------------------------------------------------------------------
 
 class ExecCommand : public Command {
@@ -27,6 +72,9 @@ class ExecCommand : public Command {
 
 	private:
 
+		void RunCoprocesses( IOManager & io, unsigned int nprocs, bool csv );
+		void WriteResult( IOManager & io, const CSVRow & row,
+							const std::string & line, bool csv );
 		std::string MakeCmd( const CSVRow & row );
 		std::string MakeParam( const CSVRow & row ,unsigned int  & pos );
 		std::string mCmdLine;
@@ -13,6 +13,8 @@
 #include "csved_command.h"
 #include "a_dict.h"
 #include <fstream>
+#include <list>
+#include <map>
 
 namespace CSVED {
 
@@ -25,6 +27,7 @@ class FileSplitCommand : public Command {
 
 		FileSplitCommand( const std::string & name,
 							const std::string & desc );
+		~FileSplitCommand();
 
 		int Execute( ALib::CommandLine & cmd );
 
@@ -34,12 +37,35 @@ class FileSplitCommand : public Command {
 		std::string NewFileName( const std::string &  key );
 		void WriteRow( IOManager & io, const CSVRow & row );
 		std::string MakeKey( const CSVRow & row );
-
-		std::string mDir, mFilePrefix, mFileExt, mCurrentFile;
-		ALib::Dictionary <std::string> mDict;
+		void Close( std::ofstream & out, const std::string & fname );
+		void CloseAll();
+
+		// output for each file is buffered in memory and written in large
+		// chunks, through a pool of open files kept in most recently used
+		// order
+
+		struct OutFile;
+		typedef std::list <OutFile *> FileList;
+
+		struct OutFile {
+			std::string mName, mPending;
+			std::ofstream * mOut;			// null if not open
+			FileList::iterator mPos;		// in open list, if open
+		};
+
+		OutFile * GetFile( const std::string & key );
+		void Write( OutFile & f );
+		void WriteAll();
+
+		std::string mDir, mFilePrefix, mFileExt, mLastKey;
+		ALib::Dictionary <OutFile *> mDict;
+		std::map <std::string, OutFile *> mNames;
+		std::vector <OutFile *> mFiles;
+		FileList mOpenFiles;
+		OutFile * mLastFile;
+		unsigned int mPending;
 		std::vector <unsigned int> mColIndex;
-		unsigned int mFileNo;
-		std::ofstream mOutFile;
+		unsigned int mFileNo, mMaxOpen;
 		bool mUseFieldNames;
 };
 
@@ -12,8 +12,10 @@
 #include "a_base.h"
 #include "a_regex.h"
 #include "a_expr.h"
+#include "a_hashset.h"
 
 #include "csved_command.h"
+#include "csved_evalvars.h"
 
 namespace CSVED {
 
@@ -35,39 +37,81 @@ class FindCommand : public Command {
 
 		void Clear();
 		void CreateRegExes( const ALib::CommandLine & cmd );
+		void ReadLiterals( const std::string & fname );
+		void CreateValueSets( const ALib::CommandLine & cmd );
+		void ReadValues( const std::string & spec, ALib::StringSet & vs );
 		void CreateRanges( const ALib::CommandLine & cmd );
 		void CreateLengths( const ALib::CommandLine & cmd );
 		void CreateFieldCounts( const ALib::CommandLine & cmd );
 
+		void CreatePlan( const ALib::CommandLine & cmd );
+		void AdaptPlan();
+		void ExplainPlan( std::ostream & os ) const;
+
+		void ExecuteBatched( IOManager & io );
+		void FilterBatch( IOManager & io, unsigned int n );
+		bool TestExpr( IOManager & io, CSVRow & row );
+		bool PassRow( CSVRow & row );
+		void OutputRow( IOManager & io, CSVRow & row );
 		bool MatchRow( CSVRow & row );
+		bool MatchField( const std::string & s );
 		bool TryAllRegExes( const std::string & s );
-		bool TryAllRanges( const std::string & s );
+		bool TryNumRanges( const std::string & s );
+		bool TryStrRanges( const std::string & s );
 		bool TryAllLengths( const std::string & s );
+		bool TryAllValues( const std::string & s );
 		bool HaveRegex() const;
 
-		std::vector <ALib::RegEx *> mExprs;
+		ALib::RegExSet mExprs;
 		std::vector <unsigned int> mColIndex;
 
-		typedef std::pair<std::string,std::string> RangeData;
-		struct Range {
-			RangeData mRange;
-			bool mIsNum;
-			Range( const RangeData & r, bool isnum )
-				: mRange( r ), mIsNum( isnum ) {}
-		};
-
-		std::vector <Range> mRanges;
-
+		typedef std::pair<double,double> NumRange;
+		std::vector <NumRange> mNumRanges;
+		typedef std::pair<std::string,std::string> StrRange;
+		std::vector <StrRange> mStrRanges;
 
 		typedef std::pair< int, int> LenRange;
 		std::vector <LenRange> mLengths;
 
 		bool mRemove;
 		bool mCountOnly;
+		unsigned int mCount;
+
+		ALib::StringSet mValues, mValuesIC;
+		bool mHaveValues;
+
+		// tests are compiled into a plan, cheapest first, with counts of
+		// how often each is tried and how often it matches
+
+		enum StepKind { STEP_FCOUNT, STEP_FIELDS, STEP_EXPR,
+						STEP_LENGTH, STEP_NUMRANGE, STEP_STRRANGE,
+						STEP_VALUES, STEP_REGEX };
+
+		struct PlanStep {
+			StepKind mKind;
+			unsigned int mCost;
+			unsigned long mTries, mHits;
+			PlanStep( StepKind kind, unsigned int cost )
+				: mKind( kind ), mCost( cost ), mTries( 0 ), mHits( 0 ) {}
+		};
+
+		bool RunStep( PlanStep & step, const std::string & s );
+		static bool CheaperStep( const PlanStep & a, const PlanStep & b );
+		static bool BetterStep( const PlanStep & a, const PlanStep & b );
+		std::string StepName( const PlanStep & step ) const;
+
+		std::vector <PlanStep> mRowPlan, mFieldPlan;
+		PlanStep mExprStep;
+		bool mExprFirst, mAdapt;
+		unsigned long mRowsToAdapt;
 
 		int mMinFields, mMaxFields;
 
 		ALib::Expression mEvalExpr;
+		VarSlots mEvalVars;
+
+		CSVTable mBatch;
+		ALib::Expression::Selection mAll, mSelected;
 };
 
 
@@ -14,42 +14,74 @@
 #include <stack>
 #include <vector>
 #include <memory>
+#include <thread>
+#include <exception>
 
 namespace CSVED {
 
+//---------------------------------------------------------------------------
+// Reads rows from one input a batch at a time, optionally filling the
+// next batch on a background thread while the current one is consumed.
+//---------------------------------------------------------------------------
+
 class RowGetter {
 
+	CANNOT_COPY( RowGetter );
+
 	public:
 
-		RowGetter( ALib::CSVStreamParser * p );
+		RowGetter( ALib::CSVStreamParser * p, bool background );
 		~RowGetter();
 
-		bool Get( CSVRow & row );
-		void ClearLatch();
+		bool Next( CSVRow & row );
 
 	private:
 
+		void Fill();
+
 		ALib::CSVStreamParser * mParser;
-		bool mDone, mHave;
-		CSVRow mLatch;
+		bool mBackground, mDone;
+		CSVTable mRows, mAhead;
+		unsigned int mPos, mCount, mAheadCount;
+		std::thread mThread;
+		std::exception_ptr mError;
 };
 
+//---------------------------------------------------------------------------
+// Loser tree over the inputs - each internal node holds the input that
+// lost the match played there, and node zero holds the overall winner.
+// Rows are compared via keys built once when the row is read.
+//---------------------------------------------------------------------------
+
 class MinFinder {
 
+	CANNOT_COPY( MinFinder );
+
 	public:
 
-		MinFinder( IOManager & io, const FieldList & fields );
+		MinFinder( IOManager & io, const FieldList & fields,
+						bool background );
 		~MinFinder();
 
 		bool FindMin( CSVRow & row );
 
 	private:
 
-		std::vector <RowGetter *> mGetters;
-		const FieldList & mFields;
+		void Advance( unsigned int i );
+		void MakeKey( unsigned int i );
+		bool Less( unsigned int a, unsigned int b ) const;
+		void Replay( unsigned int i );
 
+		std::vector <RowGetter *> mGetters;
+		FieldList mFields;
+		CSVTable mRows;
+		std::vector <std::string> mKeys;
+		std::vector <bool> mHave;
+		std::vector <unsigned int> mTree;
 };
 
+//---------------------------------------------------------------------------
+
 class FMergeCommand : public Command {
 
 	public:
@@ -65,8 +97,7 @@ class FMergeCommand : public Command {
 		void ProcessFlags( ALib::CommandLine & cmd );
 
 		FieldList mFields;
-
-
+		bool mBackground;
 };
 
 }
@@ -54,11 +54,13 @@ class IOManager {
 		std::string InFileName( unsigned int index ) const;
 
 		std::string CurrentFileName() const;
+		unsigned int CurrentStream() const;
 		unsigned int CurrentLine() const;
-		std::string CurrentInput() const;
+		const std::string & CurrentInput() const;
 
 		bool ReadLine( std::string & line );
 		bool ReadCSV( CSVRow & row );
+		bool InputWouldWait() const;
 		void WriteRow( const CSVRow & row, bool ignoredq = false );
 
 		std::ostream & Out() const;
@@ -0,0 +1,57 @@
+//---------------------------------------------------------------------------
+// csved_lookidx.h
+//
+// prebuilt on-disk index of lookup file keys for validation
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#ifndef INC_CSVED_LOOKIDX_H
+#define INC_CSVED_LOOKIDX_H
+
+#include "a_base.h"
+#include "a_file.h"
+#include "csved_types.h"
+
+namespace CSVED {
+
+//---------------------------------------------------------------------------
+// Index of the keys in a lookup file, written by the mkindex command and
+// memory mapped by the lookup rule, so that big lookup files don't have to
+// be read each time we validate. A key is made up of the values of the
+// index fields, each followed by a zero byte. The index is a hash table
+// that records the stamp of the file it was built from, and is not used
+// if the file has changed.
+//---------------------------------------------------------------------------
+
+class LookupIndex {
+
+	CANNOT_COPY( LookupIndex );
+
+	public:
+
+		LookupIndex();
+
+		static std::string IndexName( const std::string & fname );
+		static void Build( const std::string & fname,
+							const FieldList & fields );
+
+		bool Open( const std::string & fname, const FieldList & fields );
+		bool IsOpen() const;
+		bool Contains( const std::string & key ) const;
+
+	private:
+
+		ALib::MappedFile mMap;
+		const unsigned long long * mSlots;
+		unsigned long long mSlotMask;
+		const char * mKeys;
+		unsigned long long mKeySize;
+};
+
+//------------------------------------------------------------------------
+
+}	// end namespace
+
+#endif
+
@@ -0,0 +1,34 @@
+//---------------------------------------------------------------------------
+// csved_mkindex.h
+//
+// build index of lookup file for validation
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#ifndef INC_CSVED_MKINDEX_H
+#define INC_CSVED_MKINDEX_H
+
+#include "a_base.h"
+#include "csved_command.h"
+
+namespace CSVED {
+
+//---------------------------------------------------------------------------
+
+class MakeIndexCommand : public Command {
+
+	public:
+
+		MakeIndexCommand( const std::string & name,
+							const std::string & desc );
+
+		int Execute( ALib::CommandLine & cmd );
+};
+
+//------------------------------------------------------------------------
+
+}	// end namespace
+
+#endif
+
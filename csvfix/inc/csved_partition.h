@@ -0,0 +1,107 @@
+//---------------------------------------------------------------------------
+// csved_partition.h
+//
+// partition CSV stream into a fixed number of files by hash of key
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#ifndef INC_CSVED_PARTITION_H
+#define INC_CSVED_PARTITION_H
+
+#include "a_base.h"
+#include "csved_command.h"
+#include <fstream>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+namespace CSVED {
+
+class PartitionWriter;
+
+//---------------------------------------------------------------------------
+// Output file for one partition, with the rows buffered for it so far and
+// the writer thread, if any, that writes its buffers.
+//---------------------------------------------------------------------------
+
+struct PartitionFile {
+
+	std::string mName;
+	std::ofstream mOut;
+	std::string mBuf;
+	PartitionWriter * mWriter;
+
+	void Write( const std::string & data );
+};
+
+//---------------------------------------------------------------------------
+// Thread that writes full buffers for some of the partitions, so that
+// reading and hashing does not wait on output. Buffers for a partition
+// always go to the same writer, so their order is kept.
+//---------------------------------------------------------------------------
+
+class PartitionWriter {
+
+	CANNOT_COPY( PartitionWriter );
+
+	public:
+
+		PartitionWriter();
+		~PartitionWriter();
+
+		void Put( PartitionFile & pf );
+		void Finish();
+
+	private:
+
+		void Run();
+		void Stop();
+
+		struct Chunk {
+			PartitionFile * mFile;
+			std::string mData;
+		};
+
+		std::deque <Chunk> mQueue;
+		std::mutex mLock;
+		std::condition_variable mReady, mSpace;
+		bool mDone;
+		std::exception_ptr mError;
+		std::thread mThread;
+};
+
+//---------------------------------------------------------------------------
+
+class PartitionCommand : public Command {
+
+	public:
+
+		PartitionCommand( const std::string & name,
+							const std::string & desc );
+		~PartitionCommand();
+
+		int Execute( ALib::CommandLine & cmd );
+
+	private:
+
+		void ProcessFlags( ALib::CommandLine & cmd );
+		void OpenFiles();
+		void CloseFiles();
+		unsigned int PartitionOf( const CSVRow & row );
+		void Flush( PartitionFile & pf );
+
+		std::string mDir, mFilePrefix, mFileExt, mKey;
+		FieldList mFields;
+		unsigned int mCount, mBufSize, mWriters;
+		std::vector <PartitionFile *> mFiles;
+};
+
+//----------------------------------------------------------------------------
+
+} // namespace
+
+#endif
+
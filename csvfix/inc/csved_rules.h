@@ -16,6 +16,7 @@
 #include "csved_types.h"
 #include "csved_util.h"
 #include "csved_date.h"
+#include "csved_lookidx.h"
 #include <limits.h>
 #include <float.h>
 #include <set>
@@ -91,6 +92,8 @@ class ValidationRule {
 		virtual ~ValidationRule();
 
 		virtual Results Apply( const CSVRow & row ) const;
+		virtual bool Passes( const CSVRow & row,
+								std::string & scratch ) const;
 
 		std::string Name() const;
 		void DumpOn( std::ostream & os );
@@ -232,6 +235,8 @@ class FieldsRule : public ValidationRule {
 						const Params & params );
 
 		virtual Results Apply( const CSVRow & row ) const;
+		virtual bool Passes( const CSVRow & row,
+								std::string & scratch ) const;
 
 		ValidationResult Validate( const CSVRow & row,
 									unsigned int idx ) const ;
@@ -305,11 +310,15 @@ class LookupRule : public ValidationRule {
 		ValidationResult Validate( const CSVRow & row,
 									unsigned int idx ) const ;
 		virtual Results Apply( const CSVRow & row ) const;
+		virtual bool Passes( const CSVRow & row,
+								std::string & scratch ) const;
 
 	private:
 
 		void Init( const Params & params );
 		void BuildFieldSet();
+		void MakeKey( const CSVRow & row, std::string & key ) const;
+		bool HasKey( const std::string & key ) const;
 
 		typedef std::pair <unsigned int ,unsigned int> Join;
 		typedef std::vector <Join> Joins;
@@ -318,6 +327,7 @@ class LookupRule : public ValidationRule {
 		std::string mLookupFile;
 
 		std::multiset <std::string> mJoinVals;
+		LookupIndex mIndex;
 };
 
 //---------------------------------------------------------------------------
@@ -336,13 +346,15 @@ class DateRule : public ValidationRule {
 
 		ValidationResult Validate( const CSVRow & row,
 									unsigned int idx ) const ;
+		virtual bool Passes( const CSVRow & row,
+								std::string & scratch ) const;
 
 	private:
 
 		bool mCheckRange;
 		std::string mMask;
 		ALib::Date mMin, mMax;
-		mutable MaskedDateReader * mDateReader;
+		MaskedDateReader * mDateReader;
 };
 
 //------------------------------------------------------------------------
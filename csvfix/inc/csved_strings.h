@@ -17,6 +17,7 @@ namespace CSVED {
 // Command names
 //---------------------------------------------------------------------------
 
+const char * const CMD_AGGR		= "aggregate";
 const char * const CMD_ATABLE	= "ascii_table";
 const char * const CMD_BLOCK	= "block";
 const char * const CMD_CALL		= "call";
@@ -47,12 +48,14 @@ const char * const CMD_LOWER	= "lower";
 const char * const CMD_MERGE	= "merge";
 const char * const CMD_MAP		= "map";
 const char * const CMD_MIXED	= "mixed";
+const char * const CMD_MKINDEX	= "mkindex";
 const char * const CMD_MONEY	= "money";
 const char * const CMD_NUMBER	= "number";
 const char * const CMD_ODBCGET	= "odbc_get";
 const char * const CMD_ORDER	= "order";
 const char * const CMD_PRINTF	= "printf";
 const char * const CMD_PAD		= "pad";
+const char * const CMD_PARTITION	= "partition";
 const char * const CMD_PUT		= "put";
 const char * const CMD_ESC		= "escape";
 const char * const CMD_REMOVE	= "remove";
@@ -90,6 +93,7 @@ const char * const CMD_XMLR		= "read_xml";
 
 const char * const FLAG_ARG		= "-arg";
 const char * const FLAG_AVG		= "-avg";
+const char * const FLAG_ADAPT	= "-adapt";
 const char * const FLAG_ACTKEEP	= "-k";
 const char * const FLAG_ACTMARK	= "-m";
 const char * const FLAG_ACTREM	= "-r";
@@ -97,6 +101,7 @@ const char * const FLAG_BASEN	= "-b";
 const char * const FLAG_BDEXCL	= "-bdx";
 const char * const FLAG_BDLIST	= "-bdl";
 const char * const FLAG_BEXPR	= "-be";
+const char * const FLAG_BGREAD	= "-bg";
 const char * const FLAG_BLKEXC	= "-x";
 const char * const FLAG_BLKMARK	= "-m";
 const char * const FLAG_BSIZE	= "-bs";
@@ -105,8 +110,10 @@ const char * const FLAG_CENTS	= "-cn";
 const char * const FLAG_CHARS	= "-s";
 const char * const FLAG_CHAR	= "-c";
 const char * const FLAG_CMD		= "-c";
+const char * const FLAG_COPROC	= "-co";
 const char * const FLAG_COLS	= "-f";
 const char * const FLAG_CMULTI	= "-cm";
+const char * const FLAG_COUNT	= "-count";
 const char * const FLAG_CONSTR	= "-cs";
 const char * const FLAG_CURSYM	= "-cs";
 const char * const FLAG_CSV		= "-csv";
@@ -132,6 +139,7 @@ const char * const FLAG_ESC		= "-e";
 const char * const FLAG_ESCOFF	= "-noc";
 const char * const FLAG_EXPR	= "-e";
 const char * const FLAG_EXCLF	= "-xf";
+const char * const FLAG_EXPLAIN	= "-explain";
 const char * const FLAG_EXCLNL	= "-x";
 const char * const FLAG_FCOUNT	= "-fc";
 const char * const FLAG_FSEP	= "-fs";
@@ -145,6 +153,7 @@ const char * const FLAG_FREQ	= "-frq";
 const char * const FLAG_FUNC	= "-fnc";
 const char * const FLAG_EXPRIC	= "-ei";
 const char * const FLAG_FROMV	= "-fv";
+const char * const FLAG_GROUP	= "-g";
 const char * const FLAG_HEADER	= "-h";
 const char * const FLAG_HEADEXP	= "-me";
 const char * const FLAG_HDRREC	= "-hdr";
@@ -158,6 +167,7 @@ const char * const FLAG_INVERT	= "-inv";
 const char * const FLAG_IGNBL	= "-ibl";
 const char * const FLAG_INDTAB	= "-it";
 const char * const FLAG_ISPACE	= "-is";
+const char * const FLAG_JOBS	= "-j";
 const char * const FLAG_KEEP	= "-k";
 const char * const FLAG_KEY		= "-k";
 const char * const FLAG_KSEP	= "-ts";
@@ -166,6 +176,7 @@ const char * const FLAG_MASK	= "-m";
 const char * const FLAG_MASTER	= "-m";
 const char * const FLAG_MEDIAN	= "-med";
 const char * const FLAG_MAX		= "-max";
+const char * const FLAG_MAXOPEN	= "-maxopen";
 const char * const FLAG_MIN		= "-min";
 const char * const FLAG_MINUS	= "-ms";
 const char * const FLAG_MODE	= "-mod";
@@ -181,6 +192,7 @@ const char * const FLAG_OUT		= "-o";
 const char * const FLAG_OUTSEP	= "-osep";
 const char * const FLAG_OUTERJ	= "-oj";
 const char * const FLAG_PAD		= "-p";
+const char * const FLAG_PCT		= "-pct";
 const char * const FLAG_PADCHAR	= "-pc";
 const char * const FLAG_PLUS	= "-ps";
 const char * const FLAG_POS		= "-p";
@@ -202,6 +214,7 @@ const char * const FLAG_RULER	= "-ru";
 const char * const FLAG_RALIGN	= "-ra";
 const char * const FLAG_SEP		= "-s";
 const char * const FLAG_SIZE	= "-siz";
+const char * const FLAG_SKETCH	= "-sk";
 const char * const FLAG_SMARTQ	= "-smq";
 const char * const FLAG_SQLQ	= "-sql";
 const char * const FLAG_SUM		= "-sum";
@@ -209,10 +222,12 @@ const char * const FLAG_SQLSEP	= "-s";
 const char * const FLAG_SUBS	= "-s";
 const char * const FLAG_STR		= "-s";
 const char * const FLAG_STRIC	= "-si";
+const char * const FLAG_SFILE	= "-sf";
 const char * const FLAG_TABLE	= "-t";
 const char * const FLAG_SQLTBL	= "-tbl";
 const char * const FLAG_TFILE	= "-tf";
 const char * const FLAG_TONLY	= "-t";
+const char * const FLAG_TOP		= "-top";
 const char * const FLAG_TOV		= "-tv";
 const char * const FLAG_TRLEAD	= "-l";
 const char * const FLAG_TRTRAIL	= "-t";
@@ -222,6 +237,7 @@ const char * const FLAG_VAL		= "-v";
 const char * const FLAG_VALENV	= "-e";
 const char * const FLAG_VERBOSE	= "-v";
 const char * const FLAG_VFILE	= "-vf";
+const char * const FLAG_VFILEIC	= "-vfi";
 const char * const FLAG_WHERE	= "-w";
 const char * const FLAG_WIDTH	= "-w";
 
@@ -10,6 +10,8 @@
 #define INC_CSVED_SUM_H
 
 #include "a_base.h"
+#include "a_freq.h"
+#include "a_quantile.h"
 #include "csved_command.h"
 #include "csved_types.h"
 #include <map>
@@ -29,7 +31,8 @@ class SummaryCommand : public Command {
 
 	private:
 
-		enum Type { Average, Sum, Min, Max, Median, Mode, Frequency, Size };
+		enum Type { Average, Sum, Min, Max, Median, Mode, Frequency, Size,
+					Percentile, Top };
 
 		void DoMinMax( IOManager & io );
 		void DoSum( IOManager & io );
@@ -37,11 +40,22 @@ class SummaryCommand : public Command {
 		void DoFreq( IOManager & io );
 		void DoMedian( IOManager & io );
 		void DoMode( IOManager & io );
+		void DoPercentiles( IOManager & io );
+		void DoTop( IOManager & io );
 
 		typedef std::map <int,std::pair<int,int> > SizeMap;
 		void RecordSizes( const CSVRow & row, SizeMap & sm );
 		void PrintSizes( IOManager & io, const SizeMap & sm );
 
+		void RecordPercentiles( const CSVRow & row );
+		void GetPercentiles( const ALib::CommandLine & cmd );
+		void GetColumn( unsigned int col, std::vector <double> & vals ) const;
+		void GetTop( const ALib::CommandLine & cmd );
+		void GetSelectedFields( const ALib::CommandLine & cmd,
+								const std::string & flag );
+		unsigned int GetSketchSize( const ALib::CommandLine & cmd,
+									unsigned int minsize );
+
 		void SumCols( std::vector <double> & sums );
 		unsigned int  CalcFreqs();
 		std::string MakeKey( const CSVRow & row ) const;
@@ -68,6 +82,14 @@ class SummaryCommand : public Command {
 
 		typedef std::map <std::string, FreqMapEntry> FreqMap;
 			FreqMap mFreqMap;
+
+		std::vector <double> mPercentiles;
+		std::vector <std::vector <double> > mPctValues;
+		std::vector <ALib::QuantileSketch> mSketches;
+		unsigned int mSketchSize;
+
+		unsigned int mTopCount;
+		std::unique_ptr <ALib::FrequentItems> mTopItems;
 };
 
 //------------------------------------------------------------------------
@@ -11,9 +11,85 @@
 
 #include "a_base.h"
 #include "csved_command.h"
+#include "a_expr.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 namespace CSVED {
 
+//---------------------------------------------------------------------------
+// Template parsed once into literal text, field references and compiled
+// expressions, so rendering a row just appends the pieces to a buffer.
+//---------------------------------------------------------------------------
+
+class CompiledTemplate {
+
+	CANNOT_COPY( CompiledTemplate );
+
+	public:
+
+		CompiledTemplate();
+		~CompiledTemplate();
+
+		void Compile( const std::string & tplate );
+		void Render( const CSVRow & row, std::string & out );
+
+	private:
+
+		void AddLiteral( char c );
+		void AddPlaceholder( const std::string & ph );
+
+		enum SegKind { SEG_LITERAL, SEG_FIELD, SEG_EXPR };
+
+		struct Segment {
+			SegKind mKind;
+			std::string mText;		// literal text
+			unsigned int mIndex;	// field or expression index
+		};
+
+		std::vector <Segment> mSegments;
+		std::vector <ALib::Expression *> mExprs;
+};
+
+//---------------------------------------------------------------------------
+// Writes files generated by the -fn option on a background thread. Files
+// are handed over in batches, so that rendering the next batch overlaps
+// with creating the files for the previous one.
+//---------------------------------------------------------------------------
+
+class TemplateFileWriter {
+
+	CANNOT_COPY( TemplateFileWriter );
+
+	public:
+
+		TemplateFileWriter();
+		~TemplateFileWriter();
+
+		void Add( std::string & fname, std::string & text );
+		void Finish();
+
+	private:
+
+		void Run();
+		void HandOver();
+		void Stop();
+
+		struct OutFile {
+			std::string mName, mText;
+		};
+
+		std::vector <OutFile> mFilling, mWriting;
+		unsigned int mFillCount, mWriteCount;
+		std::mutex mLock;
+		std::condition_variable mChanged;
+		bool mBusy, mDone;
+		std::exception_ptr mError;
+		std::thread mThread;
+};
+
 //---------------------------------------------------------------------------
 
 class TemplateCommand : public Command {
@@ -27,18 +103,10 @@ class TemplateCommand : public Command {
 
 	private:
 
-
-		std::string ReplaceColumns( const std::string & tplate, const CSVRow & row );
-		void HandleSpecialChars( const std::string & tplate, char c, unsigned int & pos,
-									const CSVRow & row,
-									std::string & out );
-
-		std::string Eval( const CSVRow & row, const std::string & expr );
 		void ReadTemplate( const ALib::CommandLine & cmd );
-		void FileOut( const CSVRow & row );
-
-		std::string mTemplate, mFileTemplate;
 
+		std::string mTemplate;
+		CompiledTemplate mBody, mFileName;
 };
 
 
@@ -12,6 +12,7 @@
 #include "a_base.h"
 #include "csved_command.h"
 #include "csved_rules.h"
+#include <exception>
 
 namespace CSVED {
 
@@ -35,9 +36,44 @@ class ValidateCommand : public Command {
 
 		void Clear();
 
+		// row read from input, with the position info needed for reports
+
+		struct InputRow {
+			CSVRow mRow;
+			std::string mInput;
+			unsigned int mStream, mLine;
+		};
+
+		typedef std::vector <InputRow> RowBatch;
+
+		// validates part of a batch of rows on a worker thread
+
+		struct Job {
+			const ValidateCommand * mCmd;
+			const RowBatch * mBatch;
+			std::vector <char> * mPassed;
+			unsigned int mBegin, mEnd, mErrorRow;
+			std::exception_ptr mError;
+			std::string mScratch;
+			void Run();
+		};
+
+		bool RowPasses( const CSVRow & row, std::string & scratch ) const;
+		void RowFailed( IOManager & io, const CSVRow & row,
+						const std::string & fname, unsigned int line,
+						const std::string & input );
+
+		void ExecuteParallel( IOManager & io, unsigned int njobs );
+		unsigned int ReadBatch( IOManager & io, RowBatch & batch,
+									std::exception_ptr & error );
+		void EmitBatch( IOManager & io, const RowBatch & batch,
+							const std::vector <char> & passed,
+							const std::vector <Job> & jobs );
+
 		void Report( IOManager & io,
 						const ValidationRule::Results & res,
-						int errcount  ) const;
+						int errcount, const std::string & fname,
+						unsigned int line, const std::string & input ) const;
 
 		std::string ReadName( const std::string & line,
 								unsigned int & pos ) const;
@@ -67,6 +103,9 @@ class ValidateCommand : public Command {
 
 		std::vector <ValidationRule *> mRules;
 
+		bool mFailed;
+		std::string mScratch;
+
 };
 
 //------------------------------------------------------------------------
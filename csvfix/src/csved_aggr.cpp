@@ -0,0 +1,236 @@
+//---------------------------------------------------------------------------
+// csved_aggr.cpp
+//
+// hash-based group-by aggregation
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#include "a_base.h"
+#include "csved_aggr.h"
+#include "csved_cli.h"
+#include "csved_strings.h"
+#include <algorithm>
+
+using std::string;
+using std::vector;
+
+namespace CSVED {
+
+//----------------------------------------------------------------------------
+// Register aggregate command
+//----------------------------------------------------------------------------
+
+static RegisterCommand <AggregateCommand> rc1_(
+	CMD_AGGR,
+	"aggregate values by group"
+);
+
+//----------------------------------------------------------------------------
+// Help text
+//----------------------------------------------------------------------------
+
+const char * const AGGR_HELP = {
+	"calculates aggregate values for groups of records with the same key\n"
+	"usage: csvfix aggregate [flags] [files ...]\n"
+	"where flags are:\n"
+	"  -g fields\tfields making up the group key - if not specified,\n"
+	"\t\tall records are in a single group\n"
+	"  -count\tcount records in each group\n"
+	"  -sum fields\tsum numeric values of fields\n"
+	"  -avg fields\tcalculate numeric average of fields\n"
+	"  -min fields\tfind minimum numeric value of fields\n"
+	"  -max fields\tfind maximum numeric value of fields\n"
+	"  Output is the key fields followed by the aggregates in the order\n"
+	"  they were specified, with groups in the order they were first seen\n"
+	"#SMQ,SEP,IBL,IFN,OFL"
+};
+
+//----------------------------------------------------------------------------
+// Standard command ctor
+//----------------------------------------------------------------------------
+
+AggregateCommand :: AggregateCommand( const string & name,
+										const string & desc )
+		: Command( name, desc, AGGR_HELP ) {
+
+	AddFlag( ALib::CommandLineFlag( FLAG_GROUP, false, 1 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_COUNT, false, 0 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_SUM, false, 1, true ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_AVG, false, 1, true ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_MIN, false, 1, true ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_MAX, false, 1, true ) );
+}
+
+//----------------------------------------------------------------------------
+// Accumulate values for each group as rows are read - only the group keys
+// and their accumulators are kept in memory, so no sorting is needed.
+//----------------------------------------------------------------------------
+
+int AggregateCommand :: Execute( ALib::CommandLine & cmd ) {
+
+	ProcessFlags( cmd );
+	IOManager io( cmd );
+
+	CSVRow row;
+	while( io.ReadCSV( row ) ) {
+		Accumulate( row );
+	}
+
+	WriteGroups( io );
+	return 0;
+}
+
+//----------------------------------------------------------------------------
+// Aggregates are output in the order they appear on the command line, so
+// we walk the command line rather than asking for each flag in turn.
+//----------------------------------------------------------------------------
+
+void AggregateCommand :: ProcessFlags( const ALib::CommandLine & cmd ) {
+
+	ALib::CommaList cl( cmd.GetValue( FLAG_GROUP, "" ) );
+	CommaListToIndex( cl, mGroupFields );
+
+	for ( int i = 2; i < cmd.Argc(); i++ ) {
+		string arg = cmd.Argv( i );
+		if ( arg == FLAG_COUNT ) {
+			mAggs.push_back( Aggregate( Count, 0 ) );
+		}
+		else if ( i + 1 < cmd.Argc() ) {
+			if ( arg == FLAG_SUM ) {
+				AddAggregates( Sum, cmd.Argv( ++i ) );
+			}
+			else if ( arg == FLAG_AVG ) {
+				AddAggregates( Average, cmd.Argv( ++i ) );
+			}
+			else if ( arg == FLAG_MIN ) {
+				AddAggregates( Min, cmd.Argv( ++i ) );
+			}
+			else if ( arg == FLAG_MAX ) {
+				AddAggregates( Max, cmd.Argv( ++i ) );
+			}
+		}
+	}
+
+	if ( mAggs.size() == 0 ) {
+		CSVTHROW( "Need at least one of " << FLAG_COUNT << ", " << FLAG_SUM
+					<< ", " << FLAG_AVG << ", " << FLAG_MIN
+					<< " or " << FLAG_MAX );
+	}
+}
+
+//----------------------------------------------------------------------------
+// Add one aggregate of specified type for each field in list
+//----------------------------------------------------------------------------
+
+void AggregateCommand :: AddAggregates( AggType type,
+										const string & fields ) {
+	ALib::CommaList cl( fields );
+	FieldList fl;
+	CommaListToIndex( cl, fl );
+	for ( unsigned int i = 0; i < fl.size(); i++ ) {
+		mAggs.push_back( Aggregate( type, fl[i] ) );
+	}
+}
+
+//----------------------------------------------------------------------------
+// Make key by concatenating group fields separated by NUL bytes, as for
+// the unique and summary commands. The key is a member so that its buffer
+// can be reused for every row.
+//----------------------------------------------------------------------------
+
+void AggregateCommand :: MakeKey( const CSVRow & row ) {
+	mKey.clear();
+	for ( unsigned int i = 0; i < mGroupFields.size(); i++ ) {
+		unsigned int fi = mGroupFields[i];
+		if ( fi < row.size() ) {
+			mKey += row[fi];
+		}
+		mKey += '\0';
+	}
+}
+
+//----------------------------------------------------------------------------
+// Get numeric value of field, which must exist
+//----------------------------------------------------------------------------
+
+double AggregateCommand :: GetValue( const CSVRow & row,
+										unsigned int field ) const {
+	if ( field >= row.size() ) {
+		CSVTHROW( "Invalid field index " << (field + 1) );
+	}
+	return ALib::ToReal( row[field], "Non-numeric value %s" );
+}
+
+//----------------------------------------------------------------------------
+// Find (or create) group for row and update its accumulators
+//----------------------------------------------------------------------------
+
+void AggregateCommand :: Accumulate( const CSVRow & row ) {
+
+	MakeKey( row );
+	unsigned int gi;
+	IndexMap::const_iterator it = mIndex.find( mKey );
+	if ( it == mIndex.end() ) {
+		CSVRow key;
+		for ( unsigned int i = 0; i < mGroupFields.size(); i++ ) {
+			unsigned int fi = mGroupFields[i];
+			key.push_back( fi < row.size() ? row[fi] : "" );
+		}
+		gi = mGroups.size();
+		mGroups.push_back( Group( key, mAggs.size() ) );
+		mIndex.insert( std::make_pair( mKey, gi ) );
+	}
+	else {
+		gi = it->second;
+	}
+
+	Group & g = mGroups[gi];
+	for ( unsigned int i = 0; i < mAggs.size(); i++ ) {
+		const Aggregate & a = mAggs[i];
+		if ( a.mType == Count ) {
+			continue;
+		}
+		double d = GetValue( row, a.mField );
+		if ( a.mType == Sum || a.mType == Average ) {
+			g.mVals[i] += d;
+		}
+		else if ( a.mType == Min ) {
+			g.mVals[i] = g.mCount == 0 ? d : std::min( g.mVals[i], d );
+		}
+		else {
+			g.mVals[i] = g.mCount == 0 ? d : std::max( g.mVals[i], d );
+		}
+	}
+	g.mCount += 1;
+}
+
+//----------------------------------------------------------------------------
+// Output key followed by aggregate values for each group
+//----------------------------------------------------------------------------
+
+void AggregateCommand :: WriteGroups( IOManager & io ) {
+	for ( unsigned int i = 0; i < mGroups.size(); i++ ) {
+		const Group & g = mGroups[i];
+		CSVRow r( g.mKey );
+		for ( unsigned int j = 0; j < mAggs.size(); j++ ) {
+			AggType t = mAggs[j].mType;
+			if ( t == Count ) {
+				r.push_back( ALib::Str( g.mCount ) );
+			}
+			else if ( t == Average ) {
+				r.push_back( ALib::Str( g.mVals[j] / g.mCount ) );
+			}
+			else {
+				r.push_back( ALib::Str( g.mVals[j] ) );
+			}
+		}
+		io.WriteRow( r );
+	}
+}
+
+//------------------------------------------------------------------------
+
+} // end namespace
+
+// end
@@ -81,10 +81,11 @@ int BlockCommand :: Execute( ALib::CommandLine & cmd ) {
 	CSVRow row;
 	InOut state = InOut::Outside;
 	bool block = true;
+	VarSlots bvs = GetVarSlots( mBeginEx ), evs = GetVarSlots( mEndEx );
 
 	while( io.ReadCSV( row ) ) {
 		if ( state == InOut::Outside ) {
-			AddVars( mBeginEx, io, row );
+			AddVars( mBeginEx, bvs, io, row );
 			if ( AtBeginBlock() ) {
 				block = ! mExclusive;
 				state = InOut::Inside;
@@ -94,7 +95,7 @@ int BlockCommand :: Execute( ALib::CommandLine & cmd ) {
 			}
 		}
 		else if ( state == InOut::Inside ) {
-			AddVars( mEndEx, io, row );
+			AddVars( mEndEx, evs, io, row );
 			if ( AtEndBlock() ) {
 				block = ! mExclusive;
 				state = InOut::Outside;
@@ -99,16 +99,9 @@ void Command :: GetSkipOptions( const ALib::CommandLine & cl ) {
 	}
 }
 
-static void SetPosParams( ALib::Expression & e, const CSVRow & r ) {
-	e.ClearPosParams();
-	for( unsigned int i = 0; i < r.size(); i++ ) {
-		e.AddPosParam( r[i] );
-	}
-}
-
 static bool EvalSkipPass( ALib::Expression & e, const CSVRow & r ) {
 	if ( e.IsCompiled() ) {
-		SetPosParams( e, r );
+		e.BindPosParams( r );
 		string ev = e.Evaluate();
 		return ev == "0" ? false : true;
 	}
@@ -125,6 +118,52 @@ bool Command :: Pass( const CSVRow & r )  {
 	return EvalSkipPass( mPassExpr, r );
 }
 
+//----------------------------------------------------------------------------
+// Batch versions of Skip() and Pass(). Rows that are skipped are not tested
+// for passing. Returns the number of rows for which the results are known -
+// if this is less than n, failed is the expression whose evaluation failed
+// for the next row.
+//----------------------------------------------------------------------------
+
+static unsigned int EvalSkipPassBatch( ALib::Expression & e,
+										const CSVTable & rows,
+										unsigned int n,
+										const ALib::Expression::Selection & sel,
+										ALib::Expression::Selection & res,
+										ALib::Expression * & failed ) {
+	res.assign( rows.size(), 0 );
+	if ( ! e.IsCompiled() ) {
+		return n;
+	}
+	vector <string> results;
+	unsigned int ok = e.EvaluateBatch( rows, n, sel, results );
+	for ( unsigned int i = 0; i < ok; i++ ) {
+		res[i] = sel[i] && results[i] != "0";
+	}
+	if ( ok < n ) {
+		failed = & e;
+	}
+	return ok;
+}
+
+bool Command :: CanBatchSkipPass() const {
+	return ! mSkipExpr.IsStateful() && ! mPassExpr.IsStateful();
+}
+
+unsigned int Command :: SkipPassBatch( const CSVTable & rows, unsigned int n,
+										ALib::Expression::Selection & skip,
+										ALib::Expression::Selection & pass,
+										ALib::Expression * & failed ) {
+	failed = 0;
+	ALib::Expression::Selection sel( rows.size(), 1 );
+	unsigned int limit = EvalSkipPassBatch( mSkipExpr, rows, n, sel,
+												skip, failed );
+	for ( unsigned int i = 0; i < limit; i++ ) {
+		sel[i] = ! skip[i];
+	}
+	return EvalSkipPassBatch( mPassExpr, rows, limit, sel, pass, failed );
+}
+
 //----------------------------------------------------------------------------
 // Process help text. May contain a terminal section preceded by a # char
 // containing names of the generic flags applicable to this command. The
@@ -13,6 +13,9 @@
 #include "csved_except.h"
 #include "csved_cli.h"
 #include "csved_strings.h"
+#include <climits>
+#include <cstdlib>
+#include <cctype>
 
 using std::string;
 using std::vector;
@@ -468,10 +471,12 @@ void MaskedDateReader :: SetMonths( const string & months ) {
 }
 
 //---------------------------------------------------------------------------
-// Read date from string and convert to date. Return true if siccesful
+// Read date from string and convert to date. Return true if siccesful.
+// The date parts are read where they lie in the string rather than being
+// copied out, as the validate command calls this for every field.
 //---------------------------------------------------------------------------
 
-bool MaskedDateReader :: Read( const string & ds, ALib::Date & date ) {
+bool MaskedDateReader :: Read( const string & ds, ALib::Date & date ) const {
 
 	ALib::STRPOS s1 = ds.find( mSep[0] );
 	ALib::STRPOS s2 = ds.find_last_of( mSep[1] );
@@ -481,18 +486,17 @@ bool MaskedDateReader :: Read( const string & ds, ALib::Date & date ) {
 		return false;
 	}
 
-	string s[3];
-	s[0] = ds.substr( 0, s1 );
-	s[1] = ds.substr( s1 + 1, (s2 - s1) - 1 );
-	s[2] = ds.substr( s2 + 1 );
+	const char * p = ds.c_str();
+	const char * b[3] = { p, p + s1 + 1, p + s2 + 1 };
+	const char * e[3] = { p + s1, p + s2, p + ds.size() };
 
 	int day = -1, month = -1, year = -1;
 
 	for ( unsigned int i = 0; i < 3; i++ ) {
 		switch( mDMY[i] ) {
-			case 'd':	MakeDay( s[i], day ); break;
-			case 'm':	MakeMonth( s[i], month ); break;
-			case 'y':	MakeYear( s[i], year ); break;
+			case 'd':	MakeDay( b[i], e[i], day ); break;
+			case 'm':	MakeMonth( b[i], e[i], month ); break;
+			case 'y':	MakeYear( b[i], e[i], year ); break;
 		}
 	}
 
@@ -506,30 +510,54 @@ bool MaskedDateReader :: Read( const string & ds, ALib::Date & date ) {
 }
 
 //---------------------------------------------------------------------------
-// If s contains valid day, convert it
+// Convert the characters from b up to e to an integer in n, with the same
+// rules as ALib::IsInteger - in particular an empty part reads as zero.
+// Returns false, leaving n alone, if they are not an integer.
 //---------------------------------------------------------------------------
 
-void MaskedDateReader :: MakeDay( const string & s, int & day  ) {
-	if ( ALib::IsInteger( s ) ) {
-		day = ALib::ToInteger( s );
+static bool ReadInt( const char * b, const char * e, int & n ) {
+	if ( b == e ) {
+		n = 0;
+		return true;
 	}
+	char * p;
+	long v = strtol( b, & p, 10 );
+	if ( p != e || v == LONG_MAX || v == LONG_MIN ) {
+		return false;
+	}
+	n = v;
+	return true;
 }
 
 //---------------------------------------------------------------------------
-// If s is integer, convert and use as month value. Otherwise see if the
-// string is the start of a date name  and us ethat.
+// If part contains valid day, convert it
 //---------------------------------------------------------------------------
 
-void MaskedDateReader :: MakeMonth( const string & s, int & month  ) {
-	if ( ALib::IsInteger( s ) ) {
-		month = ALib::ToInteger( s );
+void MaskedDateReader :: MakeDay( const char * b, const char * e,
+									int & day ) const {
+	ReadInt( b, e, day );
+}
+
+//---------------------------------------------------------------------------
+// If part is integer, convert and use as month value. Otherwise see if the
+// part is the start of a date name  and us ethat.
+//---------------------------------------------------------------------------
+
+void MaskedDateReader :: MakeMonth( const char * b, const char * e,
+									int & month ) const {
+	if ( ReadInt( b, e, month ) ) {
+		return;
 	}
-	else if ( s.size() >= 3 ) {
+	unsigned int n = e - b;
+	if ( n >= 3 ) {
 		for ( unsigned int i = 0; i < 12; i++ ) {
-			string ms = mMonthNames.At(i);
-			if ( ms.size() >= s.size() ) {
-				ms = ms.substr( 0, s.size() );
-				if ( ALib::Equal( ms, s ) ) {
+			const string & ms = mMonthNames.At(i);
+			if ( ms.size() >= n ) {
+				unsigned int j = 0;
+				while( j < n && toupper( ms[j] ) == toupper( b[j] ) ) {
+					j++;
+				}
+				if ( j == n ) {
 					month = i + 1;
 					return;
 				}
@@ -539,14 +567,15 @@ void MaskedDateReader :: MakeMonth( const string & s, int & month  ) {
 }
 
 //---------------------------------------------------------------------------
-// Convert string to year, handling 2 digit wrap
+// Convert part to year, handling 2 digit wrap
 //---------------------------------------------------------------------------
 
-void MaskedDateReader :: MakeYear( const string & s, int & year  ) {
-	if ( s.size() == 2 || s.size() == 4 ) {
-		if ( ALib::IsInteger( s ) ) {
-			year = ALib::ToInteger( s );
-			if ( s.size() == 2 ) {
+void MaskedDateReader :: MakeYear( const char * b, const char * e,
+									int & year ) const {
+	unsigned int n = e - b;
+	if ( n == 2 || n == 4 ) {
+		if ( ReadInt( b, e, year ) ) {
+			if ( n == 2 ) {
 				if ( year < mYearBase - 1900 ) {
 					year += 2000;
 				}
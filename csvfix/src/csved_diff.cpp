@@ -3,56 +3,68 @@
 //
 // diff two csv files.
 //
-// This code is adapted from that presented in this article:
+// Positional diffs reduce each row to a 64-bit fingerprint of the compared
+// fields and run Myers' O(ND) algorithm, in its linear space form, over
+// the fingerprints. The rows themselves are only re-read to print the
+// report. The result spans and report format were originally adapted
+// from this article:
 //
 //    http://www.codeproject.com/KB/recipes/diffengine.aspx
 //
-// I'm still in the process of converting it, but the current code
-// does work. Lack of comments is my fault.
-//
 // Copyright (C) 2009 Neil Butterworth
 //---------------------------------------------------------------------------
 
 #include "a_base.h"
 #include "a_collect.h"
+#include "a_hashset.h"
 #include "csved_cli.h"
 #include "csved_diff.h"
 #include "csved_strings.h"
 
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <memory>
 using std::string;
 
 namespace CSVED {
 
-const int BAD_INDEX = -1;
-
+//----------------------------------------------------------------------------
+// Rows of one input, held as fingerprints. When the input can be rewound
+// the rows are re-read from it on demand, which is cheap as the report
+// asks for them in order - otherwise (e.g. a pipe) we must keep them.
 //----------------------------------------------------------------------------
 
+typedef unsigned long long Fingerprint;
+typedef std::vector <Fingerprint> Fingerprints;
+
 class CSVList {
 
 	public:
 
-		CSVList() {
-		}
+		CSVList( IOManager & io, unsigned int index );
 
 		unsigned int Count() const {
-			return mRows.size();
+			return mPrints.size();
 		}
 
-		void Add( const CSVRow  & row ) {
-				mRows.push_back( row );
+		const Fingerprints & Prints() const {
+			return mPrints;
 		}
 
-		const CSVRow & At( unsigned int i ) const {
-			return mRows.at( i );
-		}
+		void Add( Fingerprint fp, const CSVRow & row );
+		const CSVRow & At( unsigned int i );
 
 	private:
 
+		IOManager & mIO;
+		unsigned int mIndex;
+		bool mRewind;
+		Fingerprints mPrints;
 		std::vector <CSVRow> mRows;
-
+		std::unique_ptr <ALib::CSVStreamParser> mParser;
+		CSVRow mRow;
+		unsigned int mRead;
 };
 
 //----------------------------------------------------------------------------
@@ -104,98 +116,66 @@ typedef std::vector <ResultSpan> Results;
 
 //----------------------------------------------------------------------------
 
-enum DiffStatus {
-		dsMatched = 1,
-		dsNoMatch = -1,
-		dsUnknown = -2
-};
-
-
-class State {
+class Differ {
 
 	public:
 
-		State() : mStart( BAD_INDEX ), mLen( dsUnknown ) {
-		}
-
-		int Start() const { return mStart; }
-		int End() const { return mStart + mLen - 1; }
-		int Length() const {
-			if ( mLen > 0 ) {
-				return mLen;
-			}
-			else {
-				return mLen == 0 ? 1 : 0;
-			}
-		}
-
-		DiffStatus Status() const {
-			if ( mLen > 0 ) {
-				return dsMatched;
-			}
-			else if ( mLen == -1 ) {
-				return dsNoMatch;
-			}
-			else {
-				return dsUnknown;
-			}
-		}
-
-		void SetMatch( int start, int len ) {
-			mStart = start;
-			mLen = len;
-		}
-
-		void SetNoMatch() {
-			mStart = BAD_INDEX;
-			mLen = dsNoMatch;
-		}
+		Differ( const DiffCommand * cmd );
+		void Read( IOManager & io, unsigned int index, CSVList & list );
+		Results Diff( const Fingerprints & src, const Fingerprints & dest );
+		void Display( const Results & r, IOManager & io,
+						CSVList & src, CSVList & dest ) const;
 
-		bool HasValidLength( int start, int end, int maxposs ) {
-			if ( mLen > 0) {
-				if ( maxposs < mLen || mStart  < start || End() > end ) {
-					* this = State(); // reset
-				}
-			}
-			return ( mLen != dsUnknown );
-		}
+		static bool Same( const Results & r );
 
 	private:
 
-		int mStart, mLen;
+		Fingerprint Print( const CSVRow & row );
+		void Compare( int sstart, int send, int dstart, int dend );
+		bool Bisect( int sstart, int send, int dstart, int dend,
+						int & x, int & y );
+		bool AddChanges( Results & r, int dest, int nextdest,
+							int src, int nextsrc );
+		Results MakeReport();
 
+		const Fingerprints * mSrc;
+		const Fingerprints * mDest;
+		Results mMatches;
+		std::vector <int> mFwd, mRev;
+		std::vector <Fingerprint> mHashes;
+		string mScratch;
+		const DiffCommand * mCmd;
 };
 
-typedef std::vector <State> StateList;
-
+//----------------------------------------------------------------------------
+// Diff of two files sorted on key fields. Both files are streamed and
+// merged on the key, so only the current row of each is held in memory.
 //----------------------------------------------------------------------------
 
-class Differ {
+class KeyedDiffer {
 
 	public:
 
-		Differ( const DiffCommand * cmd );
-		Results Diff( const CSVList & src, const CSVList & dest );
-		void Display( const Results & r, IOManager & io ) const;
-
-		static bool Same( const Results & r );
+		KeyedDiffer( const DiffCommand * cmd, IOManager & io );
+		bool Diff();
 
 	private:
 
+		enum { SRC = 0, DEST = 1 };
 
-		void ProcessRange( int dstart, int dend, int sstart, int send );
-		int SourceMatchLen( int di, int si, int maxlen ) const;
-		void LongestSourceMatch( State & curitem, int di,int dend, int sstart,int send) const;
-		bool AddChanges( Results & r, int dest, int nextdest, int src, int nextsrc );
-		Results MakeReport();
-
-		bool NotEq( const CSVRow & src, const CSVRow & dest ) const;
+		bool Next( int side );
+		int CmpKeys() const;
+		bool Changed( std::string & fields ) const;
+		void Report( const std::string & ind, int side,
+						const std::string & fields = "" );
 
-		const CSVList * mSrc;
-		const CSVList * mDest;
-		Results mMatches;
-		StateList mStates;
 		const DiffCommand * mCmd;
+		IOManager & mIO;
+		std::unique_ptr <ALib::CSVStreamParser> mParser[2];
+		CSVRow mRow[2];
+		std::vector <std::string> mKey[2], mNewKey;
+		bool mHave[2];
+		unsigned int mRecNo[2];
 };
 
 
@@ -221,6 +201,8 @@ const char * const DIFF_HELP = {
 	"  -q\t\tdo not report, only return same/different status\n"
 	"  -ic\t\tignore case when diffing\n"
 	"  -is\t\tignore leading and trailing spaces when diffing\n"
+	"  -k fields\tinputs are sorted on these key fields - diff by key,\n"
+	"\t\treporting changed rows as < and > with the changed fields\n"
 	"#ALL"
 };
 
@@ -236,24 +218,11 @@ DiffCommand :: DiffCommand( const string & name, const string & desc )
 	AddFlag( ALib::CommandLineFlag( FLAG_QUIET, false, 0 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_ICASE, false, 0 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_ISPACE, false, 0 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_KEY, false, 1 ) );
 
 
 }
 
-//----------------------------------------------------------------------------
-// Helper to read the indexed input stream into a CSVList
-//----------------------------------------------------------------------------
-
-static void ReadCSV( IOManager & io, int index, CSVList & csvlist ) {
-
-	std::unique_ptr<ALib::CSVStreamParser> p( io.CreateStreamParser( index ) );
-
-	CSVRow row;
-	while( p->ParseNext( row ) ) {
-		csvlist.Add( row );
-	}
-}
-
 //----------------------------------------------------------------------------
 // Read the two input files (source and destination in the parlance of the
 // adapted code) and produce a diff. Diff format is currently of my
@@ -268,16 +237,20 @@ int DiffCommand :: Execute( ALib::CommandLine & cmd ) {
 		CSVTHROW( "diff needs two input files" );
 	}
 
-	CSVList src, dest;
-	ReadCSV( io, 0, src );
-	ReadCSV( io, 1, dest );
+	if ( mKeys.size() ) {
+		KeyedDiffer kd( this, io );
+		return kd.Diff() ? 0 : 1;
+	}
 
 	Differ differ( this );
+	CSVList src( io, 0 ), dest( io, 1 );
+	differ.Read( io, 0, src );
+	differ.Read( io, 1, dest );
 
-	const Results & r = differ.Diff( src, dest );
+	const Results & r = differ.Diff( src.Prints(), dest.Prints() );
 
 	if ( mReport ) {
-		differ.Display( r, io );
+		differ.Display( r, io, src, dest );
 	}
 
 	return Differ::Same( r ) ? 0 : 1;
@@ -296,175 +269,269 @@ void DiffCommand :: ProcessFlags( ALib::CommandLine & cmd ) {
 		ALib::CommaList cl( cmd.GetValue( FLAG_COLS ) );
 		CommaListToIndex( cl, mFields );
 	}
+	if ( cmd.HasFlag( FLAG_KEY ) ) {
+		ALib::CommaList kl( cmd.GetValue( FLAG_KEY ) );
+		CommaListToIndex( kl, mKeys );
+	}
 }
 
-
+//----------------------------------------------------------------------------
+// Input rows - the stream can be rewound if it knows its position.
 //----------------------------------------------------------------------------
 
-Differ :: Differ ( const DiffCommand * cmd ) : mSrc( 0 ), mDest( 0 ), mCmd( cmd ) {
+CSVList :: CSVList( IOManager & io, unsigned int index )
+	: mIO( io ), mIndex( index ),
+	  mRewind( io.In( index ).tellg() != std::streampos( -1 ) ),
+	  mRead( 0 ) {
 }
 
-
-Results Differ :: Diff( const CSVList & src, const CSVList & dest ) {
-
-	mSrc = & src;
-	mDest = & dest;
-	mMatches = Results();
-	Results r;
-
-	int sz = dest.Count();
-	if ( sz && src.Count() ) {
-		mStates = StateList( sz );
-		ProcessRange( 0, sz - 1, 0, src.Count() - 1 );
-		r = MakeReport();
+void CSVList :: Add( Fingerprint fp, const CSVRow & row ) {
+	mPrints.push_back( fp );
+	if ( ! mRewind ) {
+		mRows.push_back( row );
 	}
-	return r;
 }
 
-
 //----------------------------------------------------------------------------
-// Helper to compare strings possibly uppercased and trimmed
+// Get row by index, re-reading the input. Going backwards means starting
+// again from the beginning, but Display never does that.
 //----------------------------------------------------------------------------
 
-static bool Cmp( const string & src, const string & dest, bool ic, bool is ) {
-	string s = src, d = dest;
-	if ( ic ) {
-		s = ALib::Upper( s );
-		d = ALib::Upper( d );
+const CSVRow & CSVList :: At( unsigned int i ) {
+	if ( ! mRewind ) {
+		return mRows.at( i );
 	}
-	if ( is ) {
-		s = ALib::Trim( s );
-		d = ALib::Trim( d );
+	if ( mParser.get() == 0 || i + 1 < mRead ) {
+		std::istream & is = mIO.In( mIndex );
+		is.clear();
+		is.seekg( 0 );
+		mParser.reset( mIO.CreateStreamParser( mIndex ) );
+		mRead = 0;
 	}
-	return s != d;
+	while( mRead <= i ) {
+		if ( ! mParser->ParseNext( mRow ) ) {
+			CSVTHROW( "Input changed during diff: "
+						<< mIO.InFileName( mIndex ) );
+		}
+		mRead++;
+	}
+	return mRow;
+}
+
+//----------------------------------------------------------------------------
+
+Differ :: Differ ( const DiffCommand * cmd )
+	: mSrc( 0 ), mDest( 0 ), mCmd( cmd ) {
 }
 
 //----------------------------------------------------------------------------
-// Helper to do comparison possibly using user supplied field list
+// Normalise string by uppercasing and trimming, as required, into n. This
+// avoids allocating for every field when fingerprinting.
 //----------------------------------------------------------------------------
 
-bool Differ :: NotEq( const CSVRow & src, const CSVRow & dest ) const {
-	if ( mCmd->mFields.size() ) {
-		for ( unsigned int  i = 0; i < mCmd->mFields.size(); i++ ) {
-			string ss = GetField( src,  mCmd->mFields[i]  );
-			string ds = GetField( dest,  mCmd->mFields[i]  );
-			if ( Cmp( ss, ds, mCmd->mIgnoreCase, mCmd->mTrim )) {
-				return true;
-			}
-		}
-		return false;
+const char * const SPACES = " \t\n\r";
+
+static void NormaliseInto( const string & s, bool ic, bool is, string & n ) {
+	n.assign( s );
+	if ( is ) {
+		string::size_type end = n.find_last_not_of( SPACES );
+		n.erase( end == string::npos ? 0 : end + 1 );
+		n.erase( 0, n.find_first_not_of( SPACES ) );
 	}
-	else {
-		unsigned int sz = std::max( src.size(), dest.size() );
-		for ( unsigned int  i = 0; i < sz; i++ ) {
-			string ss = GetField( src,  i  );
-			string ds = GetField( dest,  i  );
-			if ( Cmp( ss, ds, mCmd->mIgnoreCase, mCmd->mTrim )) {
-				return true;
-			}
+	if ( ic ) {
+		for ( unsigned int i = 0; i < n.size(); i++ ) {
+			n[i] = toupper( (unsigned char) n[i] );
 		}
-		return false;
 	}
 }
 
+static string Normalise( const string & s, bool ic, bool is ) {
+	string n;
+	NormaliseInto( s, ic, is, n );
+	return n;
+}
 
+//----------------------------------------------------------------------------
+// Helper to compare strings possibly uppercased and trimmed
 //----------------------------------------------------------------------------
 
-int Differ :: SourceMatchLen( int di, int si, int maxlen ) const {
-	int matchcount = 0;
-	for ( ; matchcount < maxlen; matchcount++ ) {
-		if ( NotEq( mDest->At( di + matchcount), mSrc->At( si + matchcount ) ) ) {
-			break;
-		}
-	}
-	return matchcount;
+static bool Cmp( const string & src, const string & dest, bool ic, bool is ) {
+	return Normalise( src, ic, is ) != Normalise( dest, ic, is );
 }
 
-void Differ :: LongestSourceMatch( State & curitem, int di,int dend,
-										int sstart,int send) const {
-
-	int maxdestlen = (dend - di) + 1;
-	int bestlen = 0;
-	int besti = -1;
+//----------------------------------------------------------------------------
+// Fingerprint a row by hashing the hashes of the normalised fields, using
+// the user supplied field list if there is one. When comparing all fields
+// missing fields are treated as empty, so trailing empty fields must not
+// change the fingerprint.
+//----------------------------------------------------------------------------
 
-	for ( int si = sstart; si <= send; si++ ) {
-		int maxlen = std::min(maxdestlen,(send - si) + 1);
-		if ( maxlen <= bestlen ) {
-			//No chance to find a longer one any more
-			break;
+Fingerprint Differ :: Print( const CSVRow & row ) {
+	const FieldList & fl = mCmd->mFields;
+	unsigned int n = fl.size() ? fl.size() : row.size();
+	unsigned int used = 0;
+	mHashes.resize( n );
+	for ( unsigned int i = 0; i < n; i++ ) {
+		unsigned int f = fl.size() ? fl[i] : i;
+		NormaliseInto( f < row.size() ? row[f] : "",
+							mCmd->mIgnoreCase, mCmd->mTrim, mScratch );
+		mHashes[i] = ALib::HashBytes( mScratch.data(), mScratch.size() );
+		if ( fl.size() || mScratch.size() ) {
+			used = i + 1;
 		}
-		int curlen = SourceMatchLen( di, si, maxlen );
-		if ( curlen > bestlen ) {
-			//This is the best match so far
-			besti = si;
-			bestlen = curlen;
-		}
-		//jump over the match
-		si += bestlen;
 	}
+	return ALib::HashBytes( used ? (const char *) & mHashes[0] : "",
+								used * sizeof( Fingerprint ) );
+}
 
-	//DiffState cur = _stateList.GetByIndex(destIndex);
-	if ( besti == -1) {
-		curitem.SetNoMatch();
-	}
-	else {
-		curitem.SetMatch( besti, bestlen);
+//----------------------------------------------------------------------------
+// Read the input for a list, fingerprinting each row.
+//----------------------------------------------------------------------------
+
+void Differ :: Read( IOManager & io, unsigned int index, CSVList & list ) {
+	std::unique_ptr <ALib::CSVStreamParser> p( io.CreateStreamParser( index ) );
+	CSVRow row;
+	while( p->ParseNext( row ) ) {
+		list.Add( Print( row ), row );
 	}
 }
 
-void Differ :: ProcessRange(int dstart, int dend, int sstart, int send)  {
+//----------------------------------------------------------------------------
+// Diff two lists of fingerprints, producing the matching spans and then
+// the report of changes between them.
+//----------------------------------------------------------------------------
 
-	State curstate, beststate;
+Results Differ :: Diff( const Fingerprints & src, const Fingerprints & dest ) {
+	mSrc = & src;
+	mDest = & dest;
+	mMatches = Results();
+	Compare( 0, src.size(), 0, dest.size() );
+	return MakeReport();
+}
 
-	int bestlen = -1, bestindex = -1;
-	for ( int di = dstart; di <= dend; di++ ) {
-		int maxposlen = (dend - di) + 1;
-		if ( maxposlen <= bestlen )	{
-			//we won't find a longer one even if we looked
-			break;
-		}
+//----------------------------------------------------------------------------
+// Find the matches in source range [sstart,send) and destination range
+// [dstart,dend). Common prefixes and suffixes are matched directly, which
+// deals quickly with the usual case of a few changes in large files, and
+// what is left is split at the middle of an optimal edit path and each
+// half dealt with recursively.
+//----------------------------------------------------------------------------
 
-		curstate = mStates.at( di );		// ***** PROBLEMO ******
+void Differ :: Compare( int sstart, int send, int dstart, int dend ) {
+	const Fingerprints & src = * mSrc, & dest = * mDest;
+	int n = 0;
+	while( sstart + n < send && dstart + n < dend
+				&& src[sstart + n] == dest[dstart + n] ) {
+		n++;
+	}
+	if ( n ) {
+		mMatches.push_back( ResultSpan( eaNoChange, dstart, sstart, n ) );
+		sstart += n;
+		dstart += n;
+	}
+	n = 0;
+	while( send - n > sstart && dend - n > dstart
+				&& src[send - n - 1] == dest[dend - n - 1] ) {
+		n++;
+	}
+	if ( n ) {
+		send -= n;
+		dend -= n;
+		mMatches.push_back( ResultSpan( eaNoChange, dend, send, n ) );
+	}
+	int x, y;
+	if ( sstart < send && dstart < dend
+			&& Bisect( sstart, send, dstart, dend, x, y ) ) {
+		Compare( sstart, sstart + x, dstart, dstart + y );
+		Compare( sstart + x, send, dstart + y, dend );
+	}
+}
 
-		if ( ! curstate.HasValidLength(sstart , send, maxposlen ) ) {
-			//recalc new best length since it isn't valid or has never been done.
-			LongestSourceMatch( curstate, di, dend, sstart, send);
-		}
+//----------------------------------------------------------------------------
+// Myers' middle snake search. Paths are extended forward from the start
+// and backward from the end of the ranges, one edit at a time, until they
+// overlap - the overlap point (x,y), relative to the range starts, lies
+// on an optimal path. Returns false if the ranges have nothing in common.
+//----------------------------------------------------------------------------
 
-		if ( curstate.Status() == dsMatched ) {
-			if ( curstate.Length() > bestlen ) {
-				//this is longest match so far
-				bestindex = di;
-				bestlen = curstate.Length();
-				beststate = curstate;
+bool Differ :: Bisect( int sstart, int send, int dstart, int dend,
+						int & x, int & y ) {
+	const Fingerprint * src = & (* mSrc)[sstart];
+	const Fingerprint * dest = & (* mDest)[dstart];
+	const int slen = send - sstart, dlen = dend - dstart;
+	const int maxd = (slen + dlen + 1) / 2;
+	const int off = maxd + 1;
+	const int delta = slen - dlen;
+	const bool front = delta % 2 != 0;
+
+	mFwd.assign( 2 * maxd + 3, -1 );
+	mRev.assign( 2 * maxd + 3, -1 );
+	mFwd[off + 1] = 0;
+	mRev[off + 1] = 0;
+
+	// diagonals that have run off the edges are trimmed from the search
+
+	int fstart = 0, fend = 0, rstart = 0, rend = 0;
+
+	for ( int d = 0; d < maxd; d++ ) {
+		for ( int k = -d + fstart; k <= d - fend; k += 2 ) {
+			int x1 = ( k == -d || ( k != d && mFwd[off + k - 1]
+											< mFwd[off + k + 1] ) )
+						? mFwd[off + k + 1] : mFwd[off + k - 1] + 1;
+			int y1 = x1 - k;
+			while( x1 < slen && y1 < dlen && src[x1] == dest[y1] ) {
+				x1++;
+				y1++;
 			}
-		}
-	}
-
-	if ( bestindex >=  0 ) {
-		int si = beststate.Start();
-		mMatches.push_back( ResultSpan( eaNoChange, bestindex, si ,bestlen));
-		if ( dstart < bestindex ) {
-			//Still have more lower destination data
-			if ( sstart < si ) 	{
-				//Still have more lower source data
-				// Recursive call to process lower indexes
-				ProcessRange( dstart, bestindex - 1, sstart, si - 1 );
+			mFwd[off + k] = x1;
+			if ( x1 > slen ) {
+				fend += 2;
+			}
+			else if ( y1 > dlen ) {
+				fstart += 2;
+			}
+			else if ( front ) {
+				int rk = off + delta - k;
+				if ( rk >= 0 && rk < (int) mRev.size() && mRev[rk] != -1
+						&& x1 >= slen - mRev[rk] ) {
+					x = x1;
+					y = y1;
+					return true;
+				}
 			}
 		}
-		int udstart = bestindex + bestlen;
-		int usstart = si + bestlen;
-		if ( dend > udstart ) 		{
-			//we still have more upper dest data
-			if ( send > udstart ) {
-				//set still have more upper source data
-				// Recursive call to process upper indexes
-				ProcessRange( udstart, dend, usstart, send );
+		for ( int k = -d + rstart; k <= d - rend; k += 2 ) {
+			int x2 = ( k == -d || ( k != d && mRev[off + k - 1]
+											< mRev[off + k + 1] ) )
+						? mRev[off + k + 1] : mRev[off + k - 1] + 1;
+			int y2 = x2 - k;
+			while( x2 < slen && y2 < dlen
+					&& src[slen - x2 - 1] == dest[dlen - y2 - 1] ) {
+				x2++;
+				y2++;
+			}
+			mRev[off + k] = x2;
+			if ( x2 > slen ) {
+				rend += 2;
+			}
+			else if ( y2 > dlen ) {
+				rstart += 2;
+			}
+			else if ( ! front ) {
+				int fk = off + delta - k;
+				if ( fk >= 0 && fk < (int) mFwd.size() && mFwd[fk] != -1
+						&& mFwd[fk] >= slen - x2 ) {
+					x = mFwd[fk];
+					y = x - ( fk - off );
+					return true;
+				}
 			}
 		}
 	}
+	return false;
 }
 
+
 bool Differ :: AddChanges( Results & report, int dest, int nextdest,
 								int src, int nextsrc ) {
 
@@ -506,8 +573,8 @@ bool Differ :: AddChanges( Results & report, int dest, int nextdest,
 Results Differ ::  MakeReport()	{
 
 	Results res;
-	int dcount = mDest->Count();
-	int scount = mSrc->Count();
+	int dcount = mDest->size();
+	int scount = mSrc->size();
 
 	//Deal with the special case of empty files
 	if ( dcount == 0 )	{
@@ -527,20 +594,18 @@ Results Differ ::  MakeReport()	{
 
 	int dest = 0;
 	int src = 0;
-	ResultSpan * last = 0;
 
 	for ( unsigned int i = 0; i < mMatches.size(); i++ ) {
-		ResultSpan & drs = mMatches[i];
+		const ResultSpan & drs = mMatches[i];
 		if ( (! AddChanges( res, dest, drs.mDestIndex, src, drs.mSrcIndex ))
-				&& last != 0 ) {
-			last->IncLen( drs.mLen );
+				&& res.size() && res.back().mAction == eaNoChange ) {
+			res.back().IncLen( drs.mLen );
 		}
 		else {
 			res.push_back( drs );
 		}
 		dest = drs.mDestIndex + drs.mLen;
 		src = drs.mSrcIndex + drs.mLen;
-		last = & drs;
 	}
 	AddChanges( res, dest, dcount, src, scount);
 
@@ -552,32 +617,31 @@ static string Indicator( const string & ic, int index ) {
 
 }
 
-void Differ :: Display( const Results & r, IOManager & io ) const {
+void Differ :: Display( const Results & r, IOManager & io,
+							CSVList & src, CSVList & dest ) const {
 	for ( unsigned int i = 0; i < r.size(); i++ ) {
 		const ResultSpan & rs = r[i];
 		if ( rs.mAction == eaNoChange ) {
-			for ( int i = 0; i < rs.mLen; i++ ) {
-			}
-
+			continue;
 		}
 		else if ( rs.mAction == eaAddDest ) {
 			for ( int i = 0; i < rs.mLen; i++ ) {
 				io.Out() << Indicator( "+", rs.mDestIndex + i );
-				io.WriteRow( mDest->At( rs.mDestIndex + i ) );
+				io.WriteRow( dest.At( rs.mDestIndex + i ) );
 			}
 		}
 		else if ( rs.mAction == eaDelSrc ) {
 			for ( int i = 0; i < rs.mLen; i++ ) {
 				io.Out() << Indicator( "-", rs.mSrcIndex + i );
-				io.WriteRow( mSrc->At( rs.mSrcIndex + i ) );
+				io.WriteRow( src.At( rs.mSrcIndex + i ) );
 			}
 		}
 		else if ( rs.mAction == eaReplace ) {
 			for ( int i = 0; i < rs.mLen; i++ ) {
 				io.Out() << Indicator( "-", rs.mSrcIndex + i );
-				io.WriteRow( mSrc->At( rs.mSrcIndex + i ) );
+				io.WriteRow( src.At( rs.mSrcIndex + i ) );
 				io.Out() << Indicator( "+", rs.mDestIndex + i );
-				io.WriteRow( mDest->At( rs.mDestIndex + i ) );
+				io.WriteRow( dest.At( rs.mDestIndex + i ) );
 			}
 		}
 		else {
@@ -586,8 +650,139 @@ void Differ :: Display( const Results & r, IOManager & io ) const {
 	}
 }
 
+//----------------------------------------------------------------------------
+// Files are the same if there is nothing but unchanged spans - this
+// includes the case where both files are empty.
+//----------------------------------------------------------------------------
+
 bool Differ :: Same( const Results & r ) {
-	return r.size() == 1 && r[0].mAction == eaNoChange;
+	for ( unsigned int i = 0; i < r.size(); i++ ) {
+		if ( r[i].mAction != eaNoChange ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// Keyed diff - open parsers on both inputs and read the first row of each.
+//----------------------------------------------------------------------------
+
+KeyedDiffer :: KeyedDiffer( const DiffCommand * cmd, IOManager & io )
+	: mCmd( cmd ), mIO( io ) {
+	for ( int side = SRC; side <= DEST; side++ ) {
+		mParser[side].reset( io.CreateStreamParser( side ) );
+		mRecNo[side] = 0;
+		mHave[side] = false;
+	}
+}
+
+//----------------------------------------------------------------------------
+// Read next row from one side and build its normalised key. Keys must
+// never decrease, or the merge would report rows as missing that are
+// merely out of place.
+//----------------------------------------------------------------------------
+
+bool KeyedDiffer :: Next( int side ) {
+	mHave[side] = mParser[side]->ParseNext( mRow[side] );
+	if ( ! mHave[side] ) {
+		return false;
+	}
+	mRecNo[side]++;
+	std::vector <string> & key = mNewKey;
+	key.resize( mCmd->mKeys.size() );
+	for ( unsigned int i = 0; i < mCmd->mKeys.size(); i++ ) {
+		key[i] = Normalise( GetField( mRow[side], mCmd->mKeys[i] ),
+								mCmd->mIgnoreCase, mCmd->mTrim );
+	}
+	if ( mRecNo[side] > 1 && key < mKey[side] ) {
+		CSVTHROW( "Input not sorted on key fields at record "
+					<< mRecNo[side] << " of " << mIO.InFileName( side ) );
+	}
+	mKey[side].swap( key );
+	return true;
+}
+
+int KeyedDiffer :: CmpKeys() const {
+	if ( mKey[SRC] < mKey[DEST] ) {
+		return -1;
+	}
+	return mKey[DEST] < mKey[SRC] ? 1 : 0;
+}
+
+//----------------------------------------------------------------------------
+// See if rows with same key differ in the compared fields, which are the
+// -f fields or all non-key fields. Changed field numbers go in fields.
+//----------------------------------------------------------------------------
+
+bool KeyedDiffer :: Changed( string & fields ) const {
+	const CSVRow & src = mRow[SRC], & dest = mRow[DEST];
+	unsigned int n = mCmd->mFields.size()
+						? mCmd->mFields.size()
+						: std::max( src.size(), dest.size() );
+	fields = "";
+	for ( unsigned int i = 0; i < n; i++ ) {
+		unsigned int f = mCmd->mFields.size() ? mCmd->mFields[i] : i;
+		if ( mCmd->mFields.empty() && std::find( mCmd->mKeys.begin(),
+						mCmd->mKeys.end(), f ) != mCmd->mKeys.end() ) {
+			continue;
+		}
+		if ( Cmp( GetField( src, f ), GetField( dest, f ),
+					mCmd->mIgnoreCase, mCmd->mTrim ) ) {
+			fields += (fields.empty() ? "" : ",") + ALib::Str( f + 1 );
+		}
+	}
+	return ! fields.empty();
+}
+
+void KeyedDiffer :: Report( const string & ind, int side,
+								const string & fields ) {
+	if ( mCmd->mReport ) {
+		mIO.Out() << Indicator( ind, mRecNo[side] - 1 );
+		if ( fields != "" ) {
+			mIO.Out() << "\"" << fields << "\",";
+		}
+		mIO.WriteRow( mRow[side] );
+	}
+}
+
+//----------------------------------------------------------------------------
+// Merge the two inputs on key. Rows only in the source are reported as
+// removed, those only in the destination as added. When reporting is off
+// we can stop at the first difference. Returns true if files are same.
+//----------------------------------------------------------------------------
+
+bool KeyedDiffer :: Diff() {
+	bool same = true;
+	string fields;
+	Next( SRC );
+	Next( DEST );
+	while( mHave[SRC] || mHave[DEST] ) {
+		int c = ! mHave[DEST] ? -1 : ( ! mHave[SRC] ? 1 : CmpKeys() );
+		if ( c < 0 ) {
+			Report( "-", SRC );
+			Next( SRC );
+			same = false;
+		}
+		else if ( c > 0 ) {
+			Report( "+", DEST );
+			Next( DEST );
+			same = false;
+		}
+		else {
+			if ( Changed( fields ) ) {
+				Report( "<", SRC, fields );
+				Report( ">", DEST, fields );
+				same = false;
+			}
+			Next( SRC );
+			Next( DEST );
+		}
+		if ( ! same && ! mCmd->mReport ) {
+			break;
+		}
+	}
+	return same;
 }
 
 //----------------------------------------------------------------------------
@@ -106,6 +106,9 @@ void EditCommand :: EditRow( CSVRow & row ) {
 //		s/abc/XXX/g
 //
 // would change all occurrences of abc into XXX
+//
+// Each regex is compiled the first time it is needed and then kept, as it
+// builds up its matching tables as it is used.
 //---------------------------------------------------------------------------
 
 const char SUB_CMD 	= 's';		// substitute command
@@ -114,20 +117,23 @@ const char ALL_OPT		= 'g';		// replace all (global) option
 
 void EditCommand :: EditField( std::string & f ) {
 	for ( unsigned int i = 0; i < mSubCmds.size(); i++ ) {
-		EditSubCmd sc = mSubCmds[ i ];
+		EditSubCmd & sc = mSubCmds[ i ];
 		if ( sc.mCmd == SUB_CMD ) {
-			if ( sc.mFrom == "" ) {
-				CSVTHROW( "Need expression to search for" );
+			if ( ! sc.mCompiled ) {
+				if ( sc.mFrom == "" ) {
+					CSVTHROW( "Need expression to search for" );
+				}
+				bool icase = sc.mOpts.find( IC_OPT ) != std::string::npos ;
+				sc.mRegEx = ALib::RegEx( sc.mFrom,
+								icase ? ALib::RegEx::Insensitive
+									  : ALib::RegEx::Sensitive );
+				sc.mCompiled = true;
 			}
-			bool icase = sc.mOpts.find( IC_OPT ) != std::string::npos ;
-			ALib::RegEx r( sc.mFrom,
-							icase ? ALib::RegEx::Insensitive
-							      : ALib::RegEx::Sensitive );
 			if ( sc.mOpts.find( ALL_OPT ) != std::string::npos ) {
-				r.ReplaceAllIn( f, sc.mTo );
+				sc.mRegEx.ReplaceAllIn( f, sc.mTo );
 			}
 			else {
-				r.ReplaceIn( f, sc.mTo );
+				sc.mRegEx.ReplaceIn( f, sc.mTo );
 			}
 		}
 		else {
@@ -67,15 +67,17 @@ int EvalCommand ::	Execute( ALib::CommandLine & cmd ) {
 	mDiscardInput = cmd.HasFlag( FLAG_DISCARD );
 	GetExpressions( cmd );
 
+	if ( CanBatch() ) {
+		ExecuteBatched( io );
+		return 0;
+	}
+
 	while( io.ReadCSV( row ) ) {
 		if ( Skip( row ) ) {
 			continue;
 		}
 		if ( ! Pass( row ) ) {
 			SetParams( row, io );
-			if ( mDiscardInput ) {
-				row.clear();
-			}
 			Evaluate( row );
 		}
 
@@ -93,11 +95,15 @@ int EvalCommand ::	Execute( ALib::CommandLine & cmd ) {
 // Now need to process -if expressions. If one of these evalates to true, the
 // following -e expression is evaluated, and the one following that is
 // skipped - vice versa if it returned false.
+//
+// The expressions are bound to the input row, so all results are saved
+// and only applied to the row once every expression has been evaluated.
 //----------------------------------------------------------------------------
 
 void EvalCommand ::	Evaluate( CSVRow & row ) {
 
 	bool skipelse = false;
+	mResults.clear();
 
 	for ( unsigned int i = 0; i < mFieldExprs.size() ; i++ ) {
 		if ( mIsIf[i] ) {
@@ -117,18 +123,135 @@ void EvalCommand ::	Evaluate( CSVRow & row ) {
 		}
 
 		string r = mFieldExprs[i].mExpr.Evaluate();
-		if ( mFieldExprs[i].mField < 0 || mFieldExprs[i].mField >= (int) row.size() ) {
-			row.push_back( r );
-		}
-		else {
-			row[ mFieldExprs[i].mField ] = r;
-		}
+		mResults.push_back( std::make_pair( mFieldExprs[i].mField, r ) );
 
 		if ( skipelse ) {
 			i++;
 			skipelse = false;
 		}
 	}
+
+	ApplyResults( row );
+}
+
+//----------------------------------------------------------------------------
+// Apply saved expression results to row
+//----------------------------------------------------------------------------
+
+void EvalCommand :: ApplyResults( CSVRow & row ) {
+	if ( mDiscardInput ) {
+		row.clear();
+	}
+	for ( unsigned int i = 0; i < mResults.size(); i++ ) {
+		int field = mResults[i].first;
+		if ( field < 0 || field >= (int) row.size() ) {
+			row.push_back( mResults[i].second );
+		}
+		else {
+			row[ field ] = mResults[i].second;
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+// Rows can be evaluated in batches unless the -if option is used, which
+// would need each row to take its own path through the expressions, or
+// the expressions use the special variables, which are set for each row.
+// Calls to random() must also be made in the same order as they would be
+// for row by row evaluation.
+//----------------------------------------------------------------------------
+
+bool EvalCommand :: CanBatch() const {
+	if ( ! CanBatchSkipPass() ) {
+		return false;
+	}
+	for ( unsigned int i = 0; i < mFieldExprs.size(); i++ ) {
+		const ALib::Expression & e = mFieldExprs[i].mExpr;
+		if ( mIsIf[i] || e.UsesVars() || e.IsStateful() ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// Read and evaluate blocks of rows. If reading fails, we still process the
+// rows read so far, as we would have done when working row by row. A block
+// is cut short if more input has yet to arrive, so that rows from a pipe
+// or terminal are output as soon as they are read.
+//----------------------------------------------------------------------------
+
+void EvalCommand :: ExecuteBatched( IOManager & io ) {
+	mBatch.resize( BATCH_SIZE );
+	bool more = true;
+	while( more ) {
+		unsigned int n = 0;
+		try {
+			while( n < BATCH_SIZE ) {
+				more = io.ReadCSV( mBatch[n] );
+				if ( ! more ) {
+					break;
+				}
+				n++;
+				if ( io.InputWouldWait() ) {
+					break;
+				}
+			}
+		}
+		catch( ... ) {
+			EvaluateBatch( io, n );
+			throw;
+		}
+		EvaluateBatch( io, n );
+	}
+}
+
+//----------------------------------------------------------------------------
+// Evaluate each expression for all rows in the batch that are neither
+// skipped nor passed, and then apply the results and write the rows. If
+// evaluation failed for some row, the rows before it are written and the
+// error is reported just as it would be for row by row evaluation.
+//----------------------------------------------------------------------------
+
+void EvalCommand :: EvaluateBatch( IOManager & io, unsigned int n ) {
+
+	ALib::Expression * failed = 0;
+	unsigned int limit = SkipPassBatch( mBatch, n, mSkipped, mPassed, failed );
+
+	mSelected.assign( mBatch.size(), 0 );
+	for ( unsigned int i = 0; i < limit; i++ ) {
+		mSelected[i] = ! mSkipped[i] && ! mPassed[i];
+	}
+
+	mBatchResults.resize( mFieldExprs.size() );
+	for ( unsigned int i = 0; i < mFieldExprs.size(); i++ ) {
+		ALib::Expression & e = mFieldExprs[i].mExpr;
+		unsigned int ok = e.EvaluateBatch( mBatch, limit, mSelected,
+												mBatchResults[i] );
+		if ( ok < limit ) {
+			limit = ok;
+			failed = & e;
+		}
+	}
+
+	for ( unsigned int i = 0; i < limit; i++ ) {
+		if ( mSkipped[i] ) {
+			continue;
+		}
+		if ( mSelected[i] ) {
+			mResults.clear();
+			for ( unsigned int j = 0; j < mFieldExprs.size(); j++ ) {
+				mResults.push_back( std::make_pair( mFieldExprs[j].mField,
+													mBatchResults[j][i] ) );
+			}
+			ApplyResults( mBatch[i] );
+		}
+		io.WriteRow( mBatch[i] );
+	}
+
+	if ( failed ) {
+		failed->ThrowBatchError();
+	}
 }
 
 //----------------------------------------------------------------------------
@@ -138,8 +261,8 @@ void EvalCommand ::	Evaluate( CSVRow & row ) {
 
 void EvalCommand ::	SetParams( const CSVRow & row, IOManager & iom ) {
 	for ( unsigned int i = 0; i < mFieldExprs.size(); i++ ) {
-		ALib::Expression & e = mFieldExprs[i].mExpr;
-		AddVars( e, iom, row );
+		FieldEx & fe = mFieldExprs[i];
+		AddVars( fe.mExpr, fe.mVars, iom, row );
 	}
 }
 
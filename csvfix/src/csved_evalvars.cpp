@@ -11,14 +11,20 @@
 
 namespace CSVED {
 
-void AddVars( ALib::Expression & e, const IOManager & io, const CSVRow & row ) {
-	e.ClearPosParams();
-	e.AddVar( LINE_VAR, ALib::Str( io.CurrentLine() ));
-	e.AddVar( FILE_VAR, ALib::Str( io.CurrentFileName()));
-	e.AddVar( FIELD_VAR, ALib::Str( row.size()));
-	for ( unsigned int j = 0; j < row.size(); j++ ) {
-		e.AddPosParam( row.at( j ) );
-	}
+VarSlots GetVarSlots( ALib::Expression & e ) {
+	VarSlots vs;
+	vs.mLine = e.VarSlot( LINE_VAR );
+	vs.mFile = e.VarSlot( FILE_VAR );
+	vs.mFields = e.VarSlot( FIELD_VAR );
+	return vs;
+}
+
+void AddVars( ALib::Expression & e, const VarSlots & vs,
+				const IOManager & io, const CSVRow & row ) {
+	e.BindPosParams( row );
+	e.SetVar( vs.mLine, ALib::Str( io.CurrentLine() ));
+	e.SetVar( vs.mFile, io.CurrentFileName() );
+	e.SetVar( vs.mFields, ALib::Str( row.size()));
 }
 
 
@@ -91,7 +91,7 @@ int ExcludeCommand :: Execute( ALib::CommandLine & cmd ) {
 bool ExcludeCommand :: EvalExprOnRow( IOManager & io, const CSVRow & row ) {
 
 	if ( mExpr.IsCompiled() ) {
-		AddVars( mExpr, io, row );
+		AddVars( mExpr, mVars, io, row );
 		string s = mExpr.Evaluate();
 		return ALib::Expression::ToBool( s );
 	}
@@ -115,6 +115,7 @@ void ExcludeCommand :: ProcessFlags( const ALib::CommandLine & cmd ) {
 		if ( emsg != "" ) {
 			CSVTHROW( emsg + " " + es );
 		}
+		mVars = GetVarSlots( mExpr );
 
 	}
 	mReverse = cmd.HasFlag( FLAG_REVCOLS );
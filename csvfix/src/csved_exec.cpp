@@ -12,6 +12,9 @@
 #include "csved_exec.h"
 #include "csved_strings.h"
 
+#include <memory>
+#include <cstring>
+
 using std::string;
 using std::vector;
 
@@ -36,6 +39,11 @@ const char * const EXEC_HELP = {
 	"where flags are:\n"
 	"  -c cmd\tcommand line to execute\n"
 	"  -r\t\treplace CSV input with command output\n"
+	"  -co\t\trun command once as a co-process, writing each record to its\n"
+	"\t\tinput as a CSV line and reading one line of its output for each\n"
+	"\t\trecord - parameters are not substituted in the command\n"
+	"  -j n\t\twith -co, share records between n co-processes, keeping\n"
+	"\t\tthe output in input order (default is 1)\n"
 	"#ALL,SKIP,PASS"
 };
 
@@ -49,6 +57,8 @@ ExecCommand ::ExecCommand( const string & name,
 
 	AddFlag( ALib::CommandLineFlag( FLAG_CMD, true, 1 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_REPLACE, false, 0 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_COPROC, false, 0 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_JOBS, false, 1 ) );
 }
 
 //---------------------------------------------------------------------------
@@ -65,7 +75,20 @@ int ExecCommand :: Execute( ALib::CommandLine & cmd ) {
 	}
 	bool csv = ! cmd.HasFlag( FLAG_REPLACE );
 
+	string js = cmd.GetValue( FLAG_JOBS, "1" );
+	if ( ! ALib::IsInteger( js ) || ALib::ToInteger( js ) < 1 ) {
+		CSVTHROW( "Invalid value for " << FLAG_JOBS << ": " << js );
+	}
+	if ( cmd.HasFlag( FLAG_JOBS ) && ! cmd.HasFlag( FLAG_COPROC ) ) {
+		CSVTHROW( FLAG_JOBS << " can only be used with " << FLAG_COPROC );
+	}
+
 	IOManager io( cmd );
+	if ( cmd.HasFlag( FLAG_COPROC ) ) {
+		RunCoprocesses( io, ALib::ToInteger( js ), csv );
+		return 0;
+	}
+
 	CSVRow row;
 	ALib::Executor ex;
 
@@ -100,6 +123,114 @@ int ExecCommand :: Execute( ALib::CommandLine & cmd ) {
 	return 0;
 }
 
+//----------------------------------------------------------------------------
+// Send records to the co-processes in turn. Results are written as soon
+// as they are available in input order - a record whose result has not
+// arrived holds up those after it. Records that are passed are not sent,
+// but are written in their place in the output.
+//----------------------------------------------------------------------------
+
+void ExecCommand :: RunCoprocesses( IOManager & io, unsigned int nprocs,
+										bool csv ) {
+
+	vector <std::unique_ptr <ExecCoprocess> > procs;
+	for ( unsigned int i = 0; i < nprocs; i++ ) {
+		procs.push_back(
+			std::unique_ptr <ExecCoprocess>( new ExecCoprocess( mCmdLine ) ) );
+	}
+
+	struct Pending {
+		CSVRow mRow;
+		int mProc;		// -1 if passed
+	};
+	std::deque <Pending> pending;
+
+	CSVRow row;
+	string line, out;
+	unsigned int next = 0;
+
+	while( io.ReadCSV( row ) ) {
+		if ( Skip( row ) ) {
+			continue;
+		}
+		pending.push_back( Pending() );
+		pending.back().mProc = -1;
+		if ( ! Pass( row ) ) {
+			out.clear();
+			for ( unsigned int i = 0; i < row.size(); i++ ) {
+				if ( i ) {
+					out += ',';
+				}
+				out += ALib::CSVQuote( row[i] );
+			}
+			procs[ next ]->Send( out );
+			pending.back().mProc = next;
+			next = (next + 1) % nprocs;
+		}
+		pending.back().mRow.swap( row );
+
+		while( pending.size() ) {
+			Pending & p = pending.front();
+			if ( p.mProc < 0 ) {
+				io.WriteRow( p.mRow );
+			}
+			else if ( procs[ p.mProc ]->TryGetLine( line ) ) {
+				WriteResult( io, p.mRow, line, csv );
+			}
+			else {
+				break;
+			}
+			pending.pop_front();
+		}
+	}
+
+	for ( unsigned int i = 0; i < nprocs; i++ ) {
+		procs[i]->EndInput();
+	}
+
+	while( pending.size() ) {
+		Pending & p = pending.front();
+		if ( p.mProc < 0 ) {
+			io.WriteRow( p.mRow );
+		}
+		else if ( procs[ p.mProc ]->GetLine( line ) ) {
+			WriteResult( io, p.mRow, line, csv );
+		}
+		else {
+			CSVTHROW( "Command produced fewer lines of output than records" );
+		}
+		pending.pop_front();
+	}
+
+	for ( unsigned int i = 0; i < nprocs; i++ ) {
+		if ( procs[i]->GetLine( line ) ) {
+			CSVTHROW( "Command produced more lines of output than records" );
+		}
+		if ( procs[i]->Finish() != 0 ) {
+			CSVTHROW( "Command execution error" );
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+// Write command output for a record, appended to the record unless the
+// -r flag was used.
+//----------------------------------------------------------------------------
+
+void ExecCommand :: WriteResult( IOManager & io, const CSVRow & row,
+									const string & line, bool csv ) {
+	if ( csv ) {
+		CSVRow tmp( row ), cmdout;
+		ALib::CSVLineParser clp;
+		clp.Parse( line, cmdout );
+		ALib::operator+=( tmp, cmdout );
+		io.WriteRow( tmp );
+	}
+	else {
+		io.Out() << line << "\n";
+	}
+}
+
 //----------------------------------------------------------------------------
 // Helpers to make the command string from the -c flag value and the CSV
 // input data.
@@ -166,6 +297,194 @@ string ExecCommand :: MakeParam( const CSVRow & row, unsigned int  & pos ) {
 	}
 }
 
+//----------------------------------------------------------------------------
+// Input to a co-process is written in blocks of at least SEND_SIZE bytes,
+// and its output read in blocks of up to READ_SIZE.
+//----------------------------------------------------------------------------
+
+const unsigned int SEND_SIZE = 16 * 1024;
+const unsigned int READ_SIZE = 64 * 1024;
+
+//----------------------------------------------------------------------------
+// Start the command and the thread that reads its output
+//----------------------------------------------------------------------------
+
+ExecCoprocess :: ExecCoprocess( const string & cmd )
+	: mProc( cmd ), mInLines( 0 ), mSent( 0 ), mReceived( 0 ),
+		mEOF( false ) {
+	mThread = std::thread( &ExecCoprocess::Run, this );
+}
+
+//----------------------------------------------------------------------------
+// If we get here with the reader thread still running, something has gone
+// wrong and we may never see the end of the command's output, so the
+// command is killed rather than waited for.
+//----------------------------------------------------------------------------
+
+ExecCoprocess :: ~ExecCoprocess() {
+	if ( mThread.joinable() ) {
+		mProc.CloseInput();
+		mProc.Kill();
+		mThread.join();
+	}
+}
+
+//----------------------------------------------------------------------------
+// Buffer line of input for the command, writing the buffer when full
+//----------------------------------------------------------------------------
+
+void ExecCoprocess :: Send( const string & line ) {
+	mInBuf += line;
+	mInBuf += '\n';
+	mInLines++;
+	if ( mInBuf.size() >= SEND_SIZE ) {
+		WriteInput();
+	}
+}
+
+//----------------------------------------------------------------------------
+// Write buffered input. The lines are counted as sent before they are
+// written, so the reader thread never sees a reply to an uncounted line.
+//----------------------------------------------------------------------------
+
+void ExecCoprocess :: WriteInput() {
+	{
+		std::lock_guard <std::mutex> lock( mLock );
+		mSent += mInLines;
+	}
+	mInLines = 0;
+	mProc.Write( mInBuf.data(), mInBuf.size() );
+	mInBuf.clear();
+}
+
+//----------------------------------------------------------------------------
+// Write anything buffered and tell command there is no more input
+//----------------------------------------------------------------------------
+
+void ExecCoprocess :: EndInput() {
+	if ( mInBuf.size() ) {
+		WriteInput();
+	}
+	mProc.CloseInput();
+}
+
+//----------------------------------------------------------------------------
+// Get next line of command output. TryGetLine returns false if there is
+// none yet, GetLine waits for one and returns false at end of output. Any
+// error the reader thread had is reported once its lines are used up.
+//----------------------------------------------------------------------------
+
+bool ExecCoprocess :: TakeLine( string & line ) {
+	if ( mLines.empty() ) {
+		if ( mError ) {
+			std::rethrow_exception( mError );
+		}
+		return false;
+	}
+	line.swap( mLines.front() );
+	mLines.pop_front();
+	return true;
+}
+
+bool ExecCoprocess :: TryGetLine( string & line ) {
+	std::lock_guard <std::mutex> lock( mLock );
+	return TakeLine( line );
+}
+
+bool ExecCoprocess :: GetLine( string & line ) {
+	std::unique_lock <std::mutex> lock( mLock );
+	while( mLines.empty() && ! mEOF && ! mError ) {
+		mChanged.wait( lock );
+	}
+	return TakeLine( line );
+}
+
+//----------------------------------------------------------------------------
+// Wait for command to finish, returning its exit status. Only called once
+// all its output has been read, so the reader thread has finished.
+//----------------------------------------------------------------------------
+
+int ExecCoprocess :: Finish() {
+	mThread.join();
+	if ( mError ) {
+		std::rethrow_exception( mError );
+	}
+	return mProc.Wait();
+}
+
+//----------------------------------------------------------------------------
+// Thread reads command output until end of file. After an error, output
+// is read and discarded, so that the command is never left blocked on a
+// write while we are still writing its input.
+//----------------------------------------------------------------------------
+
+void ExecCoprocess :: Run() {
+	vector <char> buf( READ_SIZE );
+	try {
+		ReadLines( buf );
+	}
+	catch( ... ) {
+		{
+			std::lock_guard <std::mutex> lock( mLock );
+			mError = std::current_exception();
+		}
+		mChanged.notify_one();
+		try {
+			while( mProc.Read( & buf[0], READ_SIZE ) ) {
+			}
+		}
+		catch( ... ) {
+		}
+	}
+	std::lock_guard <std::mutex> lock( mLock );
+	mEOF = true;
+	mChanged.notify_one();
+}
+
+//----------------------------------------------------------------------------
+// Split command output into lines. A last line with no newline still
+// counts as a line. A command can't have replied to more lines than it
+// has been sent, so if it has we know it is producing too much output,
+// and stop now rather than queueing it all.
+//----------------------------------------------------------------------------
+
+void ExecCoprocess :: ReadLines( vector <char> & buf ) {
+	vector <string> got;
+	string part;
+	bool eof = false;
+	while( ! eof ) {
+		unsigned int n = mProc.Read( & buf[0], buf.size() );
+		const char * p = & buf[0], * end = p + n;
+		while( const char * nl = (const char *)
+							std::memchr( p, '\n', end - p ) ) {
+			part.append( p, nl - p );
+			got.push_back( string() );
+			got.back().swap( part );
+			p = nl + 1;
+		}
+		part.append( p, end - p );
+		if ( n == 0 ) {
+			eof = true;
+			if ( part.size() ) {
+				got.push_back( part );
+			}
+		}
+		if ( got.size() ) {
+			std::lock_guard <std::mutex> lock( mLock );
+			for ( unsigned int i = 0; i < got.size(); i++ ) {
+				if ( mReceived++ == mSent ) {
+					CSVTHROW( "Command produced more lines of output "
+								"than records" );
+				}
+				mLines.push_back( string() );
+				mLines.back().swap( got[i] );
+			}
+			got.clear();
+			mChanged.notify_one();
+		}
+	}
+}
+
 //------------------------------------------------------------------------
 
 } // end namespace
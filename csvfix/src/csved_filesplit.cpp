@@ -34,6 +34,16 @@ const char * const DEF_DIR 	= "";			// directory path
 const char * const DEF_PREF = "file_";		// file name prefix
 const char * const DEF_EXT 	= "csv";		// file extension
 
+//----------------------------------------------------------------------------
+// Output for a file is written when its buffer reaches OUTBUF_SIZE, or
+// when the total buffered for all files reaches MAX_PENDING. The number
+// of files kept open for writing can be changed by the user.
+//----------------------------------------------------------------------------
+
+const char * const DEF_MAXOPEN	= "100";
+const unsigned int OUTBUF_SIZE	= 64 * 1024;
+const unsigned int MAX_PENDING	= 32 * 1024 * 1024;
+
 //----------------------------------------------------------------------------
 // Help text
 //----------------------------------------------------------------------------
@@ -47,6 +57,7 @@ const char * const SPLIT_HELP = {
 	"  -fp pre\tprefix to use to generate filenames(default is file_)\n"
 	"  -fx ext\textension to use to generate filenames(default is csv)\n"
 	"  -ufn\t\tuse field content to generate filenames\n"
+	"  -maxopen n\tmaximum number of files to keep open (default is 100)\n"
 	"#IBL,SEP,IFN,SMQ,SKIP,PASS"
 };
 
@@ -56,17 +67,26 @@ const char * const SPLIT_HELP = {
 
 FileSplitCommand :: FileSplitCommand( const string & name,
 							const string & desc )
-			: Command( name, desc, SPLIT_HELP), mUseFieldNames( false ) {
+			: Command( name, desc, SPLIT_HELP), mLastFile( 0 ),
+				mPending( 0 ), mMaxOpen( 0 ), mUseFieldNames( false ) {
 
 	AddFlag( ALib::CommandLineFlag( FLAG_COLS, true, 1 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_FSPRE, false, 1 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_FSDIR, false, 1 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_FSEXT, false, 1 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_USEFLD, false, 0 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_MAXOPEN, false, 1 ) );
 
 	mFileNo = 1;
 }
 
+FileSplitCommand :: ~FileSplitCommand() {
+	for ( unsigned int i = 0; i < mFiles.size(); i++ ) {
+		delete mFiles[i]->mOut;
+		delete mFiles[i];
+	}
+}
+
 //----------------------------------------------------------------------------
 // Read input and split into separate files
 //----------------------------------------------------------------------------
@@ -79,19 +99,33 @@ int FileSplitCommand :: Execute( ALib::CommandLine & cmd ) {
 	IOManager io( cmd );
 	CSVRow row;
 
-	while( io.ReadCSV( row ) ) {
-		if ( Skip( row ) ) {
-			continue;
+	// if anything goes wrong, the rows before it must still end up in their
+	// files, as they would if we did not buffer output, but it is the
+	// original error that gets reported
+
+	try {
+		while( io.ReadCSV( row ) ) {
+			if ( Skip( row ) ) {
+				continue;
+			}
+			if ( Pass( row ) ) {
+				io.WriteRow( row  );
+			}
+			else {
+				WriteRow( io, row );
+			}
 		}
-		if ( Pass( row ) ) {
-			io.WriteRow( row  );
+	}
+	catch( ... ) {
+		try {
+			CloseAll();
 		}
-		else {
-			WriteRow( io, row );
+		catch( ... ) {
 		}
+		throw;
 	}
 
-	mOutFile.flush();
+	CloseAll();
 
 	return 0;
 }
@@ -113,33 +147,129 @@ string FileSplitCommand :: MakeKey( const CSVRow & row ) {
 
 //----------------------------------------------------------------------------
 // See if we already have a row with same key as this one. If we do, write
-// the row to the same file as the existing row, otherwise creater a new
-// file name. If the file name is the same as the the one used on the last
-// call, re-use the file else open a new one.
+// the row to the same file as the existing row, otherwise create a new
+// file name. Rows for the same key tend to come together, so we check the
+// last key used before looking in the dictionary.
+//----------------------------------------------------------------------------
+
+FileSplitCommand::OutFile * FileSplitCommand :: GetFile( const string & key ) {
+
+	if ( mLastFile && key == mLastKey ) {
+		return mLastFile;
+	}
+
+	OutFile * const * p = mDict.GetPtr( key );
+	OutFile * f = p ? * p : 0;
+
+	// several keys may generate the same file name, in which case they
+	// must share the output buffer and stream
+
+	if ( f == 0 ) {
+		string fname = NewFileName( key );
+		std::map <string, OutFile *>::iterator pos = mNames.find( fname );
+		if ( pos == mNames.end() ) {
+			f = new OutFile;
+			f->mName = fname;
+			f->mOut = 0;
+			mFiles.push_back( f );
+			mNames[ fname ] = f;
+		}
+		else {
+			f = pos->second;
+		}
+		mDict.Add( key, f );
+	}
+
+	mLastKey = key;
+	mLastFile = f;
+	return f;
+}
+
+//----------------------------------------------------------------------------
+// Add row to its file's buffer, writing the buffer if it has got big enough
 //----------------------------------------------------------------------------
 
 void FileSplitCommand :: WriteRow( IOManager & ioman, const CSVRow & row ) {
 
-	string key = MakeKey( row );
-	const string * p = mDict.GetPtr( key );
-	string fname = (p == 0) ? NewFileName( key ) : * p;
+	OutFile * f = GetFile( MakeKey( row ) );
+	const string & line = ioman.CurrentInput();
+	f->mPending += line;
+	f->mPending += '\n';
+	mPending += line.size() + 1;
+
+	if ( f->mPending.size() >= OUTBUF_SIZE ) {
+		Write( * f );
+	}
+	if ( mPending >= MAX_PENDING ) {
+		WriteAll();
+	}
+}
+
+//----------------------------------------------------------------------------
+// Write buffered output for a file. If the file is not open, open it in
+// append mode, first closing the least recently used file if too many are
+// open. Buffer memory is released, as most files will be idle for a while.
+//----------------------------------------------------------------------------
 
-	if ( p == 0 ) {
-		mDict.Add( key, fname );
+void FileSplitCommand :: Write( OutFile & f ) {
+
+	if ( f.mOut ) {
+		mOpenFiles.splice( mOpenFiles.begin(), mOpenFiles, f.mPos );
+	}
+	else {
+		if ( mOpenFiles.size() < mMaxOpen ) {
+			f.mOut = new std::ofstream;
+		}
+		else {
+			OutFile * old = mOpenFiles.back();
+			mOpenFiles.pop_back();
+			Close( * old->mOut, old->mName );
+			std::swap( f.mOut, old->mOut );
+		}
+		f.mOut->open( f.mName.c_str(), std::ios::out | std::ios::app );
+		if ( ! f.mOut->is_open() ) {
+			CSVTHROW( "Could not open file " << f.mName << " for output" );
+		}
+		mOpenFiles.push_front( & f );
+		f.mPos = mOpenFiles.begin();
 	}
 
-	if ( fname != mCurrentFile ) {
-		mOutFile.close();
-		mOutFile.clear();	// close does not reset state
-		mOutFile.open( fname.c_str(), std::ios::out | std::ios::app );   // append
+	if ( ! f.mOut->write( f.mPending.data(), f.mPending.size() ) ) {
+		CSVTHROW( "Error writing to file " << f.mName );
+	}
+	mPending -= f.mPending.size();
+	string().swap( f.mPending );
+}
 
-		if ( ! mOutFile.is_open() ) {
-			CSVTHROW( "Could not open file " << fname << " for output" );
+void FileSplitCommand :: WriteAll() {
+	for ( unsigned int i = 0; i < mFiles.size(); i++ ) {
+		if ( mFiles[i]->mPending.size() ) {
+			Write( * mFiles[i] );
 		}
-		mCurrentFile = fname;
 	}
+}
+
+//----------------------------------------------------------------------------
+// Close file, which writes anything left in the stream's buffer, and check
+// that it worked.
+//----------------------------------------------------------------------------
+
+void FileSplitCommand :: Close( std::ofstream & out, const string & fname ) {
+	out.close();
+	bool ok = ! out.fail();
+	out.clear();	// close does not reset state
+	if ( ! ok ) {
+		CSVTHROW( "Error writing to file " << fname );
+	}
+}
 
-	mOutFile << ioman.CurrentInput() << "\n";
+void FileSplitCommand :: CloseAll() {
+	WriteAll();
+	while( mOpenFiles.size() ) {
+		OutFile * f = mOpenFiles.front();
+		mOpenFiles.pop_front();
+		Close( * f->mOut, f->mName );
+	}
 }
 
 //----------------------------------------------------------------------------
@@ -181,6 +311,11 @@ void FileSplitCommand :: ProcessFlags( ALib::CommandLine & cmd ) {
 	ALib::CommaList cl( cmd.GetValue( FLAG_COLS ) );
 	CommaListToIndex( cl, mColIndex );
 	mUseFieldNames = cmd.HasFlag( FLAG_USEFLD );
+	string mo = cmd.GetValue( FLAG_MAXOPEN, DEF_MAXOPEN );
+	if ( ! ALib::IsInteger( mo ) || ALib::ToInteger( mo ) < 1 ) {
+		CSVTHROW( "Invalid value for " << FLAG_MAXOPEN << ": " << mo );
+	}
+	mMaxOpen = ALib::ToInteger( mo );
 }
 
 //----------------------------------------------------------------------------
@@ -16,6 +16,11 @@
 #include "csved_evalvars.h"
 
 #include "a_debug.h"
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+#include <iostream>
+#include <sstream>
 
 using std::string;
 using std::vector;
@@ -52,9 +57,15 @@ const char * const FIND_HELP = {
 	"  -r range\trange to search for - multiple -r flags are allowed\n"
 	"  -ei expr\tas for -e flag, but search ignoring case\n"
 	"  -si expr\tas for -e flag, but don't treat expr as regex\n"
+	"  -sf file\tas for -s, but read strings from file, one per line\n"
+	"  -vf file[:f]\tmatch fields exactly equal to a value in field f\n"
+	"\t\t(default 1) of CSV file - multiple -vf flags are allowed\n"
+	"  -vfi file[:f]\tas for -vf, but ignore case\n"
 	"  -n\t\toutput count of matched rows only\n"
 	"  -l length\tsearch for fields of given length (may be a range)\n"
 	"  -if expr\tonly output line if eval expression evaluates to true\n"
+	"  -adapt\t\treorder field tests on how often they match\n"
+	"  -explain\twrite the test plan, with match counts, to stderr\n"
 };
 
 const char * const REMOVE_HELP = {
@@ -68,9 +79,15 @@ const char * const REMOVE_HELP = {
 	"  -r range\trange to search for - multiple -r flags are allowed\n"
 	"  -ei expr\tas for -e flag, but search ignoring case\n"
 	"  -si expr\tas for -e flag, but don't treat expr as regex\n"
+	"  -sf file\tas for -s, but read strings from file, one per line\n"
+	"  -vf file[:f]\tmatch fields exactly equal to a value in field f\n"
+	"\t\t(default 1) of CSV file - multiple -vf flags are allowed\n"
+	"  -vfi file[:f]\tas for -vf, but ignore case\n"
 	"  -n\t\toutput count of non-matching rows only\n"
 	"  -l length\t search for fields of given length (may be a range)\n"
 	"  -if expr\tdon't output line if eval expression evaluates to true\n"
+	"  -adapt\t\treorder field tests on how often they match\n"
+	"  -explain\twrite the test plan, with match counts, to stderr\n"
 };
 
 //------------------------------------------------------------------------
@@ -81,7 +98,9 @@ FindCommand :: FindCommand( const string & name,
 							const string & desc )
 
 		: Command( name, desc ), mRemove( name == CMD_REMOVE ),
-			mCountOnly( false ),
+			mCountOnly( false ), mValuesIC( true ), mHaveValues( false ),
+			mExprStep( STEP_EXPR, 0 ), mExprFirst( false ), mAdapt( false ),
+			mRowsToAdapt( 0 ),
 			mMinFields( 0 ), mMaxFields( INT_MAX ) {
 
 	AddFlag( ALib::CommandLineFlag( FLAG_COLS, false, 1 ) );
@@ -90,10 +109,15 @@ FindCommand :: FindCommand( const string & name,
 	AddFlag( ALib::CommandLineFlag( FLAG_RANGE, false, 1 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_EXPRIC, false, 1, true ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_STRIC, false, 1, true ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_SFILE, false, 1, true ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_VFILE, false, 1, true ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_VFILEIC, false, 1, true ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_NUM, false, 0 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_LEN, false, 1 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_FCOUNT, false, 1 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_IF, false, 1 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_ADAPT, false, 0 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_EXPLAIN, false, 0 ) );
 }
 
 //---------------------------------------------------------------------------
@@ -135,6 +159,7 @@ int FindCommand :: Execute( ALib::CommandLine & cmd ) {
 	ALib::CommaList cl( cmd.GetValue( FLAG_COLS ) );
 	CommaListToIndex( cl, mColIndex );
 	CreateRegExes( cmd );
+	CreateValueSets( cmd );
 	CreateRanges( cmd );
 	CreateLengths( cmd );
 	CreateFieldCounts( cmd );
@@ -145,6 +170,7 @@ int FindCommand :: Execute( ALib::CommandLine & cmd ) {
 		if ( emsg != "" ) {
 			CSVTHROW( emsg + " " + e );
 		}
+		mEvalVars = GetVarSlots( mEvalExpr );
 
 	}
 
@@ -157,93 +183,363 @@ int FindCommand :: Execute( ALib::CommandLine & cmd ) {
 					<< ", " << FLAG_LEN
 					<< ", " << FLAG_FCOUNT
 					<< ", " << FLAG_IF
+					<< ", " << FLAG_VFILE
 					<< " or "<< FLAG_EXPRIC << " flag" );
 	}
 
 	mCountOnly = cmd.HasFlag( FLAG_NUM );
+	CreatePlan( cmd );
 
 	IOManager io( cmd );
 	CSVRow row;
 
-	unsigned int count = 0;
-	while( io.ReadCSV( row ) ) {
-		if ( mEvalExpr.IsCompiled() ) {
-			AddVars( mEvalExpr, io, row );
-			bool es = ALib::Expression::ToBool( mEvalExpr.Evaluate() );
-			if ( (es && mRemove) || (!es && !mRemove)) {
+	mCount = 0;
+	if ( mEvalExpr.IsCompiled() && ! mEvalExpr.UsesVars() ) {
+		ExecuteBatched( io );
+	}
+	else {
+		while( io.ReadCSV( row ) ) {
+			if ( mExprFirst && ! TestExpr( io, row ) ) {
 				continue;
 			}
-		}
-		// check field count is in range and remove if necessary
-		if ( cmd.HasFlag( FLAG_FCOUNT ) ) {
-			bool fcok = int(row.size()) >= mMinFields
-							&& int(row.size()) <= mMaxFields;
-			if ( (mRemove && fcok) || ( ! mRemove && ! fcok ) ) {
+			if ( ! PassRow( row ) ) {
 				continue;
 			}
+			if ( mEvalExpr.IsCompiled() && ! mExprFirst
+					&& ! TestExpr( io, row ) ) {
+				continue;
+			}
+			OutputRow( io, row );
+		}
+	}
+
+	if ( mCountOnly ) {			// count is not CSV
+		io.Out() << mCount << "\n";
+	}
+
+	if ( cmd.HasFlag( FLAG_EXPLAIN ) ) {
+		io.Out().flush();
+		ExplainPlan( std::cerr );
+	}
+
+	return 0;
+}
+
+//---------------------------------------------------------------------------
+// Rough relative costs of the tests, used to order the plan. Field tests
+// are charged per field they are applied to.
+//---------------------------------------------------------------------------
+
+const unsigned int FCOUNT_COST = 1;
+const unsigned int LENGTH_COST = 1;
+const unsigned int STRRANGE_COST = 2;
+const unsigned int VALUES_COST = 4;
+const unsigned int NUMRANGE_COST = 6;
+const unsigned int REGEX_COST = 10;
+const unsigned int EXPR_COST = 50;
+
+// rows between reorderings of the field tests in adaptive mode
+const unsigned long ADAPT_ROWS = 1000;
+
+//---------------------------------------------------------------------------
+// Compile the tests into a plan. A row must pass the field count test
+// before we look at its fields, and the -if expression is evaluated last
+// unless it has state, in which case it must see every row.
+//---------------------------------------------------------------------------
+
+void FindCommand :: CreatePlan( const ALib::CommandLine & cmd ) {
+
+	mFieldPlan.clear();
+	if ( mLengths.size() ) {
+		mFieldPlan.push_back( PlanStep( STEP_LENGTH,
+									LENGTH_COST * mLengths.size() ) );
+	}
+	if ( mStrRanges.size() ) {
+		mFieldPlan.push_back( PlanStep( STEP_STRRANGE,
+									STRRANGE_COST * mStrRanges.size() ) );
+	}
+	if ( mHaveValues ) {
+		mFieldPlan.push_back( PlanStep( STEP_VALUES, VALUES_COST ) );
+	}
+	if ( mNumRanges.size() ) {
+		mFieldPlan.push_back( PlanStep( STEP_NUMRANGE,
+									NUMRANGE_COST + mNumRanges.size() ) );
+	}
+	if ( mExprs.Size() ) {
+		mFieldPlan.push_back( PlanStep( STEP_REGEX, REGEX_COST ) );
+	}
+	std::stable_sort( mFieldPlan.begin(), mFieldPlan.end(), CheaperStep );
+
+	mRowPlan.clear();
+	if ( cmd.HasFlag( FLAG_FCOUNT ) ) {
+		mRowPlan.push_back( PlanStep( STEP_FCOUNT, FCOUNT_COST ) );
+	}
+	if ( HaveRegex() ) {
+		unsigned int cost = 0;
+		for ( unsigned int i = 0; i < mFieldPlan.size(); i++ ) {
+			cost += mFieldPlan[i].mCost;
+		}
+		mRowPlan.push_back( PlanStep( STEP_FIELDS, cost ) );
+	}
+
+	mExprStep = PlanStep( STEP_EXPR, EXPR_COST );
+	mExprFirst = mEvalExpr.IsCompiled() && mEvalExpr.IsStateful();
+	mAdapt = cmd.HasFlag( FLAG_ADAPT );
+	mRowsToAdapt = ADAPT_ROWS;
+}
+
+//---------------------------------------------------------------------------
+// Order plan steps on their estimated cost
+//---------------------------------------------------------------------------
+
+bool FindCommand :: CheaperStep( const PlanStep & a, const PlanStep & b ) {
+	return a.mCost < b.mCost;
+}
+
+//---------------------------------------------------------------------------
+// Order plan steps on cost per match so far, which is the best order for
+// tests where the first match wins. Steps that have not matched yet go
+// last, keeping their current order.
+//---------------------------------------------------------------------------
+
+static double CostPerMatch( unsigned int cost, unsigned long tries,
+								unsigned long hits ) {
+	return hits ? double( cost ) * tries / hits : DBL_MAX;
+}
+
+bool FindCommand :: BetterStep( const PlanStep & a, const PlanStep & b ) {
+	return CostPerMatch( a.mCost, a.mTries, a.mHits )
+				< CostPerMatch( b.mCost, b.mTries, b.mHits );
+}
+
+void FindCommand :: AdaptPlan() {
+	std::stable_sort( mFieldPlan.begin(), mFieldPlan.end(), BetterStep );
+	mRowsToAdapt = ADAPT_ROWS;
+}
+
+//---------------------------------------------------------------------------
+// Describe the plan, in the order the steps were last applied, together
+// with how many times each step was tried and how many times it matched.
+//---------------------------------------------------------------------------
+
+string FindCommand :: StepName( const PlanStep & step ) const {
+	std::ostringstream os;
+	switch( step.mKind ) {
+		case STEP_FCOUNT:
+			os << "field count " << mMinFields << ":" << mMaxFields;
+			break;
+		case STEP_FIELDS:
+			os << "any of fields ";
+			if ( mColIndex.size() == 0 ) {
+				os << "(all)";
+			}
+			for ( unsigned int i = 0; i < mColIndex.size(); i++ ) {
+				os << (i ? "," : "") << mColIndex[i] + 1;
+			}
+			os << " matches";
+			break;
+		case STEP_EXPR:
+			os << FLAG_IF << " expression";
+			break;
+		case STEP_LENGTH:
+			os << "length (" << mLengths.size() << ")";
+			break;
+		case STEP_NUMRANGE:
+			os << "numeric range (" << mNumRanges.size() << ")";
+			break;
+		case STEP_STRRANGE:
+			os << "string range (" << mStrRanges.size() << ")";
+			break;
+		case STEP_VALUES:
+			os << "value set (" << mValues.Size() + mValuesIC.Size() << ")";
+			break;
+		case STEP_REGEX:
+			os << "regex or string (" << mExprs.Size() << ")";
+			break;
+	}
+	os << " - tried " << step.mTries << ", matched " << step.mHits;
+	return os.str();
+}
 
+void FindCommand :: ExplainPlan( std::ostream & os ) const {
+	os << (mRemove ? CMD_REMOVE : CMD_FIND) << " plan:\n";
+	vector <const PlanStep *> steps;
+	if ( mEvalExpr.IsCompiled() && mExprFirst ) {
+		steps.push_back( & mExprStep );
+	}
+	for ( unsigned int i = 0; i < mRowPlan.size(); i++ ) {
+		steps.push_back( & mRowPlan[i] );
+	}
+	if ( mEvalExpr.IsCompiled() && ! mExprFirst ) {
+		steps.push_back( & mExprStep );
+	}
+	for ( unsigned int i = 0; i < steps.size(); i++ ) {
+		os << "  " << i + 1 << ". " << StepName( * steps[i] ) << "\n";
+		if ( steps[i]->mKind == STEP_FIELDS ) {
+			for ( unsigned int j = 0; j < mFieldPlan.size(); j++ ) {
+				os << "       " << char( 'a' + j ) << ". "
+					<< StepName( mFieldPlan[j] ) << "\n";
+			}
 		}
+	}
+}
+
+//---------------------------------------------------------------------------
+// If the -if expression doesn't use the special variables, which are set
+// for each row, we can read blocks of rows and evaluate the expression for
+// the whole block at once. Rows before any failure are still processed
+// before the error is reported, as they would be when working row by row.
+// Blocks are cut short when input from a pipe or terminal has to wait.
+//---------------------------------------------------------------------------
 
-		bool match = HaveRegex() ? MatchRow( row ) : ! mRemove;
-		if ( mRemove ^ match ) {		// only one must be true
-			count++;
-			if ( ! mCountOnly ) {
-				io.WriteRow( row );
+void FindCommand :: ExecuteBatched( IOManager & io ) {
+	mBatch.resize( BATCH_SIZE );
+	mAll.resize( BATCH_SIZE );
+	bool more = true;
+	while( more ) {
+		unsigned int n = 0;
+		try {
+			while( n < BATCH_SIZE ) {
+				more = io.ReadCSV( mBatch[n] );
+				if ( ! more ) {
+					break;
+				}
+				n++;
+				if ( io.InputWouldWait() ) {
+					break;
+				}
 			}
 		}
+		catch( ... ) {
+			FilterBatch( io, n );
+			throw;
+		}
+		FilterBatch( io, n );
 	}
+}
 
-	if ( mCountOnly ) {			// count is not CSV
-		io.Out() << count << "\n";
+//---------------------------------------------------------------------------
+// The cheap tests are applied first, and the expression is only evaluated
+// for rows that pass them.
+//---------------------------------------------------------------------------
+
+void FindCommand :: FilterBatch( IOManager & io, unsigned int n ) {
+	for ( unsigned int i = 0; i < n; i++ ) {
+		mAll[i] = mExprFirst || PassRow( mBatch[i] );
+	}
+	unsigned int ok = mEvalExpr.SelectBatch( mBatch, n, mAll, mSelected );
+	for ( unsigned int i = 0; i < ok; i++ ) {
+		if ( ! mAll[i] ) {
+			continue;
+		}
+		mExprStep.mTries++;
+		if ( mSelected[i] ) {
+			mExprStep.mHits++;
+		}
+		if ( (mRemove ^ (bool) mSelected[i])
+				&& ( ! mExprFirst || PassRow( mBatch[i] ) ) ) {
+			OutputRow( io, mBatch[i] );
+		}
 	}
+	if ( ok < n ) {
+		mEvalExpr.ThrowBatchError();
+	}
+}
 
-	return 0;
+//---------------------------------------------------------------------------
+// Test a single row against the -if expression. Find wants rows where it
+// is true, remove those where it is false.
+//---------------------------------------------------------------------------
+
+bool FindCommand :: TestExpr( IOManager & io, CSVRow & row ) {
+	AddVars( mEvalExpr, mEvalVars, io, row );
+	mExprStep.mTries++;
+	bool es = ALib::Expression::ToBool( mEvalExpr.Evaluate() );
+	if ( es ) {
+		mExprStep.mHits++;
+	}
+	return es != mRemove;
 }
 
+//---------------------------------------------------------------------------
+// Apply the field count and field tests to a row. For find every test
+// must match, for remove none may.
+//---------------------------------------------------------------------------
+
+bool FindCommand :: PassRow( CSVRow & row ) {
+	for ( unsigned int i = 0; i < mRowPlan.size(); i++ ) {
+		PlanStep & step = mRowPlan[i];
+		step.mTries++;
+		bool hit;
+		if ( step.mKind == STEP_FCOUNT ) {
+			hit = int(row.size()) >= mMinFields
+					&& int(row.size()) <= mMaxFields;
+		}
+		else {
+			hit = MatchRow( row );
+		}
+		if ( hit ) {
+			step.mHits++;
+		}
+		if ( hit == mRemove ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------
+// Row has passed all tests
+//---------------------------------------------------------------------------
+
+void FindCommand :: OutputRow( IOManager & io, CSVRow & row ) {
+	mCount++;
+	if ( ! mCountOnly ) {
+		io.WriteRow( row );
+	}
+}
 
 //----------------------------------------------------------------------------
 // Has user specified some sort of regexor range?
 //----------------------------------------------------------------------------
 
 bool FindCommand :: HaveRegex() const {
-	return mExprs.size() != 0 || mRanges.size() != 0  || mLengths.size() != 0;
+	return mExprs.Size() != 0 || mNumRanges.size() != 0
+			|| mStrRanges.size() != 0 || mLengths.size() != 0
+			|| mHaveValues;
 }
 
 //---------------------------------------------------------------------------
-// Try to match 's' against all compiled regexes.
+// Try to match 's' against all compiled regexes. The regex set scans the
+// string once, however many regexes and strings we are looking for.
 //---------------------------------------------------------------------------
 
 bool FindCommand :: TryAllRegExes( const string & s ) {
-	for ( unsigned int i = 0; i < mExprs.size(); i++ ) {
-		ALib::RegEx::Pos pos = mExprs[i]->FindIn( s );
-		if ( pos.Found() ) {
-			return true;
-		}
-	}
-	return false;
+	return mExprs.FindIn( s );
 }
 
 //----------------------------------------------------------------------------
-// Try to match 's' against available ranges.
+// Try to match 's' against available ranges. The bounds of numeric ranges
+// were converted when the ranges were created.
 //----------------------------------------------------------------------------
 
-bool FindCommand :: TryAllRanges( const string & s ) {
-	for ( unsigned int i = 0; i < mRanges.size(); i++ ) {
-		if ( mRanges[i].mIsNum ) {
-			if ( ALib::IsNumber( s ) ) {
-				double ds = ALib::ToReal( s );
-				double d1 = ALib::ToReal( mRanges[i].mRange.first );
-				double d2 = ALib::ToReal( mRanges[i].mRange.second );
-				if ( ds >= d1 && ds <= d2 ) {
-					return true;
-				}
-			}
+bool FindCommand :: TryNumRanges( const string & s ) {
+	double ds;
+	if ( ! ALib::ParseReal( s, ds ) ) {
+		return false;
+	}
+	for ( unsigned int i = 0; i < mNumRanges.size(); i++ ) {
+		if ( ds >= mNumRanges[i].first && ds <= mNumRanges[i].second ) {
+			return true;
 		}
-		else {
-			if ( s >= mRanges[i].mRange.first
-					&& s <= mRanges[i].mRange.second ) {
-				return true;
-			}
+	}
+	return false;
+}
+
+bool FindCommand :: TryStrRanges( const string & s ) {
+	for ( unsigned int i = 0; i < mStrRanges.size(); i++ ) {
+		if ( s >= mStrRanges[i].first && s <= mStrRanges[i].second ) {
+			return true;
 		}
 	}
 	return false;
@@ -264,22 +560,99 @@ bool FindCommand :: TryAllLengths( const string & s ) {
 }
 
 //---------------------------------------------------------------------------
-// Match a row using column index info
+// Match a row using column index info. In adaptive mode, the field tests
+// are reordered every so often on how well they have done so far.
 //---------------------------------------------------------------------------
 
 bool FindCommand :: MatchRow( CSVRow & row ) {
-	for ( unsigned int i = 0; i < row.size(); i++ ) {
-		if ( mColIndex.size() == 0 || ALib::Contains( mColIndex, i ) ) {
-			if ( TryAllRegExes( row[i] )
-					|| TryAllRanges( row[i] )
-					|| TryAllLengths( row[i] ) ) {
+	if ( mAdapt && --mRowsToAdapt == 0 ) {
+		AdaptPlan();
+	}
+	if ( mColIndex.size() == 0 ) {
+		for ( unsigned int i = 0; i < row.size(); i++ ) {
+			if ( MatchField( row[i] ) ) {
 				return true;
 			}
 		}
 	}
+	else {
+		for ( unsigned int i = 0; i < mColIndex.size(); i++ ) {
+			if ( mColIndex[i] < row.size()
+					&& MatchField( row[ mColIndex[i] ] ) ) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+//---------------------------------------------------------------------------
+// Apply field tests in plan order - the first to match wins. The regexes
+// cannot handle characters outside the ASCII range and report an error
+// for them, so a field containing such characters is tried against the
+// regexes first, as it always was, rather than having the error hidden
+// by a cheaper test that happens to match.
+//---------------------------------------------------------------------------
+
+static bool HasNonASCII( const string & s ) {
+	for ( unsigned int i = 0; i < s.size(); i++ ) {
+		if ( (unsigned char) s[i] > 127 ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FindCommand :: MatchField( const string & s ) {
+	unsigned int done = mFieldPlan.size();		// step already tried
+	if ( mExprs.Size() && mFieldPlan[0].mKind != STEP_REGEX
+			&& HasNonASCII( s ) ) {
+		done = 0;
+		while( mFieldPlan[ done ].mKind != STEP_REGEX ) {
+			done++;
+		}
+		if ( RunStep( mFieldPlan[ done ], s ) ) {
+			return true;
+		}
+	}
+	for ( unsigned int i = 0; i < mFieldPlan.size(); i++ ) {
+		if ( i != done && RunStep( mFieldPlan[i], s ) ) {
+			return true;
+		}
+	}
 	return false;
 }
 
+//---------------------------------------------------------------------------
+// Apply single field test, counting tries and matches
+//---------------------------------------------------------------------------
+
+bool FindCommand :: RunStep( PlanStep & step, const string & s ) {
+	step.mTries++;
+	bool hit = false;
+	switch( step.mKind ) {
+		case STEP_LENGTH:	hit = TryAllLengths( s ); break;
+		case STEP_STRRANGE:	hit = TryStrRanges( s ); break;
+		case STEP_VALUES:	hit = TryAllValues( s ); break;
+		case STEP_NUMRANGE:	hit = TryNumRanges( s ); break;
+		case STEP_REGEX:	hit = TryAllRegExes( s ); break;
+		default:			break;
+	}
+	if ( hit ) {
+		step.mHits++;
+	}
+	return hit;
+}
+
+//----------------------------------------------------------------------------
+// See if s is exactly equal to one of the values read with -vf or -vfi
+//----------------------------------------------------------------------------
+
+bool FindCommand :: TryAllValues( const string & s ) {
+	return (mValues.Size() && mValues.Contains( s ))
+			|| (mValuesIC.Size() && mValuesIC.Contains( s ));
+}
+
 //----------------------------------------------------------------------------
 // Templated helper to check valid range
 //----------------------------------------------------------------------------
@@ -388,9 +761,8 @@ void FindCommand :: CreateRanges( const ALib::CommandLine & cmd ) {
 		}
 
 		bool isnum = false;
-		if ( ALib::IsNumber( rs[0] ) && ALib::IsNumber(rs[1])) {
-			double d1 = ALib::ToReal( rs[0] );
-			double d2 = ALib::ToReal( rs[1] );
+		double d1, d2;
+		if ( ALib::ParseReal( rs[0], d1 ) && ALib::ParseReal( rs[1], d2 ) ) {
 			CheckRange( d1, d2 );
 			isnum = true;
 		}
@@ -398,19 +770,25 @@ void FindCommand :: CreateRanges( const ALib::CommandLine & cmd ) {
 			CheckRange(  rs[0], rs[1]);
 		}
 
-		mRanges.push_back( Range( std::make_pair( rs[0], rs[1] ), isnum ));
+		if ( isnum ) {
+			mNumRanges.push_back( std::make_pair( d1, d2 ) );
+		}
+		else {
+			mStrRanges.push_back( std::make_pair( rs[0], rs[1] ) );
+		}
 	}
 }
 
 //---------------------------------------------------------------------------
-// Get regexes from command line and compile them. Three flags are possible;
-// -e (normal regex), -ei (ignore case regex), -si (respect case, not regex)
+// Get regexes from command line and compile them. Four flags are possible;
+// -e (normal regex), -ei (ignore case regex), -s and -si (respect case,
+// not regex). Strings can also be read from a file with -sf.
 //---------------------------------------------------------------------------
 
 void FindCommand :: CreateRegExes( const ALib::CommandLine & cmd ) {
 	for ( int i = 2; i < cmd.Argc(); i++ ) {	// skip exe name & command
 		string flag = cmd.Argv( i );
-		if ( flag != FLAG_EXPR && flag != FLAG_STR
+		if ( flag != FLAG_EXPR && flag != FLAG_STR && flag != FLAG_SFILE
 				&& flag != FLAG_EXPRIC  && flag != FLAG_STRIC ) {
 			continue;
 		}
@@ -419,25 +797,100 @@ void FindCommand :: CreateRegExes( const ALib::CommandLine & cmd ) {
 		}
 
 		string es = cmd.Argv( ++i );	// get expr and skip it
-		ALib::RegEx::CaseSense cs = (flag == FLAG_STR || flag == FLAG_EXPR
-										|| flag == FLAG_STRIC )
-									? ALib::RegEx::Sensitive
-									: ALib::RegEx::Insensitive;
+		if ( flag == FLAG_SFILE ) {
+			ReadLiterals( es );
+		}
+		else if ( flag == FLAG_STRIC || flag == FLAG_STR ) {
+			mExprs.AddLiteral( es );
+		}
+		else {
+			mExprs.Add( ALib::RegEx( es, flag == FLAG_EXPR
+											? ALib::RegEx::Sensitive
+											: ALib::RegEx::Insensitive ) );
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+// Read strings to search for from file, one per line. Blank lines are
+// ignored, as they would otherwise match everything.
+//----------------------------------------------------------------------------
+
+void FindCommand :: ReadLiterals( const string & fname ) {
+	std::ifstream ifs( fname.c_str() );
+	if ( ! ifs.is_open() ) {
+		CSVTHROW( "Cannot open file " << fname << " for input" );
+	}
+	string line;
+	while( std::getline( ifs, line ) ) {
+		if ( line.size() && line[line.size() - 1] == '\r' ) {
+			line.erase( line.size() - 1 );
+		}
+		if ( line != "" ) {
+			mExprs.AddLiteral( line );
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+// Get the value files specified with -vf and -vfi. All case sensitive values
+// go into one set and all insensitive ones into another.
+//----------------------------------------------------------------------------
+
+void FindCommand :: CreateValueSets( const ALib::CommandLine & cmd ) {
+	for ( int i = 2; i < cmd.Argc(); i++ ) {	// skip exe name & command
+		string flag = cmd.Argv( i );
+		if ( flag != FLAG_VFILE && flag != FLAG_VFILEIC ) {
+			continue;
+		}
+		if ( i == cmd.Argc() - 1 ) {
+			CSVTHROW( "No file name following " << flag << " flag" );
+		}
+		ReadValues( cmd.Argv( ++i ), flag == FLAG_VFILE ? mValues : mValuesIC );
+		mHaveValues = true;
+	}
+}
+
+//----------------------------------------------------------------------------
+// Read values from a CSV file. The file name may be followed by a colon and
+// the index of the field to use, which is otherwise the first.
+//----------------------------------------------------------------------------
 
-		ALib::RegEx * rep = new ALib::RegEx( flag == FLAG_STRIC || flag == FLAG_STR
-												? ALib::RegEx::Escape( es )
-												: es, cs );
-		mExprs.push_back( rep );
+void FindCommand :: ReadValues( const string & spec, ALib::StringSet & vs ) {
+	string fname = spec;
+	unsigned int field = 0;
+	string::size_type pos = spec.find_last_of( ':' );
+	if ( pos != string::npos && ALib::IsInteger( spec.substr( pos + 1 ) ) ) {
+		int n = ALib::ToInteger( spec.substr( pos + 1 ) );
+		if ( n <= 0 ) {
+			CSVTHROW( "Invalid field index in " << spec );
+		}
+		fname = spec.substr( 0, pos );
+		field = n - 1;
+	}
+
+	std::ifstream ifs( fname.c_str() );
+	if ( ! ifs.is_open() ) {
+		CSVTHROW( "Cannot open file " << fname << " for input" );
+	}
+	ALib::CSVStreamParser p( ifs );
+	CSVRow row;
+	while( p.ParseNext( row ) ) {
+		if ( field < row.size() ) {
+			vs.Add( row[field] );
+		}
 	}
 }
 
 //---------------------------------------------------------------------------
-// Free compiled regexes
+// Free compiled regexes and value sets
 //---------------------------------------------------------------------------
 
 void FindCommand :: Clear() {
-	ALib::FreePtrs( mExprs );
-	mExprs.clear();
+	mExprs.Clear();
+	mValues.Clear();
+	mValuesIC.Clear();
+	mHaveValues = false;
 	mColIndex.clear();
 }
 
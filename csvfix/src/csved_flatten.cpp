@@ -85,12 +85,13 @@ int FlattenCommand :: MDFlatten( ALib::CommandLine & cmd ) {
 
 	ALib::Expression e;
 	e.Compile( mMasterExpr );
+	VarSlots vs = GetVarSlots( e );
 
 	while( io.ReadCSV( row ) ) {
 		if ( Skip( row ) ) {
 			continue;
 		}
-		AddVars( e, io, row );
+		AddVars( e, vs, io, row );
 		if ( ALib::Expression::ToBool( e.Evaluate() ) ) { // it's a master
 			master = row;
 		}
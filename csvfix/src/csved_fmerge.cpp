@@ -15,6 +15,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <algorithm>
 
 using std::string;
 
@@ -38,6 +39,7 @@ const char * const FMERGE_HELP = {
 	"usage: csvfix fmerge [flags] file ...\n"
 	"where flags are:\n"
 	"  -f fields\tfields to compare when merging (default all)\n"
+	"  -bg\t\tread ahead from inputs using background threads\n"
 	"#ALL"
 };
 
@@ -46,9 +48,10 @@ const char * const FMERGE_HELP = {
 //----------------------------------------------------------------------------
 
 FMergeCommand :: FMergeCommand( const string & name, const string & desc )
-				: Command( name, desc, FMERGE_HELP ) {
+				: Command( name, desc, FMERGE_HELP ), mBackground( false ) {
 
 	AddFlag( ALib::CommandLineFlag( FLAG_COLS, false, 1 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_BGREAD, false, 0 ) );
 
 }
 
@@ -60,7 +63,7 @@ int FMergeCommand :: Execute( ALib::CommandLine & cmd ) {
 
 	ProcessFlags( cmd );
 	IOManager io( cmd );
-	MinFinder mf( io, mFields );
+	MinFinder mf( io, mFields, mBackground );
 
 	CSVRow row;
 
@@ -77,6 +80,8 @@ int FMergeCommand :: Execute( ALib::CommandLine & cmd ) {
 
 void FMergeCommand :: ProcessFlags( ALib::CommandLine & cmd ) {
 
+	mBackground = cmd.HasFlag( FLAG_BGREAD );
+
 	if ( cmd.HasFlag( FLAG_COLS ) ) {
 		ALib::CommaList cl( cmd.GetValue( FLAG_COLS ) );
 		CommaListToIndex( cl, mFields );
@@ -84,14 +89,33 @@ void FMergeCommand :: ProcessFlags( ALib::CommandLine & cmd ) {
 }
 
 //----------------------------------------------------------------------------
-// Create row getters for all input sources
+// Create row getters for all input sources, read the first row from each
+// and play the initial tournament. The tree starts out full of a dummy
+// input (numbered one past the last) that beats everything, so replaying
+// each real input in turn pushes the dummies out.
 //----------------------------------------------------------------------------
 
-MinFinder :: MinFinder( IOManager & io, const FieldList & f ) : mFields( f ){
+MinFinder :: MinFinder( IOManager & io, const FieldList & f, bool background )
+	: mFields( f ) {
 
-	for ( unsigned int i = 0; i < io.InStreamCount(); i++ ) {
-		mGetters.push_back( new RowGetter( io.CreateStreamParser( i ) ));
+	std::sort( mFields.begin(), mFields.end() );
+	mFields.erase( std::unique( mFields.begin(), mFields.end() ),
+						mFields.end() );
 
+	unsigned int n = io.InStreamCount();
+	for ( unsigned int i = 0; i < n; i++ ) {
+		mGetters.push_back(
+			new RowGetter( io.CreateStreamParser( i ), background ) );
+	}
+	mRows.resize( n );
+	mKeys.resize( n );
+	mHave.resize( n );
+	for ( unsigned int i = 0; i < n; i++ ) {
+		Advance( i );
+	}
+	mTree.assign( n, n );
+	for ( unsigned int i = n; i > 0; i-- ) {
+		Replay( i - 1 );
 	}
 }
 
@@ -106,76 +130,171 @@ MinFinder :: ~MinFinder() {
 }
 
 //----------------------------------------------------------------------------
-// Find least row and return it
+// Get next row from input and make its key
 //----------------------------------------------------------------------------
 
-bool MinFinder :: FindMin( CSVRow & rmin ) {
+void MinFinder :: Advance( unsigned int i ) {
+	mHave[i] = mGetters[i]->Next( mRows[i] );
+	if ( mHave[i] ) {
+		MakeKey( i );
+	}
+}
 
-	CSVRow row;
-	int gi = -1;
+//----------------------------------------------------------------------------
+// The key is the compared fields, each followed by a zero and a one byte,
+// with any zero byte in a field escaped as a zero and 0xFF. Comparing keys
+// then gives the same order as comparing the fields one by one. When all
+// fields are compared, missing fields count as empty, so trailing empty
+// fields are left out.
+//----------------------------------------------------------------------------
 
-	for ( unsigned int i = 0; i < mGetters.size(); i++ ) {
-		bool ok = mGetters[i]->Get( row );
-		if ( ok ) {
-			if ( gi == -1 ||  CmpRow( row, rmin, mFields ) < 1 ) {
-				rmin = row;
-				gi = i;
+void MinFinder :: MakeKey( unsigned int i ) {
+	const CSVRow & row = mRows[i];
+	string & key = mKeys[i];
+	key.clear();
+	unsigned int n = mFields.size() ? mFields.size() : row.size();
+	while( mFields.empty() && n && row[n - 1].empty() ) {
+		n--;
+	}
+	for ( unsigned int j = 0; j < n; j++ ) {
+		unsigned int fi = mFields.size() ? mFields[j] : j;
+		if ( fi < row.size() ) {
+			const string & f = row[fi];
+			if ( f.find( '\0' ) == string::npos ) {
+				key += f;
+			}
+			else {
+				for ( unsigned int k = 0; k < f.size(); k++ ) {
+					key += f[k];
+					if ( f[k] == '\0' ) {
+						key += '\xff';
+					}
+				}
 			}
 		}
+		key.append( "\0\1", 2 );
 	}
+}
 
-	if ( gi >= 0 ) {
-		mGetters[gi]->ClearLatch();
-	}
+//----------------------------------------------------------------------------
+// Does input a's current row come before b's? The dummy input comes
+// before everything and exhausted inputs after everything. On equal keys
+// the later input wins, which is the order merging has always used.
+//----------------------------------------------------------------------------
 
-	return gi >= 0;
+bool MinFinder :: Less( unsigned int a, unsigned int b ) const {
+	const unsigned int dummy = mGetters.size();
+	if ( a == dummy || b == dummy ) {
+		return a == dummy;
+	}
+	if ( ! mHave[a] || ! mHave[b] ) {
+		return mHave[a];
+	}
+	int cmp = mKeys[a].compare( mKeys[b] );
+	return cmp == 0 ? a > b : cmp < 0;
 }
 
+//----------------------------------------------------------------------------
+// Replay matches on the path from input i's leaf to the root, leaving the
+// loser at each node and taking the winner up to the next.
+//----------------------------------------------------------------------------
+
+void MinFinder :: Replay( unsigned int i ) {
+	unsigned int winner = i;
+	for ( unsigned int t = (i + mTree.size()) / 2; t > 0; t /= 2 ) {
+		if ( Less( mTree[t], winner ) ) {
+			std::swap( winner, mTree[t] );
+		}
+	}
+	mTree[0] = winner;
+}
 
 //----------------------------------------------------------------------------
-// Getter encapsulates  astream parser and a latched input row
+// Find least row and return it. The row is swapped out rather than copied
+// and only the winning input's path is replayed.
 //----------------------------------------------------------------------------
 
-RowGetter :: RowGetter( ALib::CSVStreamParser * p )
-				: mParser( p ), mDone( false ), mHave( false ) {
+bool MinFinder :: FindMin( CSVRow & rmin ) {
+	if ( mTree.empty() || ! mHave[ mTree[0] ] ) {
+		return false;
+	}
+	unsigned int w = mTree[0];
+	rmin.swap( mRows[w] );
+	Advance( w );
+	Replay( w );
+	return true;
+}
+
+
+//----------------------------------------------------------------------------
+// Getter encapsulates a stream parser and buffers of rows read from it
+//----------------------------------------------------------------------------
 
+RowGetter :: RowGetter( ALib::CSVStreamParser * p, bool background )
+				: mParser( p ), mBackground( background ), mDone( false ),
+				  mRows( BATCH_SIZE ), mAhead( BATCH_SIZE ),
+				  mPos( 0 ), mCount( 0 ), mAheadCount( 0 ) {
 }
 
 RowGetter :: ~RowGetter() {
+	if ( mThread.joinable() ) {
+		mThread.join();
+	}
 	delete mParser;
 }
 
-
 //----------------------------------------------------------------------------
-// If there is anything in the latch, return that, else try to get a row
-// and return that.
+// Read the next batch of rows into the read-ahead buffer. This may run on
+// a background thread, so errors are saved to be thrown later by Next().
 //----------------------------------------------------------------------------
 
-bool RowGetter :: Get( CSVRow & row ) {
-	if ( mHave ) {
-		row = mLatch;
-		return true;
+void RowGetter :: Fill() {
+	mAheadCount = 0;
+	try {
+		while( ! mDone && mAheadCount < mAhead.size() ) {
+			if ( mParser->ParseNext( mAhead[ mAheadCount ] ) ) {
+				mAheadCount++;
+			}
+			else {
+				mDone = true;
+			}
+		}
 	}
-	else {
-		mDone = ! mParser->ParseNext( mLatch );
-		mHave = ! mDone;
-		row = mLatch;
-		return mHave;
+	catch( ... ) {
+		mError = std::current_exception();
+		mDone = true;
 	}
 }
 
 //----------------------------------------------------------------------------
-// Clear the latch - used if we have located the least row.
+// Swap next row into row, returning false if there are no more. When the
+// current batch is used up the read-ahead batch takes its place and, if
+// reading in the background, a thread is started to fill the next one.
 //----------------------------------------------------------------------------
 
-void RowGetter :: ClearLatch() {
-	mHave = false;
+bool RowGetter :: Next( CSVRow & row ) {
+	if ( mPos == mCount ) {
+		if ( mThread.joinable() ) {
+			mThread.join();
+		}
+		else {
+			Fill();
+		}
+		mRows.swap( mAhead );
+		mCount = mAheadCount;
+		mPos = 0;
+		if ( mCount == 0 ) {
+			if ( mError ) {
+				std::rethrow_exception( mError );
+			}
+			return false;
+		}
+		if ( mBackground && ! mDone ) {
+			mThread = std::thread( &RowGetter::Fill, this );
+		}
+	}
+	row.swap( mRows[ mPos++ ] );
+	return true;
 }
 
-
 } // namespace
-
-
-
-
-
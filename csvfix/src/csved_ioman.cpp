@@ -10,6 +10,7 @@
 #include "a_csv.h"
 #include "a_collect.h"
 #include "a_expr.h"
+#include "a_file.h"
 
 #include <assert.h>
 #include <fstream>
@@ -306,11 +307,15 @@ string IOManager :: CurrentFileName() const {
 	return InFileName( mInputIndex );
 }
 
+unsigned int IOManager :: CurrentStream() const {
+	return mInputIndex;
+}
+
 unsigned int IOManager :: CurrentLine() const {
 	return mCurrentLine;
 }
 
-string IOManager :: CurrentInput() const {
+const string & IOManager :: CurrentInput() const {
 	return mCurrentInput;
 }
 
@@ -383,6 +388,18 @@ bool IOManager :: ReadCSV( CSVRow & row ) {
 	return false;
 }
 
+//---------------------------------------------------------------------------
+// See if the next read may have to wait for input to arrive. Commands that
+// save up rows to process together use this to deal with what they have
+// first, so their output keeps up with input from a pipe or terminal.
+//---------------------------------------------------------------------------
+
+bool IOManager :: InputWouldWait() const {
+	return mInputIndex < mInputs.size()
+			&& mInputs[mInputIndex].mStream == & std::cin
+			&& ALib::StdinWouldWait();
+}
+
 //---------------------------------------------------------------------------
 // Open a named file for input. Use '-' to specify stdinput.
 //---------------------------------------------------------------------------
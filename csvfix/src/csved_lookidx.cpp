@@ -0,0 +1,336 @@
+//---------------------------------------------------------------------------
+// csved_lookidx.cpp
+//
+// prebuilt on-disk index of lookup file keys for validation
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#include "a_base.h"
+#include "a_csv.h"
+#include "a_hashset.h"
+#include "csved_except.h"
+#include "csved_lookidx.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using std::string;
+using std::vector;
+
+namespace CSVED {
+
+//---------------------------------------------------------------------------
+// The index file is laid out as a header, the index field numbers padded
+// to a multiple of eight bytes, the hash table slots, and then the keys,
+// each preceded by its four byte length. Everything is in native byte
+// order - the header contains a known value so that an index from a
+// machine with a different byte order is not used. Each slot is zero if
+// empty, otherwise the low bits contain the offset of the key plus one,
+// and the high bits contain the top bits of the key's hash.
+//
+// The header records the stamp of the lookup file and a checksum of its
+// contents. If the file was changed too soon before the index was built,
+// a later change might not alter the stamp, as file times only have the
+// resolution of the file system clock - such an index is marked as racy,
+// and is only used if the checksum still matches.
+//---------------------------------------------------------------------------
+
+const char * const INDEX_MAGIC = "CSVFXIDX";
+const char * const INDEX_EXT = ".idx";
+const unsigned int INDEX_VERSION = 2;
+const unsigned int INDEX_ORDER = 0x01020304;
+
+const unsigned int SLOT_OFF_BITS = 40;
+const unsigned long long SLOT_OFF_MASK = (1ULL << SLOT_OFF_BITS) - 1;
+
+// file times closer than this (in nanoseconds) may not be distinguishable
+const unsigned long long RACY_TIME = 2000000000ULL;
+
+struct IndexHeader {
+	char mMagic[8];
+	unsigned int mVersion, mOrder;
+	ALib::FileStamp mSource;
+	unsigned long long mChecksum;
+	unsigned long long mSlotCount, mKeySize;
+	unsigned int mFieldCount, mRacy;
+};
+
+static unsigned long long FieldBytes( unsigned int nfields ) {
+	return ((nfields * sizeof( unsigned int ) + 7) / 8) * 8;
+}
+
+static unsigned long long SlotTag( unsigned long long h ) {
+	return h & ~SLOT_OFF_MASK;
+}
+
+//---------------------------------------------------------------------------
+// Checksum of file contents, hashed in chunks as HashBytes() is limited
+// to a 32-bit length.
+//---------------------------------------------------------------------------
+
+static bool Checksum( const string & fname, unsigned long long & sum ) {
+	const unsigned long long CHUNK = 1 << 20;
+	ALib::MappedFile mf;
+	if ( ! mf.Open( fname ) ) {
+		return false;
+	}
+	const char * p = mf.Data();
+	unsigned long long n = mf.Size();
+	sum = n;
+	while( n ) {
+		unsigned int len = n < CHUNK ? n : CHUNK;
+		sum = (sum ^ ALib::HashBytes( p, len )) * 1099511628211ULL;
+		p += len;
+		n -= len;
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------
+// Index is kept alongside the lookup file
+//---------------------------------------------------------------------------
+
+string LookupIndex :: IndexName( const string & fname ) {
+	return fname + INDEX_EXT;
+}
+
+//---------------------------------------------------------------------------
+// Build key for a lookup file row - must be the same as the lookup rule
+//---------------------------------------------------------------------------
+
+static void MakeKey( const CSVRow & row, const FieldList & fields,
+						string & key ) {
+	key.clear();
+	for ( unsigned int i = 0; i < fields.size(); i++ ) {
+		if ( fields[i] < row.size() ) {
+			key += row[ fields[i] ];
+		}
+		key += '\0';
+	}
+}
+
+//---------------------------------------------------------------------------
+// Find slot for key, or the empty slot where it would go
+//---------------------------------------------------------------------------
+
+static unsigned long long FindSlot( const unsigned long long * slots,
+									unsigned long long mask,
+									const char * keys,
+									const char * key, unsigned int len ) {
+	unsigned long long h = ALib::HashBytes( key, len );
+	unsigned long long i = h & mask;
+	while( slots[i] ) {
+		if ( (slots[i] & ~SLOT_OFF_MASK) == SlotTag( h ) ) {
+			const char * p = keys + (slots[i] & SLOT_OFF_MASK) - 1;
+			unsigned int klen;
+			std::memcpy( & klen, p, sizeof( klen ) );
+			if ( klen == len
+					&& std::memcmp( p + sizeof( klen ), key, len ) == 0 ) {
+				break;
+			}
+		}
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+//---------------------------------------------------------------------------
+// Read lookup file and write index for the given fields. The index is
+// written to a temporary file which then replaces any existing index, so
+// that validations using the old index are not disturbed.
+//---------------------------------------------------------------------------
+
+void LookupIndex :: Build( const string & fname, const FieldList & fields ) {
+
+	IndexHeader hdr;
+	std::memset( & hdr, 0, sizeof( hdr ) );
+	std::memcpy( hdr.mMagic, INDEX_MAGIC, sizeof( hdr.mMagic ) );
+	hdr.mVersion = INDEX_VERSION;
+	hdr.mOrder = INDEX_ORDER;
+	hdr.mFieldCount = fields.size();
+
+	// get stamp before reading, so changes while we read invalidate index
+	if ( ! ALib::GetFileStamp( fname, hdr.mSource )
+			|| ! Checksum( fname, hdr.mChecksum ) ) {
+		CSVTHROW( "Cannot open lookup file " << fname << " for input" );
+	}
+	std::ifstream ifs( fname.c_str() );
+	if ( ! ifs.is_open() ) {
+		CSVTHROW( "Cannot open lookup file " << fname << " for input" );
+	}
+
+	// creating the output file gives us the file system's idea of now
+	string iname = IndexName( fname );
+	string tmpname = iname + ".tmp";
+	std::ofstream ofs( tmpname.c_str(), std::ios::binary );
+	ALib::FileStamp now;
+	if ( ! ofs.is_open() || ! ALib::GetFileStamp( tmpname, now ) ) {
+		CSVTHROW( "Cannot open index file " << tmpname << " for output" );
+	}
+	hdr.mRacy = hdr.mSource.mModTime + RACY_TIME >= now.mModTime
+				|| hdr.mSource.mChangeTime + RACY_TIME >= now.mModTime;
+
+	vector <unsigned long long> slots( 1024, 0 );
+	vector <char> keys;
+	unsigned long long nkeys = 0;
+
+	ALib::CSVStreamParser p( ifs );
+	CSVRow row;
+	string key;
+	while( p.ParseNext( row ) ) {
+		MakeKey( row, fields, key );
+		const char * kp = keys.empty() ? 0 : & keys[0];
+		unsigned long long i = FindSlot( & slots[0], slots.size() - 1, kp,
+											key.data(), key.size() );
+		if ( slots[i] ) {
+			continue;
+		}
+		if ( keys.size() + 1 > SLOT_OFF_MASK - key.size() - 4 ) {
+			ofs.close();
+			std::remove( tmpname.c_str() );
+			CSVTHROW( "Lookup file " << fname << " is too big to index" );
+		}
+		slots[i] = SlotTag( ALib::HashBytes( key.data(), key.size() ) )
+						| (keys.size() + 1);
+		unsigned int len = key.size();
+		const char * lp = (const char *) & len;
+		keys.insert( keys.end(), lp, lp + sizeof( len ) );
+		keys.insert( keys.end(), key.begin(), key.end() );
+
+		// keep the table no more than half full
+		if ( ++nkeys * 2 > slots.size() ) {
+			vector <unsigned long long> old( slots.size() * 2, 0 );
+			old.swap( slots );
+			for ( unsigned int j = 0; j < old.size(); j++ ) {
+				if ( old[j] ) {
+					const char * okp = & keys[0]
+											+ (old[j] & SLOT_OFF_MASK) - 1;
+					unsigned int olen;
+					std::memcpy( & olen, okp, sizeof( olen ) );
+					unsigned long long n = FindSlot( & slots[0],
+											slots.size() - 1, & keys[0],
+											okp + sizeof( olen ), olen );
+					slots[n] = old[j];
+				}
+			}
+		}
+	}
+
+	hdr.mSlotCount = slots.size();
+	hdr.mKeySize = keys.size();
+
+	vector <unsigned int> fv( FieldBytes( fields.size() )
+								/ sizeof( unsigned int ), 0 );
+	std::copy( fields.begin(), fields.end(), fv.begin() );
+
+	ofs.write( (const char *) & hdr, sizeof( hdr ) );
+	if ( fv.size() ) {
+		ofs.write( (const char *) & fv[0], fv.size() * sizeof( unsigned int ) );
+	}
+	ofs.write( (const char *) & slots[0],
+					slots.size() * sizeof( unsigned long long ) );
+	if ( keys.size() ) {
+		ofs.write( & keys[0], keys.size() );
+	}
+	ofs.close();
+	if ( ! ofs ) {
+		std::remove( tmpname.c_str() );
+		CSVTHROW( "Error writing index file " << tmpname );
+	}
+	std::remove( iname.c_str() );		// needed for rename on windows
+	if ( std::rename( tmpname.c_str(), iname.c_str() ) != 0 ) {
+		CSVTHROW( "Cannot rename " << tmpname << " to " << iname );
+	}
+}
+
+//---------------------------------------------------------------------------
+// Unopened index
+//---------------------------------------------------------------------------
+
+LookupIndex :: LookupIndex()
+	: mSlots( 0 ), mSlotMask( 0 ), mKeys( 0 ), mKeySize( 0 ) {
+}
+
+bool LookupIndex :: IsOpen() const {
+	return mSlots != 0;
+}
+
+//---------------------------------------------------------------------------
+// Map index for lookup file, if there is one. Returns false if there is
+// no usable index - if it doesn't match the file as it is now, is for
+// different fields, or is not valid. For a racy index, this means reading
+// the whole file to check its contents, though that is still much cheaper
+// than building the set of keys.
+//---------------------------------------------------------------------------
+
+bool LookupIndex :: Open( const string & fname, const FieldList & fields ) {
+
+	mSlots = 0;
+	if ( ! mMap.Open( IndexName( fname ) ) ) {
+		return false;
+	}
+
+	IndexHeader hdr;
+	unsigned long long size = mMap.Size();
+	if ( size < sizeof( hdr ) ) {
+		mMap.Close();
+		return false;
+	}
+	std::memcpy( & hdr, mMap.Data(), sizeof( hdr ) );
+
+	ALib::FileStamp fs;
+	unsigned long long fbytes = FieldBytes( hdr.mFieldCount );
+	unsigned long long sbytes = hdr.mSlotCount * sizeof( unsigned long long );
+	if ( std::memcmp( hdr.mMagic, INDEX_MAGIC, sizeof( hdr.mMagic ) ) != 0
+			|| hdr.mVersion != INDEX_VERSION
+			|| hdr.mOrder != INDEX_ORDER
+			|| ! ALib::GetFileStamp( fname, fs )
+			|| ! (fs == hdr.mSource)
+			|| hdr.mFieldCount != fields.size()
+			|| hdr.mSlotCount == 0
+			|| (hdr.mSlotCount & (hdr.mSlotCount - 1)) != 0
+			|| size != sizeof( hdr ) + fbytes + sbytes + hdr.mKeySize ) {
+		mMap.Close();
+		return false;
+	}
+
+	const char * p = mMap.Data() + sizeof( hdr );
+	for ( unsigned int i = 0; i < fields.size(); i++ ) {
+		unsigned int f;
+		std::memcpy( & f, p + i * sizeof( f ), sizeof( f ) );
+		if ( f != fields[i] ) {
+			mMap.Close();
+			return false;
+		}
+	}
+
+	unsigned long long sum;
+	if ( hdr.mRacy
+			&& ! (Checksum( fname, sum ) && sum == hdr.mChecksum) ) {
+		mMap.Close();
+		return false;
+	}
+
+	mSlots = (const unsigned long long *)( p + fbytes );
+	mSlotMask = hdr.mSlotCount - 1;
+	mKeys = p + fbytes + sbytes;
+	mKeySize = hdr.mKeySize;
+	return true;
+}
+
+//---------------------------------------------------------------------------
+// Is key in the index?
+//---------------------------------------------------------------------------
+
+bool LookupIndex :: Contains( const string & key ) const {
+	unsigned long long i = FindSlot( mSlots, mSlotMask, mKeys,
+										key.data(), key.size() );
+	return mSlots[i] != 0;
+}
+
+//------------------------------------------------------------------------
+
+} // end namespace
+
+// end
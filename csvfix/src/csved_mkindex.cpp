@@ -0,0 +1,79 @@
+//---------------------------------------------------------------------------
+// csved_mkindex.cpp
+//
+// build index of lookup file for validation
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#include "a_base.h"
+#include "csved_cli.h"
+#include "csved_lookidx.h"
+#include "csved_mkindex.h"
+#include "csved_strings.h"
+
+using std::string;
+
+namespace CSVED {
+
+//---------------------------------------------------------------------------
+// Register command
+//---------------------------------------------------------------------------
+
+static RegisterCommand <MakeIndexCommand> rc1_(
+	CMD_MKINDEX,
+	"build index of lookup file for validation"
+);
+
+//----------------------------------------------------------------------------
+// Help text
+//----------------------------------------------------------------------------
+
+const char * const MKINDEX_HELP = {
+	"build index of lookup file for the validate command's lookup rule\n"
+	"usage: csvfix mkindex [flags] file ...\n"
+	"where flags are:\n"
+	"  -f fields\tlookup file fields that make up the key (default 1)\n"
+	"the index for each file is written to the file name followed by .idx,\n"
+	"and is used by lookup rules with the same lookup file fields until the\n"
+	"file is changed\n"
+};
+
+//---------------------------------------------------------------------------
+// Standard ctor
+//---------------------------------------------------------------------------
+
+MakeIndexCommand :: MakeIndexCommand( const string & name,
+										const string & desc )
+		: Command( name, desc, MKINDEX_HELP ) {
+	AddFlag( ALib::CommandLineFlag( FLAG_COLS, false, 1 ) );
+}
+
+//---------------------------------------------------------------------------
+// Index each of the named files
+//---------------------------------------------------------------------------
+
+int MakeIndexCommand :: Execute( ALib::CommandLine & cmd ) {
+
+	ALib::CommaList cl( cmd.GetValue( FLAG_COLS, "1" ) );
+	FieldList fields;
+	CommaListToIndex( cl, fields );
+	if ( fields.size() == 0 ) {
+		CSVTHROW( "Need at least one field for " << FLAG_COLS << " flag" );
+	}
+
+	if ( cmd.FileCount() == 0 ) {
+		CSVTHROW( "Need at least one lookup file to index" );
+	}
+	for ( unsigned int i = 0; i < cmd.FileCount(); i++ ) {
+		LookupIndex::Build( cmd.File( i ), fields );
+	}
+
+	return 0;
+}
+
+//------------------------------------------------------------------------
+
+} // end namespace
+
+// end
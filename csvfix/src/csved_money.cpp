@@ -158,13 +158,13 @@ void MoneyCommand :: ProcessFlags( ALib::CommandLine & cmd ) {
 string MoneyCommand :: FormatValue( const string & v ) const {
 
 	// must be a number
-	if ( ! ALib::IsNumber( v ) ) {
+	double m;
+	if ( ! ALib::ParseReal( v, m ) ) {
 		return v;
 	}
 
 	// do all formatting with positive numbers and adjust sign at end
 	string sign = "";
-	double m = ALib::ToReal( v );
 
 	// is value to be treated as cents i.e. 123 rather than 1.23?
 	if ( mCents ) {
@@ -177,9 +177,7 @@ string MoneyCommand :: FormatValue( const string & v ) const {
 	}
 
 	// get the value into xx...xx.yy format
-	std::ostringstream os;
-	os << std::fixed << std::setprecision(2) << m;
-	string fs  = os.str();
+	string fs = ALib::RealStr( m, 2 );
 
 	// replace thousands sep and decimal point
 	string cents = fs.substr( fs.size() - 2, 2 );
@@ -206,7 +204,7 @@ string MoneyCommand :: FormatValue( const string & v ) const {
 	string smoney = money.str();
 
 	// add in the sign and currency symbols
-	os.str("");
+	std::ostringstream os;
 	os << ( sign == "-" ? mMinus : mPlus ) << mSymbol << smoney;
 	return os.str();
 }
@@ -0,0 +1,341 @@
+//---------------------------------------------------------------------------
+// csved_partition.cpp
+//
+// partition CSV stream into a fixed number of files by hash of key
+//
+// Copyright (C) 2009 Neil Butterworth
+//---------------------------------------------------------------------------
+
+#include "a_base.h"
+#include "a_hashset.h"
+#include "csved_cli.h"
+#include "csved_partition.h"
+#include "csved_strings.h"
+
+#include <memory>
+#include <algorithm>
+
+using std::string;
+using std::vector;
+
+namespace CSVED {
+
+//---------------------------------------------------------------------------
+// Register partition command
+//---------------------------------------------------------------------------
+
+static RegisterCommand <PartitionCommand> rc1_(
+	CMD_PARTITION,
+	"partition into files by hash of key"
+);
+
+//----------------------------------------------------------------------------
+// Defaults for file names and buffer size (in Kbytes), and the number of
+// buffers a writer thread may have queued before reading has to wait.
+//----------------------------------------------------------------------------
+
+const char * const DEF_DIR 	= "";			// directory path
+const char * const DEF_PREF = "part_";		// file name prefix
+const char * const DEF_EXT 	= "csv";		// file extension
+const char * const DEF_BSIZE = "64";
+const unsigned int MAX_QUEUED = 8;
+const unsigned int FILE_NUM_LEN = 4;
+
+//----------------------------------------------------------------------------
+// Help text
+//----------------------------------------------------------------------------
+
+const char * const PARTITION_HELP = {
+	"partitions data into a fixed number of files by hash of key fields\n"
+	"usage: csvfix partition [flags] [file ...]\n"
+	"where flags are:\n"
+	"  -f fields \tfields making up the key to partition on\n"
+	"  -n count\tnumber of partitions (files) to write to\n"
+	"  -fd dir\tdirectory to place output files in  (default is current)\n"
+	"  -fp pre\tprefix to use to generate filenames(default is part_)\n"
+	"  -fx ext\textension to use to generate filenames(default is csv)\n"
+	"  -bs size\tsize of output buffer for each partition in Kbytes\n"
+	"\t\t(default is 64)\n"
+	"  -j n\t\twrite output using n threads (default writes as it reads)\n"
+	"files are numbered from zero and are all created, even if empty - a\n"
+	"key always goes to the same numbered partition for the same count\n"
+	"#IBL,SEP,IFN,SMQ,SKIP,PASS"
+};
+
+//---------------------------------------------------------------------------
+// Usual ctor stuff
+//---------------------------------------------------------------------------
+
+PartitionCommand :: PartitionCommand( const string & name,
+										const string & desc )
+		: Command( name, desc, PARTITION_HELP ),
+			mCount( 0 ), mBufSize( 0 ), mWriters( 0 ) {
+
+	AddFlag( ALib::CommandLineFlag( FLAG_COLS, true, 1 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_NUM, true, 1 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_FSPRE, false, 1 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_FSDIR, false, 1 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_FSEXT, false, 1 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_BSIZE, false, 1 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_JOBS, false, 1 ) );
+}
+
+PartitionCommand :: ~PartitionCommand() {
+	for ( unsigned int i = 0; i < mFiles.size(); i++ ) {
+		delete mFiles[i];
+	}
+}
+
+//----------------------------------------------------------------------------
+// Read input, adding each row to the buffer for its partition. The writer
+// threads are local so that they are stopped if anything throws.
+//----------------------------------------------------------------------------
+
+int PartitionCommand :: Execute( ALib::CommandLine & cmd ) {
+
+	GetSkipOptions( cmd );
+	ProcessFlags( cmd );
+
+	IOManager io( cmd );
+	OpenFiles();
+
+	vector <std::unique_ptr <PartitionWriter> > writers;
+	for ( unsigned int i = 0; i < mWriters; i++ ) {
+		writers.push_back(
+			std::unique_ptr <PartitionWriter>( new PartitionWriter ) );
+	}
+	for ( unsigned int i = 0; mWriters && i < mFiles.size(); i++ ) {
+		mFiles[i]->mWriter = writers[ i % mWriters ].get();
+	}
+
+	CSVRow row;
+	while( io.ReadCSV( row ) ) {
+		if ( Skip( row ) ) {
+			continue;
+		}
+		if ( Pass( row ) ) {
+			io.WriteRow( row  );
+			continue;
+		}
+		PartitionFile & pf = * mFiles[ PartitionOf( row ) ];
+		pf.mBuf += io.CurrentInput();
+		pf.mBuf += '\n';
+		if ( pf.mBuf.size() >= mBufSize ) {
+			Flush( pf );
+		}
+	}
+
+	for ( unsigned int i = 0; i < mFiles.size(); i++ ) {
+		if ( mFiles[i]->mBuf.size() ) {
+			Flush( * mFiles[i] );
+		}
+	}
+	for ( unsigned int i = 0; i < writers.size(); i++ ) {
+		writers[i]->Finish();
+	}
+	CloseFiles();
+
+	return 0;
+}
+
+//----------------------------------------------------------------------------
+// The key is the key fields each followed by a null, so that the hash
+// (which is stable between runs and platforms) depends only on the field
+// values. Missing fields are treated as empty.
+//----------------------------------------------------------------------------
+
+unsigned int PartitionCommand :: PartitionOf( const CSVRow & row ) {
+	mKey.clear();
+	for ( unsigned int i = 0; i < mFields.size(); i++ ) {
+		if ( mFields[i] < row.size() ) {
+			mKey += row[ mFields[i] ];
+		}
+		mKey += '\0';
+	}
+	return ALib::HashBytes( mKey.data(), mKey.size() ) % mCount;
+}
+
+//----------------------------------------------------------------------------
+// Write partition's buffer, or hand it to its writer thread
+//----------------------------------------------------------------------------
+
+void PartitionCommand :: Flush( PartitionFile & pf ) {
+	if ( pf.mWriter ) {
+		pf.mWriter->Put( pf );
+		pf.mBuf.reserve( mBufSize );
+	}
+	else {
+		pf.Write( pf.mBuf );
+		pf.mBuf.clear();
+	}
+}
+
+//----------------------------------------------------------------------------
+// Create all the partition files. This includes those that turn out to
+// be empty, so users can rely on there being the requested number.
+//----------------------------------------------------------------------------
+
+void PartitionCommand :: OpenFiles() {
+	for ( unsigned int i = 0; i < mCount; i++ ) {
+		PartitionFile * pf = new PartitionFile;
+		mFiles.push_back( pf );
+		pf->mWriter = 0;
+		if ( mDir != "" ) {
+			pf->mName += mDir + "/";
+		}
+		pf->mName += mFilePrefix + ALib::ZeroPad( i, FILE_NUM_LEN )
+						+ "." + mFileExt;
+		pf->mOut.open( pf->mName.c_str() );
+		if ( ! pf->mOut.is_open() ) {
+			CSVTHROW( "Could not open file " << pf->mName << " for output" );
+		}
+		pf->mBuf.reserve( mBufSize );
+	}
+}
+
+void PartitionCommand :: CloseFiles() {
+	for ( unsigned int i = 0; i < mFiles.size(); i++ ) {
+		mFiles[i]->mOut.close();
+		if ( mFiles[i]->mOut.fail() ) {
+			CSVTHROW( "Error writing to file " << mFiles[i]->mName );
+		}
+	}
+}
+
+//----------------------------------------------------------------------------
+// Handle the flags - fields and partition count are required.
+//----------------------------------------------------------------------------
+
+void PartitionCommand :: ProcessFlags( ALib::CommandLine & cmd ) {
+	mDir = cmd.GetValue( FLAG_FSDIR, DEF_DIR );
+	mFilePrefix = cmd.GetValue( FLAG_FSPRE, DEF_PREF );
+	mFileExt= cmd.GetValue( FLAG_FSEXT, DEF_EXT );
+	ALib::CommaList cl( cmd.GetValue( FLAG_COLS ) );
+	CommaListToIndex( cl, mFields );
+
+	string ns = cmd.GetValue( FLAG_NUM );
+	if ( ! ALib::IsInteger( ns ) || ALib::ToInteger( ns ) < 1 ) {
+		CSVTHROW( "Invalid value for " << FLAG_NUM << ": " << ns );
+	}
+	mCount = ALib::ToInteger( ns );
+
+	string bs = cmd.GetValue( FLAG_BSIZE, DEF_BSIZE );
+	if ( ! ALib::IsInteger( bs ) || ALib::ToInteger( bs ) < 1 ) {
+		CSVTHROW( "Invalid value for " << FLAG_BSIZE << ": " << bs );
+	}
+	mBufSize = ALib::ToInteger( bs ) * 1024;
+
+	string js = cmd.GetValue( FLAG_JOBS, "0" );
+	if ( ! ALib::IsInteger( js ) || ALib::ToInteger( js ) < 0 ) {
+		CSVTHROW( "Invalid value for " << FLAG_JOBS << ": " << js );
+	}
+	mWriters = std::min( (unsigned int) ALib::ToInteger( js ), mCount );
+}
+
+//----------------------------------------------------------------------------
+// Write data to partition file
+//----------------------------------------------------------------------------
+
+void PartitionFile :: Write( const string & data ) {
+	if ( ! mOut.write( data.data(), data.size() ) ) {
+		CSVTHROW( "Error writing to file " << mName );
+	}
+}
+
+//----------------------------------------------------------------------------
+// Writer thread starts as soon as it is created
+//----------------------------------------------------------------------------
+
+PartitionWriter :: PartitionWriter() : mDone( false ) {
+	mThread = std::thread( &PartitionWriter::Run, this );
+}
+
+PartitionWriter :: ~PartitionWriter() {
+	Stop();
+}
+
+//----------------------------------------------------------------------------
+// Tell thread there will be no more buffers and wait for it to write
+// those it has.
+//----------------------------------------------------------------------------
+
+void PartitionWriter :: Stop() {
+	if ( mThread.joinable() ) {
+		{
+			std::lock_guard <std::mutex> lock( mLock );
+			mDone = true;
+		}
+		mReady.notify_one();
+		mThread.join();
+	}
+}
+
+void PartitionWriter :: Finish() {
+	Stop();
+	if ( mError ) {
+		std::rethrow_exception( mError );
+	}
+}
+
+//----------------------------------------------------------------------------
+// Queue partition's buffer for writing, leaving the partition with an
+// empty one. Waits if the thread is too far behind, and reports any
+// error the thread has had.
+//----------------------------------------------------------------------------
+
+void PartitionWriter :: Put( PartitionFile & pf ) {
+	{
+		std::unique_lock <std::mutex> lock( mLock );
+		while( mQueue.size() >= MAX_QUEUED && ! mError ) {
+			mSpace.wait( lock );
+		}
+		if ( mError ) {
+			std::rethrow_exception( mError );
+		}
+		mQueue.push_back( Chunk() );
+		mQueue.back().mFile = & pf;
+		mQueue.back().mData.swap( pf.mBuf );
+	}
+	mReady.notify_one();
+}
+
+//----------------------------------------------------------------------------
+// Thread writes queued buffers until told to stop. The lock is not held
+// while writing. After an error the remaining buffers are discarded.
+//----------------------------------------------------------------------------
+
+void PartitionWriter :: Run() {
+	Chunk c;
+	for ( ; ; ) {
+		{
+			std::unique_lock <std::mutex> lock( mLock );
+			while( mQueue.empty() && ! mDone ) {
+				mReady.wait( lock );
+			}
+			if ( mQueue.empty() ) {
+				return;
+			}
+			c.mFile = mQueue.front().mFile;
+			c.mData.swap( mQueue.front().mData );
+			mQueue.pop_front();
+		}
+		mSpace.notify_one();
+
+		try {
+			c.mFile->Write( c.mData );
+		}
+		catch( ... ) {
+			std::lock_guard <std::mutex> lock( mLock );
+			mError = std::current_exception();
+			mQueue.clear();
+		}
+		mSpace.notify_one();
+	}
+}
+
+//----------------------------------------------------------------------------
+
+} // namespace
+
+// end
+
@@ -148,9 +148,10 @@ string PrintfCommand :: FormatRow( const CSVRow & row ) {
 			string field = GetField( row, fieldno++ );
 			char c = ALib::StrLast( mFmtLine[i].mText );
 			if ( fdouble.find( c ) != std::string::npos  ) {
-				double d = ALib::IsNumber( field )
-							? ALib::ToReal( field )
-							: 0.0;
+				double d;
+				if ( ! ALib::ParseReal( field, d ) ) {
+					d = 0.0;
+				}
 				s += ALib::Format( mFmtLine[i].mText.c_str(), d );
 			}
 			else if ( fint.find( c ) != std::string::npos ) {
@@ -110,6 +110,22 @@ ValidationRule::Results ValidationRule :: Apply(
 	return r;
 }
 
+//---------------------------------------------------------------------------
+// Check if row passes this rule without building any results, so that the
+// common case of a valid row needs no memory allocation. Rules may use the
+// caller's scratch string as a work area - each thread has its own, so the
+// rules themselves can be shared.
+//---------------------------------------------------------------------------
+
+bool ValidationRule :: Passes( const CSVRow & row, string & ) const {
+	for ( unsigned int i = 0; i < mFields.size(); i++ ) {
+		if ( ! Validate( row, mFields[i] ).OK() ) {
+			return false;
+		}
+	}
+	return true;
+}
+
 //---------------------------------------------------------------------------
 // Debug dump
 //---------------------------------------------------------------------------
@@ -213,7 +229,7 @@ ValidationResult NumericRule :: Validate( const CSVRow & row,
 											unsigned int idx ) const {
 
 	if ( idx < row.size() ) {
-		string val = row[idx];
+		const string & val = row[idx];
 		if ( ! ALib::IsNumber( val ) ) {
 			return ValidationResult( idx, ALib::DQuote(val)
 											+ " is not numeric" );
@@ -232,13 +248,12 @@ ValidationResult NumericRule :: Validate( const CSVRow & row,
 void NumericRule :: MakeRanges( const Params & params ) {
 	for ( unsigned int i = 0; i < params.size(); i++ ) {
 		vector <string> tmp;
+		double min, max;
 		if ( ALib::Split( params[i], ':', tmp ) != 2
-				|| ! ALib::IsNumber( tmp[0] )
-				|| ! ALib::IsNumber( tmp[1] ) ) {
+				|| ! ALib::ParseReal( tmp[0], min )
+				|| ! ALib::ParseReal( tmp[1], max ) ) {
 			CSVTHROW( "Invalid numeric range:" << params[i] );
 		}
-		double min = ALib::ToReal( tmp[0] );
-		double max = ALib::ToReal( tmp[1] );
 		if ( min > max ) {
 			CSVTHROW( "Invalid numeric range:" << params[i] );
 		}
@@ -334,6 +349,10 @@ ValidationRule::Results FieldsRule :: Apply( const CSVRow & row ) const {
 	return res;
 }
 
+bool FieldsRule :: Passes( const CSVRow & row, string & ) const {
+	return row.size() >= mMin && row.size() <= mMax;
+}
+
 
 //---------------------------------------------------------------------------
 // Values tests a field againsta  list of values
@@ -368,7 +387,7 @@ ValidationResult ValuesRule :: Validate( const CSVRow & row,
 		return ValidationResult();
 	}
 
-	string val = row[idx];
+	const string & val = row[idx];
 	unsigned int matches = 0;
 	for ( unsigned int i = 0; i < mValues.size(); i++ ) {
 		if ( val == mValues[i] ) {
@@ -418,7 +437,7 @@ ValidationResult LengthRule :: Validate( const CSVRow & row,
 		return ValidationResult();
 	}
 
-	string val = row[idx];
+	const string & val = row[idx];
 	int len = val.size();
 
 	if ( len < mMin ) {
@@ -433,7 +452,9 @@ ValidationResult LengthRule :: Validate( const CSVRow & row,
 }
 
 //---------------------------------------------------------------------------
-// lookup rule validates fields against fields in a lookup file
+// lookup rule validates fields against fields in a lookup file. If the
+// mkindex command has built an index for the file that is still up to
+// date, we use that rather than reading the file.
 //---------------------------------------------------------------------------
 
 static AddRule <LookupRule> r6_( RULE_LOOKUP );
@@ -443,7 +464,13 @@ LookupRule :: LookupRule( const string & name,
 							const Params & params )
 	: ValidationRule( name, fl, params ) {
 	Init( params );
-	BuildFieldSet();
+	FieldList lookfields;
+	for ( unsigned int i = 0; i < mJoins.size(); i++ ) {
+		lookfields.push_back( mJoins[i].second );
+	}
+	if ( ! mIndex.Open( mLookupFile, lookfields ) ) {
+		BuildFieldSet();
+	}
 }
 
 //---------------------------------------------------------------------------
@@ -475,17 +502,10 @@ static string DisplayKey( const std::string & key ) {
 ValidationRule::Results LookupRule :: Apply( const CSVRow & row ) const {
 
 	string key;
-
-	for ( unsigned int i = 0; i < mJoins.size(); i++ ) {
-		unsigned int fi = mJoins[i].first;
-		if ( fi < row.size() ) {
-			key += row[fi];
-		}
-		key += '\0';
-	}
+	MakeKey( row, key );
 
 	Results res;
-	if ( mJoinVals.find( key ) == mJoinVals.end() ) {
+	if ( ! HasKey( key ) ) {
 		res.push_back(
 			ValidationResult( -1, "lookup of " + DisplayKey( key )
 								+ " in " + mLookupFile + " failed" )
@@ -495,6 +515,38 @@ ValidationRule::Results LookupRule :: Apply( const CSVRow & row ) const {
 }
 
 
+bool LookupRule :: Passes( const CSVRow & row, string & scratch ) const {
+	MakeKey( row, scratch );
+	return HasKey( scratch );
+}
+
+//---------------------------------------------------------------------------
+// Look key up in the prebuilt index if there is one, else in the set of
+// keys read from the lookup file.
+//---------------------------------------------------------------------------
+
+bool LookupRule :: HasKey( const string & key ) const {
+	if ( mIndex.IsOpen() ) {
+		return mIndex.Contains( key );
+	}
+	return mJoinVals.find( key ) != mJoinVals.end();
+}
+
+//---------------------------------------------------------------------------
+// Build key from the row's join fields, reusing the key's storage
+//---------------------------------------------------------------------------
+
+void LookupRule :: MakeKey( const CSVRow & row, string & key ) const {
+	key.clear();
+	for ( unsigned int i = 0; i < mJoins.size(); i++ ) {
+		unsigned int fi = mJoins[i].first;
+		if ( fi < row.size() ) {
+			key += row[fi];
+		}
+		key += '\0';
+	}
+}
+
 //---------------------------------------------------------------------------
 // This is never called - all work done in Apply()
 //---------------------------------------------------------------------------
@@ -615,10 +667,12 @@ DateRule :: DateRule( const string & name,
 	else {
 		mCheckRange = false;
 	}
+
+	mDateReader = new MaskedDateReader( mMask );
 }
 
 //---------------------------------------------------------------------------
-// Scrap reader created in Calidate()
+// Scrap reader created in ctor
 //---------------------------------------------------------------------------
 
 DateRule :: ~DateRule() {
@@ -626,16 +680,35 @@ DateRule :: ~DateRule() {
 }
 
 //---------------------------------------------------------------------------
-// Lazily create reader and use it to validate dates
+// Quick check of dates. A missing field is compared with today's date when
+// a range is given, so leave that to Validate() on the full check.
+//---------------------------------------------------------------------------
+
+bool DateRule :: Passes( const CSVRow & row, string & ) const {
+	ALib::Date dt( mMin );
+	for ( unsigned int i = 0; i < FieldCount(); i++ ) {
+		unsigned int idx = FieldAt( i );
+		if ( idx >= row.size() ) {
+			if ( mCheckRange ) {
+				return false;
+			}
+		}
+		else if ( ! mDateReader->Read( row[idx], dt )
+					|| ( mCheckRange && ( dt < mMin || dt > mMax ) ) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------
+// Use reader to validate dates. The reader is created up front, rather
+// than when first needed, so that rules can be applied by several threads.
 //---------------------------------------------------------------------------
 
 ValidationResult DateRule :: Validate( const CSVRow & row,
 									unsigned int idx ) const  {
 
-	if ( mDateReader == 0 ) {
-		mDateReader = new MaskedDateReader( mMask );
-	}
-
 	ALib::Date dt;
 	if ( idx < row.size() ) {
 		bool ok = mDateReader->Read( row[idx], dt );
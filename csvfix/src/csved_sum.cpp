@@ -41,9 +41,18 @@ const char * const SUM_HELP = {
 	"  -min fields\tfind and display minimum of fields\n"
 	"  -med fields\tcalculate median of fields\n"
 	"  -mod fields\tcalculate mode of fields\n"
+	"  -pct pcts\tcalculate percentiles (e.g. 50,90,99) of fields given by -f\n"
 	"  -sum fields\tperform summation of fields\n"
 	"  -siz\t\tfind max and min lengths of all fields\n"
+	"  -top n\tfind the n most frequent values of fields given by -f\n"
+	"\t\tusing bounded memory - output is the count, the maximum\n"
+	"\t\tamount by which the count may be too high, and the values\n"
 	"  Note that only one of the above flags can be specified\n"
+	"  -f fields\tfields to use - required for -pct and -top\n"
+	"  -sk k\t\tfor -pct, estimate percentiles with a sketch of size k\n"
+	"\t\tinstead of holding all values in memory - the estimated\n"
+	"\t\trank error is appended to the output\n"
+	"\t\tfor -top, number of counters to use (default 1000 or 10 * n)\n"
 	"#SMQ,SEP,IBL,IFN,OFL"
 };
 
@@ -53,7 +62,7 @@ const char * const SUM_HELP = {
 
 SummaryCommand :: SummaryCommand( const string & name,
 								const string & desc )
-		: Command( name, desc, SUM_HELP ) {
+		: Command( name, desc, SUM_HELP ), mSketchSize( 0 ), mTopCount( 0 ) {
 
 	AddFlag( ALib::CommandLineFlag( FLAG_AVG, false, 1 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_MIN, false, 1 ) );
@@ -63,10 +72,15 @@ SummaryCommand :: SummaryCommand( const string & name,
 	AddFlag( ALib::CommandLineFlag( FLAG_MODE, false, 1 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_SUM, false, 1 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_SIZE, false, 0 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_PCT, false, 1 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_TOP, false, 1 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_COLS, false, 1 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_SKETCH, false, 1 ) );
 }
 
 //----------------------------------------------------------------------------
-// Read all rows and then perform requested summary op on them.
+// Read all rows and then perform requested summary op on them. Sizes,
+// percentiles and top values don't need the rows to be kept.
 //----------------------------------------------------------------------------
 
 int SummaryCommand :: Execute( ALib::CommandLine & cmd ) {
@@ -77,10 +91,18 @@ int SummaryCommand :: Execute( ALib::CommandLine & cmd ) {
 	CSVRow row;
 
 	SizeMap sizemap;
+	bool gotrows = false;
 	while( io.ReadCSV( row ) ) {
+		gotrows = true;
 		if ( mType == Size ) {
 			RecordSizes( row, sizemap );
 		}
+		else if ( mType == Percentile ) {
+			RecordPercentiles( row );
+		}
+		else if ( mType == Top ) {
+			mTopItems->Add( MakeKey( row ) );
+		}
 		else {
 			mRows.push_back( row );
 		}
@@ -90,6 +112,18 @@ int SummaryCommand :: Execute( ALib::CommandLine & cmd ) {
 	if ( mType == Size ) {
 		PrintSizes( io, sizemap );
 	}
+	else if ( mType == Percentile ) {
+		if ( ! gotrows ) {
+			CSVTHROW( "No input" );
+		}
+		DoPercentiles( io );
+	}
+	else if ( mType == Top ) {
+		if ( ! gotrows ) {
+			CSVTHROW( "No input" );
+		}
+		DoTop( io );
+	}
 	else {
 		if ( mRows.size() == 0 ) {
 			CSVTHROW( "No input" );
@@ -179,6 +213,31 @@ void SummaryCommand :: DoMode( IOManager & io ) {
 }
 
 
+//----------------------------------------------------------------------------
+// Output the most frequent keys, with counts and errors prepended. Keys were
+// made by MakeKey(), so we can get the field values back by splitting on
+// the NUL terminators.
+//----------------------------------------------------------------------------
+
+void SummaryCommand :: DoTop( IOManager & io ) {
+
+	vector <ALib::FrequentItems::Item> items;
+	mTopItems->Top( mTopCount, items );
+
+	for ( unsigned int i = 0; i < items.size(); i++ ) {
+		CSVRow r;
+		r.push_back( ALib::Str( items[i].mCount ) );
+		r.push_back( ALib::Str( items[i].mError ) );
+		const string & key = items[i].mKey;
+		string::size_type pos = 0, end;
+		while( (end = key.find( '\0', pos )) != string::npos ) {
+			r.push_back( key.substr( pos, end - pos ) );
+			pos = end + 1;
+		}
+		io.WriteRow( r );
+	}
+}
+
 //----------------------------------------------------------------------------
 // Calculate frequencies and prepend to existing row data.
 //----------------------------------------------------------------------------
@@ -299,29 +358,21 @@ void SummaryCommand :: DoMinMax( IOManager & io ) {
 }
 
 //----------------------------------------------------------------------------
-// Helper struct to do numeric sorting on specific column
+// Copy numeric values of a column into an array, so that they need only be
+// converted once.
 //----------------------------------------------------------------------------
 
-struct NumSort {
-
-	NumSort( unsigned int col ) : mCol( col ) {}
-	bool operator()( const CSVRow & r1, const CSVRow & r2 ) const {
-		if ( mCol >= r1.size() || mCol >= r2.size() ) {
-			CSVTHROW( "Invalid field index " << (mCol + 1) );
-		}
-		double d1 = ALib::ToReal( r1[mCol] );
-		double d2 = ALib::ToReal( r2[mCol] );
-		if ( d1 < d2 ) {
-			return true;
-		}
-		else if ( d1 > d2 ) {
-			return false;
+void SummaryCommand :: GetColumn( unsigned int col,
+									vector <double> & vals ) const {
+	vals.clear();
+	vals.reserve( mRows.size() );
+	for ( unsigned int i = 0; i < mRows.size(); i++ ) {
+		if ( col >= mRows[i].size() ) {
+			CSVTHROW( "Invalid field index " << (col + 1) );
 		}
-		return false;
+		vals.push_back( ALib::ToReal( mRows[i][col] ) );
 	}
-
-	unsigned int mCol;
-};
+}
 
 //----------------------------------------------------------------------------
 // calculate median values for specified fields
@@ -330,28 +381,64 @@ struct NumSort {
 void SummaryCommand :: DoMedian( IOManager & io ) {
 
 	CSVRow r;
+	vector <double> vals;
+
+	for ( unsigned int i = 0; i < mFields.size(); i++ ) {
+		GetColumn( mFields[i], vals );
+		r.push_back( ALib::Str( ALib::Quantile( vals, 0.5 ) ) );
+	}
+
+	io.WriteRow( r );
+}
+
+//----------------------------------------------------------------------------
+// Add the specified fields of a row to the values or sketches we are
+// calculating percentiles for.
+//----------------------------------------------------------------------------
 
+void SummaryCommand :: RecordPercentiles( const CSVRow & row ) {
 	for ( unsigned int i = 0; i < mFields.size(); i++ ) {
-		unsigned int col = mFields[i];
-		NumSort ns( col );
-		std::sort( mRows.begin(), mRows.end(), ns );
-		unsigned int sz = mRows.size();
-		double d;
-		if ( sz % 2 ) {
-			unsigned int idx = (sz / 2);
-			d = ALib::ToReal( mRows.at(idx).at(col) );
+		unsigned int fi = mFields[i];
+		if ( fi >= row.size() ) {
+			CSVTHROW( "Invalid field index " << (fi + 1) );
+		}
+		double d = ALib::ToReal( row[fi] );
+		if ( mSketchSize ) {
+			mSketches[i].Add( d );
 		}
 		else {
-			unsigned int idx = (sz / 2) - 1;
-			double d1 = ALib::ToReal( mRows.at(idx).at(col) );
-			double d2 = ALib::ToReal( mRows.at(idx+1).at(col) );
-			d = (d1 + d2) /2;
+			mPctValues[i].push_back( d );
 		}
-
-		r.push_back( ALib::Str( d ) );
 	}
+}
 
-	io.WriteRow( r );
+//----------------------------------------------------------------------------
+// Output one row per field, containing the field index followed by the
+// requested percentiles and, for sketches, the estimated rank error.
+//----------------------------------------------------------------------------
+
+void SummaryCommand :: DoPercentiles( IOManager & io ) {
+
+	vector <double> results;
+
+	for ( unsigned int i = 0; i < mFields.size(); i++ ) {
+		CSVRow r;
+		r.push_back( ALib::Str( mFields[i] + 1 ) );
+		if ( mSketchSize ) {
+			for ( unsigned int j = 0; j < mPercentiles.size(); j++ ) {
+				double d = mSketches[i].Quantile( mPercentiles[j] );
+				r.push_back( ALib::Str( d ) );
+			}
+			r.push_back( ALib::Str( mSketches[i].RankError() ) );
+		}
+		else {
+			ALib::Quantiles( mPctValues[i], mPercentiles, results );
+			for ( unsigned int j = 0; j < results.size(); j++ ) {
+				r.push_back( ALib::Str( results[j] ) );
+			}
+		}
+		io.WriteRow( r );
+	}
 }
 
 //----------------------------------------------------------------------------
@@ -397,6 +484,91 @@ void SummaryCommand :: GetFields( const ALib::CommandLine & cmd,
 }
 
 
+//----------------------------------------------------------------------------
+// Get percentiles for -pct and set up somewhere to accumulate values for
+// each field, either exactly or in a sketch if -sk was specified.
+//----------------------------------------------------------------------------
+
+void SummaryCommand :: GetPercentiles( const ALib::CommandLine & cmd ) {
+
+	GetSelectedFields( cmd, FLAG_PCT );
+
+	ALib::CommaList cl( cmd.GetValue( FLAG_PCT ) );
+	if ( cl.Size() == 0 ) {
+		CSVTHROW( "Need percentiles for " << FLAG_PCT );
+	}
+	mPercentiles.clear();
+	for ( unsigned int i = 0; i < cl.Size(); i++ ) {
+		double p = ALib::ToReal( cl.At(i), "Invalid percentile %s" );
+		if ( p < 0 || p > 100 ) {
+			CSVTHROW( "Percentile must be in range 0 to 100" );
+		}
+		mPercentiles.push_back( p / 100 );
+	}
+
+	mSketchSize = GetSketchSize( cmd, 8 );
+	if ( mSketchSize ) {
+		mSketches.assign( mFields.size(),
+							ALib::QuantileSketch( mSketchSize ) );
+	}
+	else {
+		mPctValues.assign( mFields.size(), vector <double>() );
+	}
+}
+
+//----------------------------------------------------------------------------
+// Get number of top values for -top, and create counters for them
+//----------------------------------------------------------------------------
+
+void SummaryCommand :: GetTop( const ALib::CommandLine & cmd ) {
+
+	GetSelectedFields( cmd, FLAG_TOP );
+
+	string ts = cmd.GetValue( FLAG_TOP );
+	int n = ALib::ToInteger( ts, "Invalid value for " + string( FLAG_TOP )
+									+ ": %s" );
+	if ( n < 1 ) {
+		CSVTHROW( "Value for " << FLAG_TOP << " must be greater than zero" );
+	}
+	mTopCount = n;
+
+	unsigned int counters = GetSketchSize( cmd, mTopCount );
+	if ( counters == 0 ) {
+		counters = std::max( 1000u, 10 * mTopCount );
+	}
+	mTopItems.reset( new ALib::FrequentItems( counters ) );
+}
+
+//----------------------------------------------------------------------------
+// The -pct and -top flags get their fields from -f, which must be given
+//----------------------------------------------------------------------------
+
+void SummaryCommand :: GetSelectedFields( const ALib::CommandLine & cmd,
+											const string & flag ) {
+	if ( ! cmd.HasFlag( FLAG_COLS ) ) {
+		CSVTHROW( "Need " << FLAG_COLS << " flag to specify fields for "
+					<< flag );
+	}
+	GetFields( cmd, FLAG_COLS );
+}
+
+//----------------------------------------------------------------------------
+// Get optional sketch size, returning zero if not specified
+//----------------------------------------------------------------------------
+
+unsigned int SummaryCommand :: GetSketchSize( const ALib::CommandLine & cmd,
+												unsigned int minsize ) {
+	if ( ! cmd.HasFlag( FLAG_SKETCH ) ) {
+		return 0;
+	}
+	string ss = cmd.GetValue( FLAG_SKETCH );
+	int k = ALib::ToInteger( ss, "Invalid sketch size %s" );
+	if ( k < (int) minsize ) {
+		CSVTHROW( "Sketch size must be at least " << minsize );
+	}
+	return k;
+}
+
 //----------------------------------------------------------------------------
 // Helper template to do actual comparison, returning as for strcmp()
 //----------------------------------------------------------------------------
@@ -420,9 +592,8 @@ int TCmp( const T & t1, const T & t2 ) {
 //----------------------------------------------------------------------------
 
 static int NSCmp( const std::string & s1, const std::string & s2 ) {
-	if ( ALib::IsNumber( s1 ) && ALib::IsNumber( s2 ) ) {
-		double d1 = ALib::ToReal( s1 );
-		double d2 = ALib::ToReal( s2 );
+	double d1, d2;
+	if ( ALib::ParseReal( s1, d1 ) && ALib::ParseReal( s2, d2 ) ) {
 		return TCmp( d1, d2 );
 	}
 	else {
@@ -457,6 +628,15 @@ int SummaryCommand :: Cmp( const CSVRow & r1, const CSVRow & r2 ) const {
 void SummaryCommand :: ProcessFlags( const ALib::CommandLine & cmd ) {
 
 	int nf = CountNonGeneric( cmd );
+	if ( cmd.HasFlag( FLAG_PCT ) || cmd.HasFlag( FLAG_TOP ) ) {
+		nf -= cmd.HasFlag( FLAG_COLS ) + cmd.HasFlag( FLAG_SKETCH );
+	}
+	else if ( cmd.HasFlag( FLAG_COLS ) || cmd.HasFlag( FLAG_SKETCH ) ) {
+		CSVTHROW( "Flags " << FLAG_COLS << " and " << FLAG_SKETCH
+					<< " can only be used with " << FLAG_PCT
+					<< " or " << FLAG_TOP );
+	}
+
 	if ( nf == 0 ) {
 		CSVTHROW( "Need a summary flag" );
 	}
@@ -495,6 +675,14 @@ void SummaryCommand :: ProcessFlags( const ALib::CommandLine & cmd ) {
 	else if ( cmd.HasFlag( FLAG_SIZE ) ) {
 		mType = Size;
 	}
+	else if ( cmd.HasFlag( FLAG_PCT ) ) {
+		mType = Percentile;
+		GetPercentiles( cmd );
+	}
+	else if ( cmd.HasFlag( FLAG_TOP ) ) {
+		mType = Top;
+		GetTop( cmd );
+	}
 	else {
 		CSVTHROW( "Should never happen in SummaryCommand::ProcessFlags" );
 	}
@@ -12,6 +12,7 @@
 #include "csved_except.h"
 #include "a_expr.h"
 #include <fstream>
+#include <memory>
 
 using std::string;
 
@@ -47,6 +48,12 @@ const char * const TPL_HELP = {
 	"#IBL,SEP,IFN,OFL,SKIP"
 };
 
+//----------------------------------------------------------------------------
+// Number of files written by each batch handed to the file writer thread
+//----------------------------------------------------------------------------
+
+const unsigned int FILE_BATCH = 64;
+
 //---------------------------------------------------------------------------
 // Standard command ctor
 //---------------------------------------------------------------------------
@@ -60,146 +67,320 @@ TemplateCommand ::	TemplateCommand( const string & name,
 }
 
 //---------------------------------------------------------------------------
-// Put all input through template to format output
+// Put all input through template to format output. With the -fn option,
+// which is itself a template, each row goes to the file it names - the
+// files are written by another thread while we carry on rendering.
 //---------------------------------------------------------------------------
 
 int TemplateCommand :: Execute( ALib::CommandLine & cmd ) {
 
 	GetSkipOptions( cmd );
 	ReadTemplate( cmd );
+	mBody.Compile( mTemplate );
 
+	std::unique_ptr <TemplateFileWriter> writer;
 	if ( cmd.HasFlag( FLAG_FNAMES ) ) {
-		mFileTemplate = cmd.GetValue( FLAG_FNAMES );
+		mFileName.Compile( cmd.GetValue( FLAG_FNAMES ) );
+		writer.reset( new TemplateFileWriter );
 	}
 
 	IOManager io( cmd );
 	CSVRow row;
+	string fname, out;
+
+	// If a row fails, the files for the rows before it must still be
+	// written, but it is the row's error that gets reported. As when files
+	// were written directly, a row whose file was named but whose body
+	// failed leaves that file empty.
+
+	bool named = false;
+	try {
+		while( io.ReadCSV( row ) ) {
+			if ( Skip( row ) ) {
+				continue;
+			}
 
-	while( io.ReadCSV( row ) ) {
-		if ( Skip( row ) ) {
-			continue;
-		}
-
-		if ( mFileTemplate.empty() ) {
-			io.Out() << ReplaceColumns( mTemplate, row );
+			out.clear();
+			if ( writer.get() ) {
+				fname.clear();
+				mFileName.Render( row, fname );
+				named = true;
+			}
+			mBody.Render( row, out );
+			if ( writer.get() ) {
+				named = false;
+				writer->Add( fname, out );
+			}
+			else {
+				io.Out().write( out.data(), out.size() );
+			}
 		}
-		else {
-			FileOut( row );
+	}
+	catch( ... ) {
+		if ( writer.get() ) {
+			try {
+				if ( named ) {
+					out.clear();
+					writer->Add( fname, out );
+				}
+				writer->Finish();
+			}
+			catch( ... ) {
+			}
 		}
+		throw;
+	}
+
+	if ( writer.get() ) {
+		writer->Finish();
 	}
 
 	return 0;
 }
 
 //----------------------------------------------------------------------------
-// Output to a file specified by the -fn option, which itself is a template.
+// Compiled template owns its expressions
 //----------------------------------------------------------------------------
 
-void TemplateCommand :: FileOut( const CSVRow & row  ) {
-	string fname = ReplaceColumns( mFileTemplate, row );
-	std::ofstream ifs( fname );
-	if ( ! ifs.is_open() ) {
-		CSVTHROW( "Cannot open file " << fname << " for output" );
+CompiledTemplate :: CompiledTemplate() {
+}
+
+CompiledTemplate :: ~CompiledTemplate() {
+	for ( unsigned int i = 0; i < mExprs.size(); i++ ) {
+		delete mExprs[i];
 	}
-	ifs << ReplaceColumns( mTemplate, row );
 }
 
 //---------------------------------------------------------------------------
-// Handles the special characters backslash and open brace. Backslash
-// does C-style quoting of the next character. Open brace introduces
-// a formatting placeholder. For exanple {2} will be replaced by column
-// two from the input row. Append placeholder value to the 'out'
-// parameter. Also updates the 'pos' param with new position in template.
-//
-// If the string in braces begins with the special EVALCHR character, it is
-// an expression in the expression language and needs to be evaluated.
+// Parse template into segments. Backslash does C-style quoting of the next
+// character. Open brace introduces a formatting placeholder. For example
+// {2} will be replaced by column two from the input row. If the string in
+// braces begins with the special EVALCHR character, it is an expression
+// in the expression language, which is compiled now and evaluated for
+// each row.
 //---------------------------------------------------------------------------
 
-void TemplateCommand :: HandleSpecialChars( const string & tplate,
-											char c, unsigned int & pos,
-											const CSVRow & row,
-											string & out ) {
-	char t = tplate[ pos++ ];
-	if ( c == '\\' ) {
-		switch( t ) {
-			case '\n':
-			case '\r':	CSVTHROW( "Invalid escape at end of line" );
-			case 'n':	out += '\n'; break;
-			case 't':	out += '\t'; break;
-			default:	out += t;
-		}
-	}
-	else {		// its a brace
-		string ns;
-		while( t != POUTRO) {
-			if ( t == '\n' || t == '\r' ) {
+void CompiledTemplate :: Compile( const string & tplate ) {
+
+	if ( ALib::IsEmpty( tplate ) ) {
+		CSVTHROW( "No template contents" );
+	}
+
+	unsigned int pos = 0, len = tplate.size();
+
+	while( pos != len ) {
+		char c = tplate[pos++];
+		if ( c == '\\' ) {
+			char t = pos == len ? '\n' : tplate[ pos++ ];
+			switch( t ) {
+				case '\n':
+				case '\r':	CSVTHROW( "Invalid escape at end of line" );
+				case 'n':	AddLiteral( '\n' ); break;
+				case 't':	AddLiteral( '\t' ); break;
+				default:	AddLiteral( t );
+			}
+		}
+		else if ( c == PINTRO ) {
+			string ph;
+			char t;
+			while( pos != len && ( t = tplate[ pos++ ] ) != POUTRO ) {
+				if ( t == '\n' || t == '\r' ) {
+					break;
+				}
+				ph += t;
+			}
+			if ( tplate[ pos - 1 ] != POUTRO ) {
 				CSVTHROW( "Missing closing brace" );
 			}
-			ns += t;
-			t = tplate[ pos++ ];
+			AddPlaceholder( ph );
 		}
-
-		if( ns.size() && ns[0] == EVALCHR ) {    // it's an expression
-			out += Eval( row, ns );
-			return;
+		else {
+			AddLiteral( c );
 		}
+	}
+}
 
-		if ( ! ALib::IsInteger( ns ) ) {
-			CSVTHROW( "Invalid placeholder: " << "{" << ns << "}" );
-		}
+//----------------------------------------------------------------------------
+// Literal characters are merged into a single segment
+//----------------------------------------------------------------------------
+
+void CompiledTemplate :: AddLiteral( char c ) {
+	if ( mSegments.empty() || mSegments.back().mKind != SEG_LITERAL ) {
+		Segment seg;
+		seg.mKind = SEG_LITERAL;
+		seg.mIndex = 0;
+		mSegments.push_back( seg );
+	}
+	mSegments.back().mText += c;
+}
 
-		int n =  ALib::ToInteger( ns ) - 1;		// to zero based
+//----------------------------------------------------------------------------
+// Placeholder is either an expression or a one-based field number
+//----------------------------------------------------------------------------
+
+void CompiledTemplate :: AddPlaceholder( const string & ph ) {
+	Segment seg;
+	if ( ph.size() && ph[0] == EVALCHR ) {
+		std::unique_ptr <ALib::Expression> ex( new ALib::Expression );
+		string emsg = ex->Compile( ph.substr( 1 ) );
+		if ( emsg != "" ) {
+			CSVTHROW( emsg );
+		}
+		seg.mKind = SEG_EXPR;
+		seg.mIndex = mExprs.size();
+		mExprs.push_back( ex.release() );
+	}
+	else {
+		int n = ALib::IsInteger( ph ) ? ALib::ToInteger( ph ) - 1 : -1;
 		if ( n < 0 ) {
-			CSVTHROW( "Invalid placeholder: " << "{" << ns << "}" );
+			CSVTHROW( "Invalid placeholder: " << "{" << ph << "}" );
 		}
+		seg.mKind = SEG_FIELD;
+		seg.mIndex = n;
+	}
+	mSegments.push_back( seg );
+}
+
+//---------------------------------------------------------------------------
+// Append the template, with placeholders replaced by the coresponding
+// column from the row, to out. If there is no such column, ignore it.
+//---------------------------------------------------------------------------
 
-		if ( (unsigned int) n < row.size() ) {
-			out += row[ n ];
+void CompiledTemplate :: Render( const CSVRow & row, string & out ) {
+	for ( unsigned int i = 0; i < mSegments.size(); i++ ) {
+		const Segment & seg = mSegments[i];
+		if ( seg.mKind == SEG_LITERAL ) {
+			out += seg.mText;
+		}
+		else if ( seg.mKind == SEG_FIELD ) {
+			if ( seg.mIndex < row.size() ) {
+				out += row[ seg.mIndex ];
+			}
+		}
+		else {
+			ALib::Expression & ex = * mExprs[ seg.mIndex ];
+			ex.BindPosParams( row );
+			out += ex.Evaluate();
 		}
 	}
 }
 
 //----------------------------------------------------------------------------
-// Evaluate a string as an expression. The string will start with EVALCHR
-// which needs to be removed.
+// File writer thread starts as soon as it is created
 //----------------------------------------------------------------------------
 
-string TemplateCommand :: Eval( const CSVRow & row, const string & expr ) {
-	ALib::Expression ex;
-	for( unsigned int i = 0; i < row.size(); i++ ) {
-		ex.AddPosParam( row[i] );
+TemplateFileWriter :: TemplateFileWriter()
+	: mFilling( FILE_BATCH ), mWriting( FILE_BATCH ),
+	  mFillCount( 0 ), mWriteCount( 0 ), mBusy( false ), mDone( false ) {
+	mThread = std::thread( &TemplateFileWriter::Run, this );
+}
+
+TemplateFileWriter :: ~TemplateFileWriter() {
+	Stop();
+}
+
+//----------------------------------------------------------------------------
+// Add file to current batch, swapping the strings to avoid copying them.
+// The caller gets back strings with no content but useful capacity.
+//----------------------------------------------------------------------------
+
+void TemplateFileWriter :: Add( string & fname, string & text ) {
+	OutFile & f = mFilling[ mFillCount++ ];
+	f.mName.swap( fname );
+	f.mText.swap( text );
+	fname.clear();
+	text.clear();
+	if ( mFillCount == mFilling.size() ) {
+		HandOver();
 	}
-	return ex.Evaluate( expr.substr( 1 ) );
 }
 
-//---------------------------------------------------------------------------
-// Replace all placeholders enclosed in braces in the template with the
-// coresponding column from therow. If there is no such column, ignore.
-// Other characters are copied literaly to output.
-//---------------------------------------------------------------------------
+//----------------------------------------------------------------------------
+// Wait for the thread to finish its batch, then give it the one we have
+// been filling. Any error the thread had is reported here.
+//----------------------------------------------------------------------------
+
+void TemplateFileWriter :: HandOver() {
+	{
+		std::unique_lock <std::mutex> lock( mLock );
+		while( mBusy ) {
+			mChanged.wait( lock );
+		}
+		if ( mError ) {
+			std::rethrow_exception( mError );
+		}
+		mFilling.swap( mWriting );
+		mWriteCount = mFillCount;
+		mFillCount = 0;
+		mBusy = true;
+	}
+	mChanged.notify_all();
+}
 
-string TemplateCommand :: ReplaceColumns( const string & tplate,
-											const CSVRow & row ) {
+//----------------------------------------------------------------------------
+// Write remaining files and wait for the thread to finish
+//----------------------------------------------------------------------------
 
-	if ( ALib::IsEmpty( tplate ) ) {
-		CSVTHROW( "No template contents" );
+void TemplateFileWriter :: Finish() {
+	if ( mFillCount ) {
+		HandOver();
 	}
+	Stop();
+	if ( mError ) {
+		std::rethrow_exception( mError );
+	}
+}
 
-	unsigned int pos = 0, len = tplate.size();
+void TemplateFileWriter :: Stop() {
+	if ( mThread.joinable() ) {
+		{
+			std::lock_guard <std::mutex> lock( mLock );
+			mDone = true;
+		}
+		mChanged.notify_all();
+		mThread.join();
+	}
+}
 
-	string out;
+//----------------------------------------------------------------------------
+// Thread writes each batch it is given. Files are written in the order
+// the rows were read, so if two rows name the same file the last one wins,
+// and writing stops at the first error.
+//----------------------------------------------------------------------------
 
-	while( pos != len ) {
-		char c = tplate[pos++];
-		if ( c == '\\' || c == PINTRO ) {
-			HandleSpecialChars( tplate, c, pos, row, out );
+void TemplateFileWriter :: Run() {
+	for ( ; ; ) {
+		{
+			std::unique_lock <std::mutex> lock( mLock );
+			while( ! mBusy && ! mDone ) {
+				mChanged.wait( lock );
+			}
+			if ( ! mBusy ) {
+				return;
+			}
 		}
-		else {
-			out += c;
+		try {
+			for ( unsigned int i = 0; i < mWriteCount; i++ ) {
+				const OutFile & f = mWriting[i];
+				std::ofstream ofs( f.mName.c_str() );
+				if ( ! ofs.is_open() ) {
+					CSVTHROW( "Cannot open file " << f.mName
+								<< " for output" );
+				}
+				ofs.write( f.mText.data(), f.mText.size() );
+			}
+		}
+		catch( ... ) {
+			std::lock_guard <std::mutex> lock( mLock );
+			mError = std::current_exception();
+			mDone = true;
 		}
+		{
+			std::lock_guard <std::mutex> lock( mLock );
+			mBusy = false;
+		}
+		mChanged.notify_all();
 	}
-
-	return out;
 }
 
 //---------------------------------------------------------------------------
@@ -12,7 +12,9 @@
 #include "csved_cli.h"
 #include "csved_valid.h"
 #include "csved_strings.h"
+#include <algorithm>
 #include <fstream>
+#include <thread>
 #include <ctype.h>
 
 using std::string;
@@ -39,6 +41,7 @@ const char * const VALID_HELP = {
 	"where flags are:\n"
 	"  -vf file\tspecify file containing validation rules\n"
 	"  -om mode\toutput mode (pass,fail,report)\n"
+	"  -j n\t\tvalidate using n threads\n"
 	"#IFN,SEP,OFL,IBL,SKIP"
 };
 
@@ -48,10 +51,12 @@ const char * const VALID_HELP = {
 
 ValidateCommand ::	ValidateCommand( const string & name,
 										const string & desc )
-		: Command( name, desc, VALID_HELP ), mOutMode( Reports ) {
+		: Command( name, desc, VALID_HELP ), mOutMode( Reports ),
+			mFailed( false ) {
 	AddFlag( ALib::CommandLineFlag( FLAG_VFILE, true, 1 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_OMODE, false, 1 ) );
 	AddFlag( ALib::CommandLineFlag( FLAG_ERRCODE, false, 0 ) );
+	AddFlag( ALib::CommandLineFlag( FLAG_JOBS, false, 1 ) );
 }
 
 //---------------------------------------------------------------------------
@@ -72,7 +77,9 @@ void ValidateCommand :: Clear() {
 }
 
 //---------------------------------------------------------------------------
-// Read inputs and for each row apply rules.
+// Read inputs and for each row apply rules. With the -j flag, rows are
+// read in batches which are validated by several threads while the next
+// batch is being read. Output is always in input order.
 //---------------------------------------------------------------------------
 
 int ValidateCommand :: Execute( ALib::CommandLine & cmd ) {
@@ -81,44 +88,213 @@ int ValidateCommand :: Execute( ALib::CommandLine & cmd ) {
 	GetOutputMode( cmd );
 	ReadValidationFile( cmd );
 
+	string js = cmd.GetValue( FLAG_JOBS, "1" );
+	if ( ! ALib::IsInteger( js ) || ALib::ToInteger( js ) < 1 ) {
+		CSVTHROW( "Invalid value for " << FLAG_JOBS << ": " << js );
+	}
+	unsigned int njobs = ALib::ToInteger( js );
+
 	IOManager io( cmd );
 	CSVRow row;
 
 	// we optionally return an error code to the shell if validation failed
-	int errtotal = 0;
+	mFailed = false;
 	bool errcode = cmd.HasFlag( FLAG_ERRCODE );
 
-	while( io.ReadCSV( row ) ) {
-		if ( Skip( row ) ) {
+	if ( njobs > 1 ) {
+		ExecuteParallel( io, njobs );
+	}
+	else {
+		while( io.ReadCSV( row ) ) {
+			if ( Skip( row ) ) {
+				continue;
+			}
+			if ( RowPasses( row, mScratch ) ) {
+				if ( mOutMode == Passes ) {
+					io.WriteRow( row );
+				}
+			}
+			else {
+				RowFailed( io, row, io.CurrentFileName(),
+							io.CurrentLine(), io.CurrentInput() );
+			}
+		}
+	}
+
+    // exit code of 2 indicates program detected invalid data
+	return mFailed && errcode ? 2 : 0;
+}
+
+//---------------------------------------------------------------------------
+// Quick check that a row passes all the rules, which allocates nothing
+//---------------------------------------------------------------------------
+
+bool ValidateCommand :: RowPasses( const CSVRow & row,
+									string & scratch ) const {
+	for ( unsigned int i = 0; i < mRules.size(); i++ ) {
+		if ( ! mRules[i]->Passes( row, scratch ) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+//---------------------------------------------------------------------------
+// Row has failed the quick check, so apply the rules again to get the
+// results and report or output the row as required.
+//---------------------------------------------------------------------------
+
+void ValidateCommand :: RowFailed( IOManager & io, const CSVRow & row,
+									const string & fname, unsigned int line,
+									const string & input ) {
+	int errcount = 0;
+	for ( unsigned int i = 0; i < mRules.size(); i++ ) {
+		ValidationRule::Results res = mRules[i]->Apply( row );
+
+		if ( res.size() && mOutMode == Reports ) {
+			Report( io, res, errcount, fname, line, input );
+			errcount++;
 			continue;
 		}
-		int errcount = 0;
-		for ( unsigned int i = 0; i < mRules.size(); i++ ) {
-			ValidationRule::Results res = mRules[i]->Apply( row );
-
-			if ( res.size() && mOutMode == Reports ) {
-				Report( io, res, errcount );
-				errcount++;
-				errtotal += errcount;
+
+		if ( res.size() ) {
+			errcount++;
+			if ( mOutMode == Fails ) {
+				io.WriteRow( row );
+				break;
+			}
+		}
+	}
+	if ( mOutMode == Passes && errcount == 0 ) {
+		io.WriteRow( row );
+	}
+	if ( errcount ) {
+		mFailed = true;
+	}
+}
+
+//---------------------------------------------------------------------------
+// Validate using several threads. While the jobs are checking one batch
+// we read the next, and then output the results of the first in order.
+// Errors are reported once the rows before them have been output.
+//---------------------------------------------------------------------------
+
+void ValidateCommand :: ExecuteParallel( IOManager & io,
+											unsigned int njobs ) {
+	RowBatch batch[2];
+	batch[0].resize( njobs * BATCH_SIZE );
+	batch[1].resize( njobs * BATCH_SIZE );
+	vector <char> passed[2];
+	std::exception_ptr readerr;
+	unsigned int cur = 0;
+	unsigned int n = ReadBatch( io, batch[cur], readerr );
+
+	while( n ) {
+		passed[cur].resize( n );
+		vector <Job> jobs( njobs );
+		vector <std::thread> threads;
+		unsigned int chunk = (n + njobs - 1) / njobs;
+		for ( unsigned int i = 0; i < njobs; i++ ) {
+			Job & job = jobs[i];
+			job.mCmd = this;
+			job.mBatch = & batch[cur];
+			job.mPassed = & passed[cur];
+			job.mBegin = std::min( n, i * chunk );
+			job.mEnd = std::min( n, job.mBegin + chunk );
+			job.mErrorRow = job.mEnd;
+			if ( job.mBegin < job.mEnd ) {
+				threads.push_back( std::thread( &Job::Run, &job ) );
+			}
+		}
+
+		unsigned int next = 0;
+		if ( ! readerr ) {
+			next = ReadBatch( io, batch[1 - cur], readerr );
+		}
+
+		for ( unsigned int i = 0; i < threads.size(); i++ ) {
+			threads[i].join();
+		}
+		EmitBatch( io, batch[cur], passed[cur], jobs );
+
+		cur = 1 - cur;
+		n = next;
+	}
+
+	if ( readerr ) {
+		std::rethrow_exception( readerr );
+	}
+}
+
+//---------------------------------------------------------------------------
+// Read rows that are not skipped into batch, reusing the batch's storage.
+// Returns number of rows read. If reading fails, the error is kept to be
+// rethrown once the rows we did read have been dealt with.
+//---------------------------------------------------------------------------
+
+unsigned int ValidateCommand :: ReadBatch( IOManager & io, RowBatch & batch,
+											std::exception_ptr & error ) {
+	unsigned int size = batch.size();
+	unsigned int n = 0;
+	try {
+		while( n < size && io.ReadCSV( batch[n].mRow ) ) {
+			if ( Skip( batch[n].mRow ) ) {
 				continue;
 			}
+			batch[n].mInput = io.CurrentInput();
+			batch[n].mStream = io.CurrentStream();
+			batch[n].mLine = io.CurrentLine();
+			n++;
+		}
+	}
+	catch( ... ) {
+		error = std::current_exception();
+	}
+	return n;
+}
 
-			if ( res.size() ) {
-				errcount++;
-				if ( mOutMode == Fails ) {
-					io.WriteRow( row );
-					break;
+//---------------------------------------------------------------------------
+// Check rows in job's part of the batch, stopping at the first error
+//---------------------------------------------------------------------------
+
+void ValidateCommand :: Job :: Run() {
+	for ( unsigned int i = mBegin; i < mEnd; i++ ) {
+		try {
+			(*mPassed)[i] = mCmd->RowPasses( (*mBatch)[i].mRow, mScratch );
+		}
+		catch( ... ) {
+			mError = std::current_exception();
+			mErrorRow = i;
+			return;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------
+// Output results for a checked batch in input order
+//---------------------------------------------------------------------------
+
+void ValidateCommand :: EmitBatch( IOManager & io, const RowBatch & batch,
+									const vector <char> & passed,
+									const vector <Job> & jobs ) {
+	for ( unsigned int j = 0; j < jobs.size(); j++ ) {
+		const Job & job = jobs[j];
+		for ( unsigned int i = job.mBegin; i < job.mErrorRow; i++ ) {
+			const InputRow & r = batch[i];
+			if ( passed[i] ) {
+				if ( mOutMode == Passes ) {
+					io.WriteRow( r.mRow );
 				}
 			}
+			else {
+				RowFailed( io, r.mRow, io.InFileName( r.mStream ),
+							r.mLine, r.mInput );
+			}
 		}
-		if ( mOutMode == Passes && errcount == 0 ) {
-			io.WriteRow( row );
+		if ( job.mError ) {
+			std::rethrow_exception( job.mError );
 		}
-		errtotal += errcount;
 	}
-
-    // exit code of 2 indicates program detected invalid data
-	return errtotal && errcode ? 2 : 0;
 }
 
 //---------------------------------------------------------------------------
@@ -151,14 +327,16 @@ void ValidateCommand :: GetOutputMode( const ALib::CommandLine & cl ) {
 
 void ValidateCommand :: Report( IOManager & io,
 								const ValidationRule::Results & res,
-								int errcount ) const {
+								int errcount, const string & fname,
+								unsigned int line,
+								const string & input ) const {
 	if ( res.size() == 0 ) {
 		return;
 	}
 	else {
 		if ( errcount == 0 ) {
-			io.Out() << io.CurrentFileName() << " (" << io.CurrentLine () << "): ";
-			io.Out() << io.CurrentInput() << "\n";
+			io.Out() << fname << " (" << line << "): ";
+			io.Out() << input << "\n";
 		}
 		for ( unsigned int i = 0; i < res.size(); i++ ) {
 			if ( res[i].Field() > 0 ) {